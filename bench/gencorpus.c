@@ -0,0 +1,265 @@
+/* gencorpus.c - synthetic benchmark corpus for rrep.
+   Copyright (C) 2026 Arno Onken <asnelt@asnelt.org>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA
+   02110-1301, USA.  */
+
+/* Writes the benchmark corpus into a directory.  The corpus only depends on
+   the scale, since the text comes from a private pseudo random generator
+   instead of rand.  The sizes of all parts are written to the file SIZES in
+   the directory, one part per line with its name and its length in bytes.
+
+   Every part consists of lines of words.  Matches are the word needle, an
+   occasional number behind it and repeated words for back-references.  */
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+/* Sizes of the parts for scale 1.  */
+#define SMALL_FILES (10000) /* Number of small files.  */
+#define SMALL_SIZE (2048) /* Mean length of a small file.  */
+#define DIRS (100) /* Number of directories for the small files.  */
+#define DEEP_LEVELS (64) /* Depth of the deep tree.  */
+#define DEEP_FILES (8) /* Number of files per level of the deep tree.  */
+#define DEEP_SIZE (4096) /* Mean length of a file in the deep tree.  */
+#define HUGE_SIZE (64*1024*1024) /* Length of the huge file.  */
+#define LONG_LINES (16) /* Number of lines of the file with long lines.  */
+#define LONG_SIZE (1024*1024) /* Length of a long line.  */
+#define DENSITY_SIZE (16*1024*1024) /* Length of the density files.  */
+#define BINARY_FILES (200) /* Number of binary files.  */
+#define BINARY_SIZE (8192) /* Length of a binary file.  */
+
+/* Mean number of words per line.  */
+#define LINE_WORDS (10)
+
+/* Words that make up the text.  */
+static const char *const words[] =
+  {
+    "the", "of", "and", "to", "in", "is", "that", "for", "it", "as", "with",
+    "was", "on", "be", "by", "this", "are", "from", "at", "or", "an", "not",
+    "buffer", "line", "pattern", "match", "replace", "file", "string",
+    "return", "static", "size_t", "const", "char", "int", "void", "struct",
+    "needles", "haystack", "needless", "kneedle"
+  };
+
+/* Number of words.  */
+#define NWORDS (sizeof (words) / sizeof (words[0]))
+
+/* State of the pseudo random generator.  */
+static uint64_t state = 88172645463325252ULL;
+
+/* Directory of the corpus.  */
+static const char *corpus;
+
+/* File with the sizes of the parts.  */
+static FILE *sizes;
+
+/* Returns the next pseudo random number.  */
+static uint64_t
+next_random ()
+{
+  /* xorshift64* by Sebastiano Vigna.  */
+  state ^= state >> 12;
+  state ^= state << 25;
+  state ^= state >> 27;
+  return state * 2685821657736338717ULL;
+}
+
+/* Returns a pseudo random number below n.  */
+static size_t
+random_below (size_t n)
+{
+  return (next_random () >> 11) % n;
+}
+
+/* Exits with a message about the file name.  */
+static void
+die (const char *name)
+{
+  fprintf (stderr, "gencorpus: %s: %s\n", name, strerror (errno));
+  exit (EXIT_FAILURE);
+}
+
+/* Creates the directory name inside the corpus.  */
+static void
+make_dir (const char *name)
+{
+  char path[4096];
+
+  snprintf (path, sizeof (path), "%s/%s", corpus, name);
+  if (mkdir (path, 0755) != 0 && errno != EEXIST)
+    die (path);
+}
+
+/* Writes a line of text to fp and returns its length.  With probability
+   1/density, the line contains the word needle.  A density of 0 means no
+   matches.  If long_len is not 0, the line has about long_len characters.  */
+static size_t
+write_line (FILE *fp, size_t density, size_t long_len)
+{
+  const char *word;
+  size_t len = 0;
+  size_t nwords, i, needle;
+
+  nwords = long_len > 0 ? long_len / 6 : 1 + random_below (2 * LINE_WORDS);
+  needle = density > 0 && random_below (density) == 0
+           ? random_below (nwords) : nwords;
+  for (i = 0; i < nwords; i++)
+    {
+      if (i == needle)
+        {
+          len += fprintf (fp, random_below (4) == 0 ? "needle%u " : "needle ",
+                          (unsigned) random_below (1000));
+          continue;
+        }
+      word = words[random_below (NWORDS)];
+      len += fprintf (fp, "%s ", word);
+      /* Repeated words for back-references.  */
+      if (random_below (64) == 0)
+        len += fprintf (fp, "%s ", word);
+    }
+  fputc ('\n', fp);
+
+  return len + 1;
+}
+
+/* Writes a file name inside the corpus with about size characters of text
+   with the given match density.  If null_flag is set, a null character is
+   put into the first line.  Returns the length of the file.  */
+static size_t
+write_file (const char *name, size_t size, size_t density, size_t long_len,
+            int null_flag)
+{
+  char path[4096];
+  FILE *fp;
+  size_t len = 0;
+
+  snprintf (path, sizeof (path), "%s/%s", corpus, name);
+  fp = fopen (path, "w");
+  if (fp == NULL)
+    die (path);
+  if (null_flag)
+    {
+      fputs ("binary", fp);
+      fputc ('\0', fp);
+      len += 7;
+    }
+  while (len < size)
+    len += write_line (fp, density, long_len);
+  if (fclose (fp) != 0)
+    die (path);
+
+  return len;
+}
+
+/* Records the length of a part in the sizes file.  */
+static void
+record_size (const char *name, size_t len)
+{
+  fprintf (sizes, "%s %zu\n", name, len);
+}
+
+int
+main (int argc, char **argv)
+{
+  char name[4096], *end;
+  size_t scale = 1;
+  size_t len, i, level;
+  size_t dir_len;
+
+  if (argc == 3)
+    {
+      scale = strtoul (argv[2], &end, 10);
+      if (*end != '\0' || scale == 0)
+        argc = 0;
+    }
+  if (argc != 2 && argc != 3)
+    {
+      fprintf (stderr, "Usage: gencorpus DIR [SCALE]\n");
+      return EXIT_FAILURE;
+    }
+  corpus = argv[1];
+  if (mkdir (corpus, 0755) != 0 && errno != EEXIST)
+    die (corpus);
+  snprintf (name, sizeof (name), "%s/SIZES", corpus);
+  sizes = fopen (name, "w");
+  if (sizes == NULL)
+    die (name);
+
+  /* Many small files with a match in every tenth line.  */
+  make_dir ("small");
+  for (i = 0; i < DIRS; i++)
+    {
+      snprintf (name, sizeof (name), "small/%02zu", i);
+      make_dir (name);
+    }
+  len = 0;
+  for (i = 0; i < SMALL_FILES * scale; i++)
+    {
+      snprintf (name, sizeof (name), "small/%02zu/file%zu.c", i % DIRS, i);
+      len += write_file (name, random_below (2 * SMALL_SIZE), 10, 0, 0);
+    }
+  record_size ("small", len);
+
+  /* A deep tree with a few files on each level.  */
+  len = 0;
+  strcpy (name, "deep");
+  make_dir (name);
+  for (level = 0; level < DEEP_LEVELS; level++)
+    {
+      dir_len = strlen (name);
+      for (i = 0; i < DEEP_FILES * scale; i++)
+        {
+          snprintf (name + dir_len, sizeof (name) - dir_len, "/file%zu.txt",
+                    i);
+          len += write_file (name, random_below (2 * DEEP_SIZE), 10, 0, 0);
+        }
+      snprintf (name + dir_len, sizeof (name) - dir_len, "/d%zu", level);
+      make_dir (name);
+    }
+  record_size ("deep", len);
+
+  /* Binary files, which are skipped, and a single huge file.  */
+  make_dir ("binary");
+  len = 0;
+  for (i = 0; i < BINARY_FILES * scale; i++)
+    {
+      snprintf (name, sizeof (name), "binary/file%zu.bin", i);
+      len += write_file (name, BINARY_SIZE, 10, 0, 1);
+    }
+  record_size ("binary", len);
+  record_size ("huge.txt", write_file ("huge.txt", HUGE_SIZE * scale, 10, 0,
+                                       0));
+
+  /* Long lines and files with high and low match density.  */
+  record_size ("long.txt", write_file ("long.txt",
+                                       LONG_LINES * LONG_SIZE * scale, 1,
+                                       LONG_SIZE, 0));
+  record_size ("dense.txt", write_file ("dense.txt", DENSITY_SIZE * scale, 1,
+                                        0, 0));
+  record_size ("sparse.txt", write_file ("sparse.txt", DENSITY_SIZE * scale,
+                                         10000, 0, 0));
+
+  if (fclose (sizes) != 0)
+    die ("SIZES");
+
+  return EXIT_SUCCESS;
+}
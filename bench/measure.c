@@ -0,0 +1,111 @@
+/* measure.c - time and peak memory of a command for the rrep benchmarks.
+   Copyright (C) 2026 Arno Onken <asnelt@asnelt.org>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA
+   02110-1301, USA.  */
+
+/* Runs a command and prints its elapsed seconds, its peak resident set size
+   in kibibytes and its exit status on one line.  Standard input and output
+   of the command can be redirected with -i and -o, so that the shell that
+   drives the benchmarks does not take part in the measurement.  */
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+/* Exits with a message about the file name.  */
+static void
+die (const char *name)
+{
+  fprintf (stderr, "measure: %s: %s\n", name, strerror (errno));
+  exit (EXIT_FAILURE);
+}
+
+/* Replaces the file descriptor fd by the file name opened with flags.  */
+static void
+redirect (int fd, const char *name, int flags)
+{
+  int new_fd;
+
+  new_fd = open (name, flags, 0644);
+  if (new_fd < 0)
+    die (name);
+  if (dup2 (new_fd, fd) < 0)
+    die (name);
+  close (new_fd);
+}
+
+int
+main (int argc, char **argv)
+{
+  struct timespec start, end;
+  struct rusage usage;
+  const char *input = NULL;
+  const char *output = NULL;
+  pid_t pid;
+  int status, opt;
+
+  while ((opt = getopt (argc, argv, "+i:o:")) != -1)
+    {
+      switch (opt)
+        {
+        case 'i':
+          input = optarg;
+          break;
+        case 'o':
+          output = optarg;
+          break;
+        default:
+          argc = 0;
+        }
+    }
+  if (optind >= argc)
+    {
+      fprintf (stderr, "Usage: measure [-i INPUT] [-o OUTPUT] COMMAND...\n");
+      return EXIT_FAILURE;
+    }
+
+  clock_gettime (CLOCK_MONOTONIC, &start);
+  pid = fork ();
+  if (pid < 0)
+    die ("fork");
+  if (pid == 0)
+    {
+      if (input != NULL)
+        redirect (STDIN_FILENO, input, O_RDONLY);
+      if (output != NULL)
+        redirect (STDOUT_FILENO, output, O_WRONLY | O_CREAT | O_TRUNC);
+      execvp (argv[optind], argv + optind);
+      die (argv[optind]);
+    }
+  if (wait4 (pid, &status, 0, &usage) < 0)
+    die ("wait4");
+  clock_gettime (CLOCK_MONOTONIC, &end);
+
+  printf ("%.6f %ld %d\n", (end.tv_sec - start.tv_sec)
+          + (end.tv_nsec - start.tv_nsec) / 1e9, usage.ru_maxrss,
+          WIFEXITED (status) ? WEXITSTATUS (status) : 128 + WTERMSIG (status));
+
+  return EXIT_SUCCESS;
+}
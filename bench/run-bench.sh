@@ -0,0 +1,90 @@
+#!/bin/sh
+# run-bench.sh - run the rrep benchmarks on a synthetic corpus
+#
+# Copyright 2026 Arno Onken <asnelt@asnelt.org>
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 3, or (at your option)
+# any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+# Usage: run-bench.sh RREP MEASURE CORPUS [SCRATCH]
+#
+# Runs each workload on each part of CORPUS, which is made by gencorpus.
+# Single files are piped through standard input to /dev/null.  Directories
+# are copied to SCRATCH before each run and rewritten in place with -r, so
+# that every run sees the same input.  The copy is not measured.
+#
+# The environment variable BENCH_RUNS sets the number of runs per case
+# (default 3) and BENCH_FLAGS adds options to every rrep call, for example
+# BENCH_FLAGS=--jobs=4.  Each case prints one line with the workload, the
+# part of the corpus, the throughput in MiB/s and the elapsed seconds of the
+# fastest run, and the largest peak resident set size in KiB of all runs.
+
+rrep=$1
+measure=$2
+corpus=$3
+scratch=${4:-$corpus.scratch}
+runs=${BENCH_RUNS:-3}
+
+if test -z "$rrep" || test -z "$measure" || test ! -f "$corpus/SIZES"; then
+  echo "Usage: run-bench.sh RREP MEASURE CORPUS [SCRATCH]" >&2
+  exit 1
+fi
+
+# Workloads as name, then pattern and replacement with options.
+workloads='fixed|-F|needle|NEEDLE
+regex|-e|ne[e]dle[0-9]*|NEEDLE
+backref|-e|\([a-z][a-z]*\) \1 |\1 
+word|-w|needle|NEEDLE'
+
+# Corpus parts in a fixed order.
+parts='small deep binary huge.txt long.txt dense.txt sparse.txt'
+
+status=0
+printf '%-8s %-10s %10s %10s %10s\n' workload corpus MiB/s seconds maxrss_kb
+echo "$workloads" | while IFS='|' read -r name flag pattern replacement; do
+  for part in $parts; do
+    bytes=`awk -v part="$part" '$1 == part { print $2 }' "$corpus/SIZES"`
+    best=
+    rss=0
+    i=0
+    while test $i -lt "$runs"; do
+      i=`expr $i + 1`
+      if test -d "$corpus/$part"; then
+        rm -rf "$scratch"
+        cp -R "$corpus/$part" "$scratch" || exit 1
+        result=`"$measure" -o /dev/null "$rrep" $BENCH_FLAGS -r -q $flag \
+                  "$pattern" "$replacement" "$scratch"`
+      else
+        result=`"$measure" -i "$corpus/$part" -o /dev/null "$rrep" \
+                  $BENCH_FLAGS $flag "$pattern" "$replacement"`
+      fi
+      set -- $result
+      if test "$3" != 0; then
+        echo "run-bench.sh: $name on $part failed with status $3" >&2
+        status=1
+      fi
+      best=`awk -v a="$1" -v b="$best" \
+              'BEGIN { print (b == "" || a < b) ? a : b }'`
+      test "$2" -gt "$rss" && rss=$2
+    done
+    awk -v name="$name" -v part="$part" -v bytes="$bytes" -v sec="$best" \
+        -v rss="$rss" 'BEGIN {
+          rate = sec > 0 ? bytes / 1048576 / sec : 0
+          printf "%-8s %-10s %10.1f %10.3f %10d\n", name, part, rate, sec, rss
+        }'
+  done
+  test $status = 0
+done
+status=$?
+rm -rf "$scratch"
+exit $status
@@ -19,128 +19,428 @@
 #include <config.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
 #include <stdbool.h>
+#include <errno.h>
 #include <regex.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#ifdef HAVE_MMAP
+# include <sys/mman.h>
+#endif
 #include "rrep.h"
 #include "messages.h"
+#include "bufferio.h"
+#include "stats.h"
 
-/* Pointer to buffer.  */
-char *buffer = NULL;
-/* Size of buffer.  */
-size_t buffer_size = 0;
-
-/* Pointer to buffer for tmpfile replacement.  */
-char *file_buffer = NULL;
-/* Size of file_buffer.  */
-size_t file_buffer_size = 0;
+/* Allocates the initial memory of the line buffer in buf.  */
+int
+init_buffer (buffer_t *buf)
+{
+  buf->file_buffer = NULL;
+  buf->file_buffer_size = 0;
+  buf->start = 0;
+  buf->search_pos = 1;
+  buf->buffer_fill = 0;
+  buf->map = NULL;
+  buf->map_size = 0;
+  buf->map_offset = 0;
+  buf->mapped_flag = false;
+  buf->ahead_fd = -1;
+  buf->ahead_data = NULL;
+  buf->ahead_len = 0;
+  buf->held = NULL;
+  buf->nheld = 0;
+  buf->buffer = (char *) malloc (INIT_BUFFER_SIZE * sizeof (char));
+  if (buf->buffer == NULL)
+    {
+      buf->buffer_size = 0;
+      rrep_error (ERR_ALLOC_BUFFER, NULL);
+      return FAILURE;
+    }
+  buf->buffer_size = INIT_BUFFER_SIZE;
 
+  return SUCCESS;
+}
 
-/* Read in a buffered line from fp.  The line starts at *line and has
-   length *line_len.  Line delimiters are '\n' and, if binary files are not
-   ignored, '\0'.  If a line could be placed at the line pointer, SUCCESS is
-   returned.  Otherwise, if the end of file was reached END_REACHED is returned
-   or if an error occurred FAILURE is returned.  */
+/* Grows the memory at *buffer with size *size to at least needed bytes.  The
+   size is doubled so that a buffer of n bytes is reallocated only log n
+   times.  The content of the buffer is kept.  */
 int
-read_line (FILE *fp, char **line, size_t *line_len, const char *file_name)
+grow_buffer (char **buffer, size_t *size, size_t needed)
 {
-  static size_t start = 0; /* Start of line.  */
-  static size_t search_pos = 1; /* Search position for end of line.  */
-  static size_t buffer_fill = 0; /* Number of read characters in buffer.  */
-  static char null_replace = '\0'; /* Character buffer for string
-                                      termination.  */
   char *tmp;
+  size_t new_size;
+
+  new_size = *size > 0 ? *size : INIT_BUFFER_SIZE;
+  while (new_size < needed)
+    {
+      if (new_size > (size_t) -1/2)
+        {
+          new_size = needed;
+          break;
+        }
+      new_size *= 2;
+    }
+  if (new_size == *size)
+    return SUCCESS;
+  tmp = (char *) realloc (*buffer, new_size * sizeof (char));
+  if (tmp == NULL)
+    return FAILURE;
+  *buffer = tmp;
+  *size = new_size;
+  count_stat (STAT_REALLOCS, 1);
+
+  return SUCCESS;
+}
+
+/* Shrinks the memory at *buffer with size *size to limit bytes if it is
+   larger.  A failure to shrink is ignored.  */
+static void
+trim_memory (char **buffer, size_t *size, size_t limit)
+{
+  char *tmp;
+
+  if (*buffer == NULL || *size <= limit)
+    return;
+  tmp = (char *) realloc (*buffer, limit * sizeof (char));
+  if (tmp == NULL)
+    return;
+  *buffer = tmp;
+  *size = limit;
+}
+
+/* Shrinks the buffers of buf that grew beyond buffer_limit for a single
+   file, so that an outlier does not keep its memory for the following files.
+   Buffers up to the limit are kept and reused.  Must only be called between
+   files.  */
+void
+trim_buffer (buffer_t *buf)
+{
+  size_t limit;
+
+  limit = buffer_limit > INIT_BUFFER_SIZE ? buffer_limit : INIT_BUFFER_SIZE;
+  trim_memory (&buf->buffer, &buf->buffer_size, limit);
+  trim_memory (&buf->file_buffer, &buf->file_buffer_size, limit);
+}
+
+/* Frees the memory that was allocated for the fields of buf.  */
+void
+free_buffer (buffer_t *buf)
+{
+  if (buf->file_buffer != NULL)
+    {
+      free (buf->file_buffer);
+      buf->file_buffer = NULL;
+    }
+  buf->file_buffer_size = 0;
+  if (buf->buffer != NULL)
+    {
+      free (buf->buffer);
+      buf->buffer = NULL;
+    }
+  buf->buffer_size = 0;
+}
+
+/* Maps the regular file fp into memory so that read_line returns lines
+   directly from the mapping.  If fp is not a regular file or cannot be mapped,
+   read_line falls back to reading fp through the line buffer.  */
+void
+map_file (buffer_t *buf, FILE *fp)
+{
+#ifdef HAVE_MMAP
+  struct stat st;
+  void *map;
+
+  buf->map = NULL;
+  buf->map_size = 0;
+  buf->map_offset = 0;
+  buf->mapped_flag = false;
+  if (fstat (fileno (fp), &st) != 0 || !S_ISREG (st.st_mode)
+      || st.st_size <= 0 || (uintmax_t) st.st_size >= SIZE_MAX)
+    return;
+  /* Lines are matched by length, so the mapping is never written.  */
+  map = mmap (NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno (fp), 0);
+  if (map == MAP_FAILED)
+    return;
+# if defined HAVE_MADVISE && defined MADV_SEQUENTIAL
+  madvise (map, st.st_size, MADV_SEQUENTIAL);
+# endif
+  buf->map = (char *) map;
+  buf->map_size = st.st_size;
+  buf->mapped_flag = true;
+  count_stat (STAT_BYTES_READ, st.st_size);
+#endif
+}
+
+/* Lets read_line on chunk return the lines of the part of the mapped file in
+   buf that starts at the file offset offset and has length len.  The offset
+   must be the start of a line.  The mapping stays owned by buf, so close_file
+   must not be called for chunk.  */
+void
+map_chunk (buffer_t *chunk, const buffer_t *buf, off_t offset, size_t len)
+{
+  map_memory (chunk, buf->map + (offset - buf->map_offset), len);
+  chunk->map_offset = offset;
+}
+
+/* Lets read_line on buf return the lines of the len characters at data as if
+   they were a mapped file.  */
+void
+map_memory (buffer_t *buf, char *data, size_t len)
+{
+  buf->map = data;
+  buf->map_size = len;
+  buf->map_offset = 0;
+  buf->mapped_flag = false;
+  buf->start = 0;
+  buf->search_pos = 1;
+}
+
+/* Closes the later files that were opened ahead for buf.  Their contents
+   are not used without a descriptor.  Returns true if a file was closed.  */
+static bool
+release_held (buffer_t *buf)
+{
+  bool closed_flag = false;
+  size_t i;
+
+  for (i = 0; i < buf->nheld; i++)
+    if (buf->held[i].fd >= 0)
+      {
+        close (buf->held[i].fd);
+        buf->held[i].fd = -1;
+        closed_flag = true;
+      }
+
+  return closed_flag;
+}
+
+/* Opens the file file_name relative to the directory dir_fd for reading and
+   maps it with map_file.  A file that was opened ahead for buf is taken from
+   buf instead and its contents are used like a mapping if they were read
+   ahead as well.  If the process is out of descriptors, the later files that
+   were opened ahead are closed and the file is opened again.  */
+FILE *
+open_mapped (buffer_t *buf, int dir_fd, const char *file_name)
+{
+  FILE *fp;
+  char *data;
+  int fd;
+
+  fd = buf->ahead_fd;
+  data = buf->ahead_data;
+  buf->ahead_fd = -1;
+  buf->ahead_data = NULL;
+  if (fd < 0)
+    {
+      data = NULL;
+      fd = openat (dir_fd, file_name, O_RDONLY);
+      if (fd < 0 && errno == EMFILE && release_held (buf))
+        fd = openat (dir_fd, file_name, O_RDONLY);
+      if (fd < 0)
+        return NULL;
+    }
+  fp = fdopen (fd, "r");
+  if (fp == NULL)
+    close (fd);
+  else if (data != NULL)
+    {
+      map_memory (buf, data, buf->ahead_len);
+      count_stat (STAT_BYTES_READ, buf->ahead_len);
+    }
+  else
+    map_file (buf, fp);
+
+  return fp;
+}
+
+/* Removes the mapping of map_file, if any, and closes fp.  */
+int
+close_file (buffer_t *buf, FILE *fp)
+{
+#ifdef HAVE_MMAP
+  if (buf->mapped_flag)
+    munmap (buf->map, buf->map_size);
+#endif
+  buf->map = NULL;
+  buf->map_size = 0;
+  buf->mapped_flag = false;
+  return fclose (fp);
+}
+
+/* Sets *rest to the part of the mapped file in buf behind the line *line, or
+   to the whole file if *line is NULL, and returns its length.  *line must not
+   be used anymore afterwards.  If buf is not mapped, *rest is set to NULL.  */
+size_t
+get_rest (buffer_t *buf, char **line, const char **rest)
+{
+  if (buf->map == NULL)
+    {
+      *rest = NULL;
+      return 0;
+    }
+  if (*line == NULL)
+    buf->search_pos = 0;
+  /* Let the next read_line continue at search_pos.  */
+  buf->start = buf->search_pos;
+  *line = buf->map;
+  *rest = buf->map+buf->search_pos;
+
+  return buf->map_size-buf->search_pos;
+}
+
+/* Lets the next read_line on the mapped file in buf start len characters
+   behind the rest from get_rest.  */
+void
+skip_rest (buffer_t *buf, size_t len)
+{
+  buf->search_pos += len;
+  buf->start = buf->search_pos;
+}
+
+/* Sets *line to the next line in the mapping of buf.  */
+static int
+read_mapped_line (buffer_t *buf, char **line, size_t *line_len)
+{
+  char *end;
+
+  if (*line == NULL)
+    buf->start = 0;
+  else
+    buf->start = buf->search_pos;
+  if (buf->start >= buf->map_size)
+    {
+      /* Reset line state and signal eof.  */
+      *line = NULL;
+      buf->start = 0;
+      buf->search_pos = 1;
+      return END_REACHED;
+    }
+
+  /* Search for end of line.  */
+  end = memchr (buf->map+buf->start, '\n', buf->map_size-buf->start);
+  if (end != NULL)
+    buf->search_pos = end-buf->map+1;
+  else
+    buf->search_pos = buf->map_size;
+  *line_len = buf->search_pos - buf->start;
+  *line = buf->map+buf->start;
+  return SUCCESS;
+}
+
+/* Read in a buffered line from fp into buf.  The line starts at *line and has
+   length *line_len.  The line delimiter is '\n'.  Lines are not terminated
+   and can contain null characters.  If a line could be placed at the line
+   pointer, SUCCESS is returned.  Otherwise, if the end of file was reached
+   END_REACHED is returned or if an error occurred FAILURE is returned.  */
+int
+read_line (buffer_t *buf, FILE *fp, char **line, size_t *line_len,
+           const char *file_name)
+{
   size_t nr; /* Number of characters read by fread.  */
-  int i;
+  size_t i;
+  int rr; /* Return value of read_mapped_line.  */
   bool search_flag;
 
   *line_len = 0;
+  if (buf->map != NULL)
+    {
+      rr = read_mapped_line (buf, line, line_len);
+      if (rr == SUCCESS)
+        count_stat (STAT_LINES, 1);
+      return rr;
+    }
   if (*line == NULL)
     {
       /* New file.  */
-      start = 0;
-      search_pos = 1;
-      buffer_fill = 0;
+      buf->start = 0;
+      buf->search_pos = 1;
+      buf->buffer_fill = 0;
       /* Fill complete buffer.  */
-      nr = fread (buffer, sizeof (char), buffer_size-1, fp);
-      if (nr != buffer_size-1 && ferror (fp))
+      nr = fread (buf->buffer, sizeof (char), buf->buffer_size, fp);
+      if (nr != buf->buffer_size && ferror (fp))
         {
           rrep_error (ERR_READ_FILE, file_name);
           fclose (fp);
           return FAILURE;
         }
-      buffer_fill = nr;
+      buf->buffer_fill = nr;
+      count_stat (STAT_BYTES_READ, nr);
     }
-  else if (feof (fp) && search_pos >= buffer_fill)
+  else if (feof (fp) && buf->search_pos >= buf->buffer_fill)
     {
-      /* Reset static variables and signal eof.  */
+      /* Reset line state and signal eof.  */
       *line = NULL;
-      start = 0;
-      search_pos = 1;
-      buffer_fill = 0;
-      null_replace = '\0';
+      buf->start = 0;
+      buf->search_pos = 1;
+      buf->buffer_fill = 0;
       return END_REACHED;
     }
   else
     {
-      /* Restore character after newline and set start to it.  */
-      *(buffer+search_pos) = null_replace;
-      start = search_pos;
-      search_pos++;
+      /* Let the line start behind the last one.  */
+      buf->start = buf->search_pos;
+      buf->search_pos++;
     }
 
   /* Search for end of line.  */
   search_flag = true;
   while (search_flag)
     {
-      while (search_pos < buffer_fill && *(buffer+search_pos-1) != '\n'
-             && (!(options & OPT_BINARY) || *(buffer+search_pos-1) != '\0'))
-        search_pos++;
+      while (buf->search_pos < buf->buffer_fill
+             && *(buf->buffer+buf->search_pos-1) != '\n')
+        buf->search_pos++;
 
-      if (search_pos >= buffer_fill && !feof (fp))
+      if (buf->search_pos >= buf->buffer_fill && !feof (fp))
         {
           /* End of buffer reached.  */
-          if (start > 0)
+          if (buf->start > 0)
             {
               /* Let line start at the beginning of buffer.  */
-              for (i = 0; i < buffer_fill-start; i++)
-                *(buffer+i) = *(buffer+start+i);
-              search_pos -= start;
+              for (i = 0; i < buf->buffer_fill-buf->start; i++)
+                *(buf->buffer+i) = *(buf->buffer+buf->start+i);
+              buf->search_pos -= buf->start;
 
               /* Fill rest of buffer.  */
-              nr = fread (buffer+search_pos, sizeof (char),
-                          buffer_size-search_pos-1, fp);
-              if (nr != buffer_size-search_pos-1 && ferror (fp))
+              nr = fread (buf->buffer+buf->search_pos, sizeof (char),
+                          buf->buffer_size-buf->search_pos, fp);
+              if (nr != buf->buffer_size-buf->search_pos && ferror (fp))
                 {
                   rrep_error (ERR_READ_FILE, file_name);
                   fclose (fp);
                   return FAILURE;
                 }
-              buffer_fill += nr - start;
-              start = 0;
+              buf->buffer_fill += nr - buf->start;
+              count_stat (STAT_BYTES_READ, nr);
+              buf->start = 0;
             }
           else
             {
               /* Reallocate memory.  */
-              tmp = realloc (buffer, buffer_size+INIT_BUFFER_SIZE);
-              if (tmp == NULL)
+              if (grow_buffer (&buf->buffer, &buf->buffer_size,
+                               buf->buffer_size+1) != SUCCESS)
                 {
                   rrep_error (ERR_REALLOC_BUFFER, file_name);
                   fclose (fp);
                   return FAILURE;
                 }
-              buffer = tmp;
-              buffer_size += INIT_BUFFER_SIZE;
 
               /* Fill allocated memory.  */
-              nr = fread (buffer+search_pos, sizeof (char),
-                          INIT_BUFFER_SIZE, fp);
-              if (nr != INIT_BUFFER_SIZE && ferror (fp))
+              nr = fread (buf->buffer+buf->search_pos, sizeof (char),
+                          buf->buffer_size-buf->search_pos, fp);
+              if (nr != buf->buffer_size-buf->search_pos && ferror (fp))
                 {
                   rrep_error (ERR_READ_FILE, file_name);
                   fclose (fp);
                   return FAILURE;
                 }
-              buffer_fill += nr;
+              buf->buffer_fill += nr;
+              count_stat (STAT_BYTES_READ, nr);
             }
         }
       else
@@ -151,13 +451,10 @@ read_line (FILE *fp, char **line, size_t *line_len, const char *file_name)
     }
 
   /* Set pointer to line.  */
-  *line = buffer+start;
-  /* Temporarily replace character after line to generate a terminated
-     string.  */
-  null_replace = *(buffer+search_pos);
-  *(buffer+search_pos) = '\0';
+  *line = buf->buffer+buf->start;
   /* Set line length.  */
-  *line_len = search_pos - start;
+  *line_len = buf->search_pos - buf->start;
+  count_stat (STAT_LINES, 1);
 
   return SUCCESS;
 }
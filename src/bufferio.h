@@ -16,20 +16,91 @@
    Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA
    02110-1301, USA.  */
 
-/* Pointer to buffer.  */
-extern char *buffer;
-/* Size of buffer.  */
-extern size_t buffer_size;
-
-/* Pointer to buffer for tmpfile replacement.  */
-extern char *file_buffer;
-/* Size of file_buffer.  */
-extern size_t file_buffer_size;
-
-
-/* Read in a buffered line from fp.  The line starts at *line and has
-   length *line_len.  Line delimiters are '\n' and, if binary files are not
-   ignored, '\0'.  If a line could be placed at the line pointer, SUCCESS is
-   returned.  Otherwise, if the end of file was reached END_REACHED is returned
-   or if an error occurred FAILURE is returned.  */
-extern int read_line (FILE *, char **, size_t *, const char *);
+/* Data structure for a file that is opened and read ahead.  */
+typedef struct
+{
+  int fd; /* File descriptor or -1 if the file was not opened.  */
+  char *data; /* Buffer for the contents of the file.  */
+  size_t size; /* Allocated size of data.  */
+  size_t len; /* Number of read characters or 0 if the file was not read.  */
+} ahead_t;
+
+/* Buffers and line reading state of a single worker.  */
+typedef struct
+{
+  char *buffer; /* Pointer to buffer.  */
+  size_t buffer_size; /* Size of buffer.  */
+  char *file_buffer; /* Pointer to buffer for tmpfile replacement.  */
+  size_t file_buffer_size; /* Size of file_buffer.  */
+  size_t start; /* Start of line.  */
+  size_t search_pos; /* Search position for end of line.  */
+  size_t buffer_fill; /* Number of read characters in buffer.  */
+  char *map; /* Private mapping of the current file or NULL.  */
+  size_t map_size; /* Size of the file in map.  */
+  off_t map_offset; /* Offset of map in the file.  */
+  bool mapped_flag; /* map was created by map_file.  */
+  int ahead_fd; /* Next file to process if it was opened ahead or -1.  */
+  char *ahead_data; /* Contents of the next file if they were read ahead.  */
+  size_t ahead_len; /* Length of ahead_data.  */
+  ahead_t *held; /* Later files that were opened ahead for buf.  */
+  size_t nheld; /* Number of files in held.  */
+} buffer_t;
+
+
+/* Allocates the initial memory of the line buffer in buf.  */
+extern int init_buffer (buffer_t *);
+
+/* Grows the memory at *buffer with size *size to at least needed bytes.  The
+   size is doubled so that a buffer of n bytes is reallocated only log n
+   times.  The content of the buffer is kept.  */
+extern int grow_buffer (char **, size_t *, size_t);
+
+/* Shrinks the buffers of buf that grew beyond buffer_limit for a single
+   file, so that an outlier does not keep its memory for the following files.
+   Buffers up to the limit are kept and reused.  Must only be called between
+   files.  */
+extern void trim_buffer (buffer_t *);
+
+/* Frees the memory that was allocated for the fields of buf.  */
+extern void free_buffer (buffer_t *);
+
+/* Maps the regular file fp into memory so that read_line returns lines
+   directly from the mapping.  If fp is not a regular file or cannot be mapped,
+   read_line falls back to reading fp through the line buffer.  */
+extern void map_file (buffer_t *, FILE *);
+
+/* Lets read_line on chunk return the lines of the part of the mapped file in
+   buf that starts at the file offset offset and has length len.  The offset
+   must be the start of a line.  The mapping stays owned by buf, so close_file
+   must not be called for chunk.  */
+extern void map_chunk (buffer_t *, const buffer_t *, off_t, size_t);
+
+/* Lets read_line on buf return the lines of the len characters at data as if
+   they were a mapped file.  */
+extern void map_memory (buffer_t *, char *, size_t);
+
+/* Opens the file file_name relative to the directory dir_fd for reading and
+   maps it with map_file.  A file that was opened ahead for buf is taken from
+   buf instead and its contents are used like a mapping if they were read
+   ahead as well.  If the process is out of descriptors, the later files that
+   were opened ahead are closed and the file is opened again.  */
+extern FILE *open_mapped (buffer_t *, int, const char *);
+
+/* Removes the mapping of map_file, if any, and closes fp.  */
+extern int close_file (buffer_t *, FILE *);
+
+/* Sets *rest to the part of the mapped file in buf behind the line *line, or
+   to the whole file if *line is NULL, and returns its length.  *line must not
+   be used anymore afterwards.  If buf is not mapped, *rest is set to NULL.  */
+extern size_t get_rest (buffer_t *, char **, const char **);
+
+/* Lets the next read_line on the mapped file in buf start len characters
+   behind the rest from get_rest.  */
+extern void skip_rest (buffer_t *, size_t);
+
+/* Read in a buffered line from fp into buf.  The line starts at *line and has
+   length *line_len.  The line delimiter is '\n'.  Lines are not terminated
+   and can contain null characters.  If a line could be placed at the line
+   pointer, SUCCESS is returned.  Otherwise, if the end of file was reached
+   END_REACHED is returned or if an error occurred FAILURE is returned.  */
+extern int read_line (buffer_t *, FILE *, char **, size_t *, const char *);
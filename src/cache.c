@@ -0,0 +1,400 @@
+/* cache.c - remembering files that do not match a pattern in rrep.
+   Copyright (C) 2026 Arno Onken <asnelt@asnelt.org>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA
+   02110-1301, USA.  */
+
+/* The cache file holds a record for each file that did not match a pattern
+   in an earlier run.  A record identifies the file by its device and inode
+   number and the pattern by its hash value, and it holds the size,
+   modification and status change time of the file when it was searched.  A
+   file is skipped if its record for the pattern still has the same size and
+   times.  The status change time catches rewrites whose modification time
+   was restored, as by --keep-times.
+
+   The records of the pattern are only read during a run.  New records are
+   collected separately and the file is written once, when the run ends:
+   records of other patterns are kept, while records of the pattern are only
+   kept if they were confirmed or found in the run, so files that changed,
+   matched or disappeared drop out.  The new file replaces the old one by
+   rename, so an interrupted run leaves the previous cache intact.
+
+   Like the index, the cache file is stored in the byte order of the machine
+   that wrote it.  It starts with a magic string and the number of
+   records.  */
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <regex.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "stat-time.h"
+#include "rrep.h"
+#include "messages.h"
+#include "pattern.h"
+#include "cache.h"
+
+/* Magic string at the start of a cache file.  */
+#define CACHE_MAGIC "RREPNMC2"
+
+/* Length of CACHE_MAGIC.  */
+#define MAGIC_LEN (8)
+
+/* Seconds that a file must be older than the run to be recorded.  File
+   systems with coarse time stamps may not change the modification time of
+   a file that is written again within this time.  */
+#define SETTLE_TIME (2)
+
+/* Data structure for a record in a cache file.  */
+typedef struct
+{
+  uint64_t dev; /* Device of the file.  */
+  uint64_t ino; /* Inode number of the file.  */
+  uint64_t size; /* Size of the file.  */
+  int64_t mtime_sec; /* Seconds of the modification time.  */
+  int64_t mtime_nsec; /* Nanoseconds of the modification time.  */
+  int64_t ctime_sec; /* Seconds of the status change time.  */
+  int64_t ctime_nsec; /* Nanoseconds of the status change time.  */
+  uint64_t pattern; /* Hash value of the pattern.  */
+} record_t;
+
+/* Data structure for the cache.  */
+struct cache
+{
+  char *file_name; /* Name of the cache file.  */
+  uint64_t pattern; /* Hash value of the pattern of the run.  */
+  record_t *records; /* Records of the cache file.  */
+  size_t nrecords; /* Number of records.  */
+  bool *kept; /* Records of the pattern that were confirmed.  */
+  size_t *slots; /* Hash table of the records of the pattern, by index plus
+                    one, zero if empty.  */
+  size_t nslots; /* Number of slots, which is a power of two.  */
+  record_t *added; /* Records found in the run.  */
+  size_t nadded; /* Number of added records.  */
+  size_t added_size; /* Allocated number of added records.  */
+  time_t start; /* Time at which the run started.  */
+  pthread_mutex_t lock; /* Lock for kept and the added records.  */
+};
+
+/* Returns the hash value of the device and inode number of a file.  */
+static size_t
+hash_file (uint64_t dev, uint64_t ino)
+{
+  uint64_t hash = (dev * 0x9e3779b97f4a7c15u) ^ ino;
+
+  hash ^= hash >> 29;
+  hash *= 0xbf58476d1ce4e5b9u;
+  hash ^= hash >> 32;
+
+  return hash;
+}
+
+/* Stores the status st of a file in record.  */
+static void
+fill_record (const cache_t *cache, const struct stat *st, record_t *record)
+{
+  struct timespec mtime = get_stat_mtime (st);
+  struct timespec ctime = get_stat_ctime (st);
+
+  memset (record, 0, sizeof (record_t));
+  record->dev = st->st_dev;
+  record->ino = st->st_ino;
+  record->size = st->st_size;
+  record->mtime_sec = mtime.tv_sec;
+  record->mtime_nsec = mtime.tv_nsec;
+  record->ctime_sec = ctime.tv_sec;
+  record->ctime_nsec = ctime.tv_nsec;
+  record->pattern = cache->pattern;
+}
+
+/* Reads the records of the cache file into cache.  A missing file is not an
+   error.  */
+static int
+read_records (cache_t *cache)
+{
+  struct stat st;
+  char magic[MAGIC_LEN];
+  uint64_t nrecords;
+  size_t offset, len;
+  ssize_t nread;
+  int fd;
+
+  fd = open (cache->file_name, O_RDONLY | O_NOCTTY);
+  if (fd < 0)
+    {
+      if (errno == ENOENT)
+        return SUCCESS;
+      rrep_error (ERR_READ_CACHE, cache->file_name);
+      return FAILURE;
+    }
+  if (fstat (fd, &st) < 0 || read (fd, magic, MAGIC_LEN) != MAGIC_LEN
+      || read (fd, &nrecords, sizeof (uint64_t)) != sizeof (uint64_t))
+    {
+      rrep_error (ERR_READ_CACHE, cache->file_name);
+      close (fd);
+      return FAILURE;
+    }
+  if (memcmp (magic, CACHE_MAGIC, MAGIC_LEN)
+      || nrecords != (st.st_size - MAGIC_LEN - sizeof (uint64_t))
+                     / sizeof (record_t))
+    {
+      rrep_error (ERR_CACHE_FORMAT, cache->file_name);
+      close (fd);
+      return FAILURE;
+    }
+
+  len = nrecords * sizeof (record_t);
+  cache->records = (record_t *) malloc (len > 0 ? len : 1);
+  if (cache->records == NULL)
+    {
+      rrep_error (ERR_MEMORY, cache->file_name);
+      close (fd);
+      return FAILURE;
+    }
+  for (offset = 0; offset < len; offset += nread)
+    {
+      nread = read (fd, (char *) cache->records + offset, len - offset);
+      if (nread <= 0)
+        {
+          if (nread < 0 && errno == EINTR)
+            {
+              nread = 0;
+              continue;
+            }
+          rrep_error (ERR_READ_CACHE, cache->file_name);
+          free (cache->records);
+          cache->records = NULL;
+          close (fd);
+          return FAILURE;
+        }
+    }
+  close (fd);
+  cache->nrecords = nrecords;
+
+  return SUCCESS;
+}
+
+/* Reads the cache file file_name for pattern into *cache.  A missing file
+   yields an empty cache.  If the file cannot be read, *cache is empty as
+   well and FAILURE is returned.  *cache is NULL only if memory is
+   insufficient.  */
+int
+load_cache (const char *file_name, const pattern_t *pattern,
+            cache_t **cache)
+{
+  cache_t *new_cache;
+  const record_t *record;
+  size_t count = 0;
+  size_t i, j;
+  int result;
+
+  *cache = NULL;
+  new_cache = (cache_t *) calloc (1, sizeof (cache_t));
+  if (new_cache == NULL || (new_cache->file_name = strdup (file_name))
+                           == NULL)
+    {
+      rrep_error (ERR_MEMORY, file_name);
+      free (new_cache);
+      return FAILURE;
+    }
+  new_cache->pattern = hash_pattern (pattern);
+  new_cache->start = time (NULL);
+  pthread_mutex_init (&new_cache->lock, NULL);
+  result = read_records (new_cache);
+
+  /* Only the records of the pattern are looked up.  */
+  for (i = 0; i < new_cache->nrecords; i++)
+    if (new_cache->records[i].pattern == new_cache->pattern)
+      count++;
+  for (new_cache->nslots = 16; new_cache->nslots < 2 * count;
+       new_cache->nslots *= 2)
+    ;
+  new_cache->slots = (size_t *) calloc (new_cache->nslots, sizeof (size_t));
+  new_cache->kept = (bool *) calloc (new_cache->nrecords + 1, sizeof (bool));
+  if (new_cache->slots == NULL || new_cache->kept == NULL)
+    {
+      rrep_error (ERR_MEMORY, file_name);
+      free_cache (new_cache);
+      return FAILURE;
+    }
+  for (i = 0; i < new_cache->nrecords; i++)
+    {
+      record = &new_cache->records[i];
+      if (record->pattern != new_cache->pattern)
+        continue;
+      for (j = hash_file (record->dev, record->ino) & (new_cache->nslots - 1);
+           new_cache->slots[j] != 0; j = (j + 1) & (new_cache->nslots - 1))
+        ;
+      new_cache->slots[j] = i + 1;
+    }
+  *cache = new_cache;
+
+  return result;
+}
+
+/* Returns true if the file with status st did not match in an earlier run
+   and is unchanged since then.  */
+bool
+cached_no_match (cache_t *cache, const struct stat *st)
+{
+  const record_t *record;
+  record_t current;
+  size_t i;
+
+  fill_record (cache, st, &current);
+  for (i = hash_file (current.dev, current.ino) & (cache->nslots - 1);
+       cache->slots[i] != 0; i = (i + 1) & (cache->nslots - 1))
+    {
+      record = &cache->records[cache->slots[i] - 1];
+      if (record->dev != current.dev || record->ino != current.ino)
+        continue;
+      if (memcmp (record, &current, sizeof (record_t)))
+        return false;
+      pthread_mutex_lock (&cache->lock);
+      cache->kept[cache->slots[i] - 1] = true;
+      pthread_mutex_unlock (&cache->lock);
+      return true;
+    }
+
+  return false;
+}
+
+/* Records that the file with status st does not match.  */
+void
+add_no_match (cache_t *cache, const struct stat *st)
+{
+  record_t *tmp;
+  size_t size;
+
+  if (get_stat_mtime (st).tv_sec > cache->start - SETTLE_TIME)
+    return;
+
+  pthread_mutex_lock (&cache->lock);
+  if (cache->nadded == cache->added_size)
+    {
+      /* Without memory, the file is just searched again next time.  */
+      size = cache->added_size > 0 ? 2 * cache->added_size : 256;
+      tmp = (record_t *) realloc (cache->added, size * sizeof (record_t));
+      if (tmp == NULL)
+        {
+          pthread_mutex_unlock (&cache->lock);
+          return;
+        }
+      cache->added = tmp;
+      cache->added_size = size;
+    }
+  fill_record (cache, st, &cache->added[cache->nadded++]);
+  pthread_mutex_unlock (&cache->lock);
+}
+
+/* Replaces the cache file by the entries of other patterns and those that
+   were found or confirmed in this run.  */
+int
+save_cache (const cache_t *cache)
+{
+  FILE *fp;
+  char *tmp_name;
+  uint64_t nrecords;
+  mode_t mask;
+  size_t i;
+  int fd;
+  bool failure_flag = false;
+
+  tmp_name = (char *) malloc (strlen (cache->file_name) + 8);
+  if (tmp_name == NULL)
+    {
+      rrep_error (ERR_MEMORY, cache->file_name);
+      return FAILURE;
+    }
+  sprintf (tmp_name, "%s.XXXXXX", cache->file_name);
+  fd = mkstemp (tmp_name);
+  /* The cache gets the permissions of a new file rather than those of a
+     temporary one.  */
+  mask = umask (0);
+  umask (mask);
+  if (fd < 0 || fchmod (fd, 0666 & ~mask) != 0
+      || (fp = fdopen (fd, "w")) == NULL)
+    {
+      rrep_error (ERR_WRITE_CACHE, cache->file_name);
+      if (fd >= 0)
+        {
+          close (fd);
+          unlink (tmp_name);
+        }
+      free (tmp_name);
+      return FAILURE;
+    }
+
+  nrecords = cache->nadded;
+  for (i = 0; i < cache->nrecords; i++)
+    if (cache->records[i].pattern != cache->pattern || cache->kept[i])
+      nrecords++;
+  if (fwrite (CACHE_MAGIC, 1, MAGIC_LEN, fp) != MAGIC_LEN
+      || fwrite (&nrecords, sizeof (uint64_t), 1, fp) != 1)
+    failure_flag = true;
+  for (i = 0; i < cache->nrecords && !failure_flag; i++)
+    if ((cache->records[i].pattern != cache->pattern || cache->kept[i])
+        && fwrite (&cache->records[i], sizeof (record_t), 1, fp) != 1)
+      failure_flag = true;
+  if (!failure_flag && cache->nadded > 0
+      && fwrite (cache->added, sizeof (record_t), cache->nadded, fp)
+         != cache->nadded)
+    failure_flag = true;
+  if (!failure_flag && (fflush (fp) != 0 || fsync (fileno (fp)) != 0))
+    failure_flag = true;
+  if (fclose (fp) != 0)
+    failure_flag = true;
+  if (failure_flag)
+    {
+      rrep_error (ERR_WRITE_CACHE, cache->file_name);
+      unlink (tmp_name);
+      free (tmp_name);
+      return FAILURE;
+    }
+  if (rename (tmp_name, cache->file_name) != 0)
+    {
+      rrep_error (ERR_RENAME, cache->file_name);
+      unlink (tmp_name);
+      free (tmp_name);
+      return FAILURE;
+    }
+  free (tmp_name);
+
+  return SUCCESS;
+}
+
+/* Frees the cache, which may be NULL.  */
+void
+free_cache (cache_t *cache)
+{
+  if (cache == NULL)
+    return;
+  pthread_mutex_destroy (&cache->lock);
+  free (cache->file_name);
+  free (cache->records);
+  free (cache->kept);
+  free (cache->slots);
+  free (cache->added);
+  free (cache);
+}
@@ -0,0 +1,40 @@
+/* cache.h - declarations for the no-match cache of rrep.
+   Copyright (C) 2026 Arno Onken <asnelt@asnelt.org>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA
+   02110-1301, USA.  */
+
+/* Files that did not match a pattern in earlier runs.  */
+typedef struct cache cache_t;
+
+/* Reads the cache file file_name for pattern into *cache.  A missing file
+   yields an empty cache.  If the file cannot be read, *cache is empty as
+   well and FAILURE is returned.  *cache is NULL only if memory is
+   insufficient.  */
+extern int load_cache (const char *, const pattern_t *, cache_t **);
+
+/* Returns true if the file with status st did not match in an earlier run
+   and is unchanged since then.  */
+extern bool cached_no_match (cache_t *, const struct stat *);
+
+/* Records that the file with status st does not match.  */
+extern void add_no_match (cache_t *, const struct stat *);
+
+/* Replaces the cache file by the entries of other patterns and those that
+   were found or confirmed in this run.  */
+extern int save_cache (const cache_t *);
+
+/* Frees the cache, which may be NULL.  */
+extern void free_cache (cache_t *);
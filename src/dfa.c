@@ -0,0 +1,1207 @@
+/* dfa.c - lazy deterministic automaton for rrep.
+   Copyright (C) 2026 Arno Onken <asnelt@asnelt.org>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA
+   02110-1301, USA.  */
+
+/* The regular expression is parsed into a syntax tree and translated into a
+   nondeterministic automaton.  Sets of its nodes become the states of a
+   deterministic automaton when the search first needs them.  The automaton
+   only tells whether a line contains a match; regexec finds the match itself.
+   Single characters like dot, bracket expressions and case insensitive
+   letters are translated by asking regexec which bytes they match.  In UTF-8
+   locales, they also match any multibyte character, so the automaton may find
+   lines that regexec rejects, but never misses one.  */
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <string.h>
+#include <wchar.h>
+#include <regex.h>
+#include "localcharset.h"
+#include "dfa.h"
+
+/* Maximum number of nodes of the nondeterministic automaton.  */
+#define MAX_NODES (8192)
+
+/* Maximum bound of a repetition.  */
+#define MAX_REPEAT (1000)
+
+/* Number of buckets of the state cache.  */
+#define HASH_SIZE (1024)
+
+/* Minimum number of characters that must be searched per cached state
+   between two flushes of the state cache.  */
+#define MIN_SCAN_PER_STATE (10)
+
+/* Kinds of syntax tree expressions and automaton nodes.  */
+enum
+  {
+    EXPR_SET, /* Character of a set.  */
+    EXPR_CAT, /* Concatenation.  */
+    EXPR_ALT, /* Alternation.  */
+    EXPR_REPEAT, /* Repetition.  */
+    EXPR_EMPTY, /* Empty string.  */
+    EXPR_BOL, /* Beginning of line.  */
+    EXPR_EOL, /* End of line.  */
+    EXPR_SPLIT, /* Two empty transitions; only used for nodes.  */
+    EXPR_MATCH /* Accepting node; only used for nodes.  */
+  };
+
+/* Expression of the syntax tree.  */
+typedef struct
+{
+  int type; /* Kind of expression.  */
+  int left, right; /* Operands.  */
+  int set; /* Character set of EXPR_SET.  */
+  int min, max; /* Bounds of EXPR_REPEAT; max is -1 if unbounded.  */
+} expr_t;
+
+/* Node of the nondeterministic automaton.  */
+typedef struct
+{
+  int type; /* EXPR_SET, EXPR_SPLIT, EXPR_BOL, EXPR_EOL or EXPR_MATCH.  */
+  int out, out1; /* Successors.  */
+  int set; /* Character set of EXPR_SET.  */
+} node_t;
+
+/* Set of characters as a bit field.  */
+typedef struct
+{
+  unsigned char bits[(UCHAR_MAX+1)/CHAR_BIT];
+} set_t;
+
+/* State of the deterministic automaton.  */
+typedef struct state
+{
+  struct state *hash_next; /* Next state in the same bucket.  */
+  int *nodes; /* Sorted nodes of the state.  */
+  size_t nnodes; /* Number of nodes.  */
+  bool bol; /* The state is at the beginning of a line.  */
+  bool match; /* A match ends in the state.  */
+  bool eol_match; /* A match ends if the line ends in the state.  */
+  /* Successors by character class or NULL.  */
+  struct state *next[FLEXIBLE_ARRAY_MEMBER];
+} state_t;
+
+/* Lazy deterministic automaton.  */
+struct dfa
+{
+  set_t *sets; /* Character sets.  */
+  size_t nsets, sets_size; /* Number of used and allocated sets.  */
+  expr_t *exprs; /* Expressions of the syntax tree.  */
+  size_t nexprs, exprs_size; /* Number of used and allocated expressions.  */
+  node_t *nodes; /* Nodes of the nondeterministic automaton.  */
+  size_t nnodes, nodes_size; /* Number of used and allocated nodes.  */
+  int start; /* First node.  */
+  unsigned char classes[UCHAR_MAX+1]; /* Character classes.  */
+  unsigned char reps[UCHAR_MAX+1]; /* Representatives of the classes.  */
+  int nclasses; /* Number of character classes.  */
+  int *marks; /* Marks of visited nodes.  */
+  int mark; /* Current mark.  */
+  int *stack; /* Stack of nodes to visit.  */
+  int *list, *closure; /* Node lists for computing states.  */
+  state_t *buckets[HASH_SIZE]; /* State cache.  */
+  state_t *starts[2]; /* Start states without and with beginning of line.  */
+  bool skip[UCHAR_MAX+1]; /* Characters but newline that keep starts[0].  */
+  bool bol_flag; /* The expression contains beginning of line anchors.  */
+  size_t cache_size, cache_used; /* Memory limit and use of the cache.  */
+  size_t ncached; /* Number of cached states.  */
+  size_t scanned; /* Number of searched characters.  */
+  size_t flush_scanned; /* Value of scanned at the last flush.  */
+  size_t nflushes; /* Number of flushes of the state cache.  */
+  bool failed; /* The cache became too small.  */
+};
+
+/* State of the parser.  */
+typedef struct
+{
+  dfa_t *dfa; /* Automaton with expressions and sets.  */
+  const char *c; /* Current position in the regular expression.  */
+  int cflags; /* Flags for regcomp.  */
+  bool utf8; /* The locale uses UTF-8.  */
+  int depth; /* Depth of nested groups.  */
+} parser_t;
+
+/* Adds character c to set.  */
+static inline void
+add_char (set_t *set, unsigned char c)
+{
+  set->bits[c/CHAR_BIT] |= 1 << (c%CHAR_BIT);
+}
+
+/* Checks whether set contains character c.  */
+static inline bool
+has_char (const set_t *set, unsigned char c)
+{
+  return (set->bits[c/CHAR_BIT] >> (c%CHAR_BIT)) & 1;
+}
+
+/* Adds a new empty set and returns its index or -1 if memory is
+   exhausted.  */
+static int
+new_set (dfa_t *dfa)
+{
+  set_t *tmp;
+
+  if (dfa->nsets == dfa->sets_size)
+    {
+      tmp = realloc (dfa->sets, 2*dfa->sets_size*sizeof (set_t));
+      if (tmp == NULL)
+        return -1;
+      dfa->sets = tmp;
+      dfa->sets_size *= 2;
+    }
+  memset (dfa->sets+dfa->nsets, 0, sizeof (set_t));
+
+  return dfa->nsets++;
+}
+
+/* Adds a new expression and returns its index or -1 if memory is exhausted or
+   an operand is -1.  */
+static int
+new_expr (dfa_t *dfa, int type, int left, int right)
+{
+  expr_t *tmp, *expr;
+
+  if ((type == EXPR_CAT || type == EXPR_ALT || type == EXPR_REPEAT)
+      && (left < 0 || (type != EXPR_REPEAT && right < 0)))
+    return -1;
+  if (dfa->nexprs == dfa->exprs_size)
+    {
+      tmp = realloc (dfa->exprs, 2*dfa->exprs_size*sizeof (expr_t));
+      if (tmp == NULL)
+        return -1;
+      dfa->exprs = tmp;
+      dfa->exprs_size *= 2;
+    }
+  expr = dfa->exprs+dfa->nexprs;
+  expr->type = type;
+  expr->left = left;
+  expr->right = right;
+  expr->set = -1;
+  expr->min = 0;
+  expr->max = -1;
+
+  return dfa->nexprs++;
+}
+
+/* Returns a new expression for the characters from first to last.  */
+static int
+range_expr (dfa_t *dfa, unsigned char first, unsigned char last)
+{
+  int set, expr;
+  unsigned int c;
+
+  set = new_set (dfa);
+  if (set < 0)
+    return -1;
+  for (c = first; c <= last; c++)
+    add_char (dfa->sets+set, c);
+  expr = new_expr (dfa, EXPR_SET, -1, -1);
+  if (expr >= 0)
+    dfa->exprs[expr].set = set;
+
+  return expr;
+}
+
+/* Returns a new repetition of expr.  */
+static int
+repeat_expr (dfa_t *dfa, int expr, int min, int max)
+{
+  int repeat;
+
+  repeat = new_expr (dfa, EXPR_REPEAT, expr, -1);
+  if (repeat >= 0)
+    {
+      dfa->exprs[repeat].min = min;
+      dfa->exprs[repeat].max = max;
+    }
+
+  return repeat;
+}
+
+/* Returns a new expression that matches any multibyte character and any
+   invalid byte of a UTF-8 string.  */
+static int
+multibyte_expr (dfa_t *dfa)
+{
+  return new_expr (dfa, EXPR_CAT, range_expr (dfa, 0x80, 0xff),
+                   repeat_expr (dfa, range_expr (dfa, 0x80, 0xbf), 0, 3));
+}
+
+/* Returns a new expression for the single character expression of length len
+   at text.  The bytes that it matches are found by asking regexec.  */
+static int
+probe_expr (parser_t *parser, const char *text, size_t len)
+{
+  dfa_t *dfa = parser->dfa;
+  regex_t compiled;
+  regmatch_t range[1]; /* Range of the probe.  */
+  char *string, probe[1];
+  int set, expr;
+  unsigned int c, last;
+
+  string = (char *) malloc ((len + 1) * sizeof (char));
+  if (string == NULL)
+    return -1;
+  memcpy (string, text, len);
+  string[len] = '\0';
+  if (regcomp (&compiled, string,
+               (parser->cflags & (REG_EXTENDED | REG_ICASE)) | REG_NOSUB)
+      != 0)
+    {
+      free (string);
+      return -1;
+    }
+  free (string);
+
+  set = new_set (dfa);
+  if (set < 0)
+    {
+      regfree (&compiled);
+      return -1;
+    }
+  /* Bytes of multibyte characters do not match on their own.  */
+  last = parser->utf8 ? 0x7f : UCHAR_MAX;
+  for (c = 0; c <= last; c++)
+    {
+      probe[0] = c;
+      range[0].rm_so = 0;
+      range[0].rm_eo = 1;
+      if (regexec (&compiled, probe, 0, range, REG_STARTEND) == 0)
+        add_char (dfa->sets+set, c);
+    }
+  regfree (&compiled);
+
+  expr = new_expr (dfa, EXPR_SET, -1, -1);
+  if (expr < 0)
+    return -1;
+  dfa->exprs[expr].set = set;
+  if (parser->utf8)
+    expr = new_expr (dfa, EXPR_ALT, expr, multibyte_expr (dfa));
+
+  return expr;
+}
+
+/* Returns a new expression for the literal character with len bytes at c.  */
+static int
+literal_expr (parser_t *parser, const char *c, size_t len)
+{
+  int expr;
+  size_t i;
+
+  if (parser->cflags & REG_ICASE)
+    {
+      /* Other cases of multibyte characters may have other lengths.  */
+      if (len > 1)
+        return probe_expr (parser, ".", 1);
+      /* Letters and bytes of single byte locales are never special.  */
+      if ((*c >= 'A' && *c <= 'Z') || (*c >= 'a' && *c <= 'z')
+          || (unsigned char) *c > 0x7f)
+        return probe_expr (parser, c, 1);
+    }
+
+  expr = range_expr (parser->dfa, c[0], c[0]);
+  for (i = 1; i < len; i++)
+    expr = new_expr (parser->dfa, EXPR_CAT, expr,
+                     range_expr (parser->dfa, c[i], c[i]));
+
+  return expr;
+}
+
+/* Checks whether the parser is at an alternation operator.  */
+static bool
+at_alternation (const parser_t *parser)
+{
+  if (parser->cflags & REG_EXTENDED)
+    return *parser->c == '|';
+  return parser->c[0] == '\\' && parser->c[1] == '|';
+}
+
+/* Checks whether the parser is at the end of a group.  */
+static bool
+at_group_end (const parser_t *parser)
+{
+  if (parser->cflags & REG_EXTENDED)
+    return *parser->c == ')';
+  return parser->c[0] == '\\' && parser->c[1] == ')';
+}
+
+/* Returns the character after the bracket expression that starts at c or NULL
+   if the expression is not terminated.  */
+static const char *
+skip_bracket (const char *c)
+{
+  char delim; /* Delimiter of a character class.  */
+
+  c++;
+  if (*c == '^')
+    c++;
+  if (*c == ']')
+    c++;
+  while (*c != ']')
+    {
+      if (*c == '\0')
+        return NULL;
+      if (*c == '[' && (*(c+1) == ':' || *(c+1) == '=' || *(c+1) == '.'))
+        {
+          /* Skip character class, equivalence class or collating symbol.  */
+          delim = *(c+1);
+          for (c += 2; *c != delim || *(c+1) != ']'; c++)
+            if (*c == '\0')
+              return NULL;
+          c++;
+        }
+      c++;
+    }
+
+  return c+1;
+}
+
+/* Parses the bounds of an interval that follows the opening brace.  Returns
+   false if the interval is invalid.  */
+static bool
+parse_interval (parser_t *parser, int *min, int *max)
+{
+  const char *c;
+  char *end;
+  long value;
+
+  c = parser->c;
+  *min = 0;
+  *max = -1;
+  if (*c >= '0' && *c <= '9')
+    {
+      value = strtol (c, &end, 10);
+      if (value > MAX_REPEAT)
+        return false;
+      *min = value;
+      c = end;
+    }
+  else if (*c != ',')
+    return false;
+  if (*c == ',')
+    {
+      c++;
+      if (*c >= '0' && *c <= '9')
+        {
+          value = strtol (c, &end, 10);
+          if (value > MAX_REPEAT || value < *min)
+            return false;
+          *max = value;
+          c = end;
+        }
+      else if (c == parser->c+1)
+        /* Neither bound was given.  */
+        return false;
+    }
+  else
+    *max = *min;
+
+  if (parser->cflags & REG_EXTENDED)
+    {
+      if (*c != '}')
+        return false;
+      parser->c = c+1;
+    }
+  else
+    {
+      if (c[0] != '\\' || c[1] != '}')
+        return false;
+      parser->c = c+2;
+    }
+
+  return true;
+}
+
+/* Parses a repetition operator.  Returns 1 if one was found, 0 if the parser
+   is not at a repetition operator and -1 if the operator is invalid.  */
+static int
+parse_repetition (parser_t *parser, int *min, int *max)
+{
+  const char *c = parser->c;
+  bool extended = parser->cflags & REG_EXTENDED;
+
+  *max = -1;
+  if (*c == '*')
+    {
+      *min = 0;
+      parser->c++;
+      return 1;
+    }
+  if (!extended)
+    {
+      if (*c != '\\')
+        return 0;
+      c++;
+    }
+  switch (*c)
+    {
+    case '+':
+      *min = 1;
+      break;
+    case '?':
+      *min = 0;
+      *max = 1;
+      break;
+    case '{':
+      parser->c = c+1;
+      return parse_interval (parser, min, max) ? 1 : -1;
+    default:
+      return 0;
+    }
+  parser->c = c+1;
+
+  return 1;
+}
+
+static int parse_alternation (parser_t *);
+
+/* Parses an atom.  at_start is set if the atom begins a branch.  *anchor_flag
+   is set if the atom is an anchor.  */
+static int
+parse_atom (parser_t *parser, bool at_start, bool *anchor_flag)
+{
+  dfa_t *dfa = parser->dfa;
+  const char *c = parser->c;
+  const char *end;
+  bool extended = parser->cflags & REG_EXTENDED;
+  mbstate_t state;
+  size_t len;
+  int expr;
+
+  *anchor_flag = false;
+  if (extended ? *c == '(' : c[0] == '\\' && c[1] == '(')
+    {
+      parser->c += extended ? 1 : 2;
+      parser->depth++;
+      expr = parse_alternation (parser);
+      if (!at_group_end (parser))
+        return -1;
+      parser->c += extended ? 1 : 2;
+      parser->depth--;
+      return expr;
+    }
+  if (*c == '^' && (extended || at_start))
+    {
+      parser->c++;
+      *anchor_flag = true;
+      return new_expr (dfa, EXPR_BOL, -1, -1);
+    }
+  if (*c == '$')
+    {
+      parser->c++;
+      if (extended || *parser->c == '\0' || at_alternation (parser)
+          || at_group_end (parser))
+        {
+          *anchor_flag = true;
+          return new_expr (dfa, EXPR_EOL, -1, -1);
+        }
+      return literal_expr (parser, c, 1);
+    }
+  switch (*c)
+    {
+    case '.':
+      parser->c++;
+      return probe_expr (parser, c, 1);
+    case '[':
+      end = skip_bracket (c);
+      /* Collating elements may consist of several characters.  */
+      if (end == NULL || memmem (c, end-c, "[.", 2) != NULL
+          || memmem (c, end-c, "[=", 2) != NULL)
+        return -1;
+      parser->c = end;
+      return probe_expr (parser, c, end-c);
+    case '*':
+      /* A star without a preceding atom.  */
+      return -1;
+    case '+':
+    case '?':
+    case '{':
+      if (extended)
+        return -1;
+      break;
+    case '\\':
+      /* Back-references, word boundaries, buffer anchors and operators
+         without an operand are not supported.  */
+      if (c[1] == '\0' || (c[1] >= '1' && c[1] <= '9')
+          || strchr ("bB<>`'", c[1]) != NULL
+          || (unsigned char) c[1] > 0x7f
+          || (!extended && strchr ("{}+?)|", c[1]) != NULL))
+        return -1;
+      parser->c += 2;
+      if (strchr ("wWsS", c[1]) != NULL)
+        return probe_expr (parser, c, 2);
+      return literal_expr (parser, c+1, 1);
+    default:
+      break;
+    }
+
+  /* Ordinary character.  */
+  if (parser->utf8)
+    {
+      memset (&state, 0, sizeof (state));
+      len = mbrlen (c, MB_CUR_MAX, &state);
+      if (len == (size_t) -1 || len == (size_t) -2 || len == 0)
+        return -1;
+    }
+  else
+    len = 1;
+  parser->c += len;
+
+  return literal_expr (parser, c, len);
+}
+
+/* Parses a branch of an alternation.  */
+static int
+parse_branch (parser_t *parser)
+{
+  int expr, atom, min, max, rr;
+  bool at_start, anchor_flag;
+
+  expr = new_expr (parser->dfa, EXPR_EMPTY, -1, -1);
+  at_start = true;
+  while (expr >= 0 && *parser->c != '\0' && !at_alternation (parser)
+         && !at_group_end (parser))
+    {
+      atom = parse_atom (parser, at_start, &anchor_flag);
+      while ((rr = parse_repetition (parser, &min, &max)) != 0)
+        {
+          /* Repeated anchors are not supported.  */
+          if (rr < 0 || anchor_flag)
+            return -1;
+          atom = repeat_expr (parser->dfa, atom, min, max);
+        }
+      expr = new_expr (parser->dfa, EXPR_CAT, expr, atom);
+      at_start = false;
+    }
+  /* Closing parentheses without an opening one are not supported.  */
+  if (parser->depth == 0 && at_group_end (parser))
+    return -1;
+
+  return expr;
+}
+
+/* Parses an alternation of branches.  */
+static int
+parse_alternation (parser_t *parser)
+{
+  int expr;
+
+  expr = parse_branch (parser);
+  while (expr >= 0 && at_alternation (parser))
+    {
+      parser->c += parser->cflags & REG_EXTENDED ? 1 : 2;
+      expr = new_expr (parser->dfa, EXPR_ALT, expr, parse_branch (parser));
+    }
+
+  return expr;
+}
+
+/* Adds a node and returns its index or -1 if there are too many nodes.  */
+static int
+new_node (dfa_t *dfa, int type, int out, int out1, int set)
+{
+  node_t *tmp, *node;
+
+  if (out < 0 || (type == EXPR_SPLIT && out1 < 0)
+      || dfa->nnodes >= MAX_NODES)
+    return -1;
+  if (dfa->nnodes == dfa->nodes_size)
+    {
+      tmp = realloc (dfa->nodes, 2*dfa->nodes_size*sizeof (node_t));
+      if (tmp == NULL)
+        return -1;
+      dfa->nodes = tmp;
+      dfa->nodes_size *= 2;
+    }
+  node = dfa->nodes+dfa->nnodes;
+  node->type = type;
+  node->out = out;
+  node->out1 = out1;
+  node->set = set;
+
+  return dfa->nnodes++;
+}
+
+/* Adds the nodes for expression expr followed by node next and returns the
+   first of them or -1 if there are too many nodes.  */
+static int
+build_nodes (dfa_t *dfa, int expr, int next)
+{
+  const expr_t *e = dfa->exprs+expr;
+  int i, loop, body, min, max, left, after;
+
+  if (next < 0)
+    return -1;
+  switch (e->type)
+    {
+    case EXPR_SET:
+      return new_node (dfa, EXPR_SET, next, -1, e->set);
+    case EXPR_CAT:
+      left = e->left;
+      return build_nodes (dfa, left, build_nodes (dfa, e->right, next));
+    case EXPR_ALT:
+      left = e->left;
+      body = build_nodes (dfa, e->right, next);
+      return new_node (dfa, EXPR_SPLIT, build_nodes (dfa, left, next), body,
+                       -1);
+    case EXPR_BOL:
+    case EXPR_EOL:
+      return new_node (dfa, e->type, next, -1, -1);
+    case EXPR_REPEAT:
+      left = e->left;
+      min = e->min;
+      max = e->max;
+      if (max < 0)
+        {
+          /* The split node loops back through the body.  */
+          loop = new_node (dfa, EXPR_SPLIT, next, next, -1);
+          if (loop < 0)
+            return -1;
+          body = build_nodes (dfa, left, loop);
+          if (body < 0)
+            return -1;
+          dfa->nodes[loop].out = body;
+          next = loop;
+        }
+      else
+        {
+          /* Each optional repetition can skip the remaining ones.  */
+          after = next;
+          for (i = 0; i < max-min; i++)
+            next = new_node (dfa, EXPR_SPLIT, build_nodes (dfa, left, next),
+                             after, -1);
+        }
+      for (i = 0; i < min; i++)
+        next = build_nodes (dfa, left, next);
+      return next;
+    default:
+      return next;
+    }
+}
+
+/* Marks the nodes from which a node of the given type is reached by empty
+   transitions in reach and returns reach or NULL if memory is exhausted.  */
+static bool *
+find_reach (const dfa_t *dfa, int type)
+{
+  const node_t *node;
+  bool *reach;
+  bool change_flag;
+  size_t i;
+
+  reach = (bool *) calloc (dfa->nnodes, sizeof (bool));
+  if (reach == NULL)
+    return NULL;
+  do
+    {
+      change_flag = false;
+      for (i = 0; i < dfa->nnodes; i++)
+        {
+          node = dfa->nodes+i;
+          if (reach[i])
+            continue;
+          if (node->type == type
+              || ((node->type == EXPR_SPLIT || node->type == EXPR_BOL
+                   || node->type == EXPR_EOL) && reach[node->out])
+              || (node->type == EXPR_SPLIT && reach[node->out1]))
+            {
+              reach[i] = true;
+              change_flag = true;
+            }
+        }
+    }
+  while (change_flag);
+
+  return reach;
+}
+
+/* Checks that beginning of line anchors never follow a character and that
+   end of line anchors are never followed by one.  regexec treats newline
+   characters like line boundaries in these cases.  */
+static bool
+check_anchors (const dfa_t *dfa)
+{
+  bool *reach;
+  bool bol_flag, eol_flag, valid_flag;
+  size_t i;
+
+  bol_flag = false;
+  eol_flag = false;
+  for (i = 0; i < dfa->nnodes; i++)
+    {
+      bol_flag |= dfa->nodes[i].type == EXPR_BOL;
+      eol_flag |= dfa->nodes[i].type == EXPR_EOL;
+    }
+  valid_flag = true;
+  if (bol_flag)
+    {
+      reach = find_reach (dfa, EXPR_BOL);
+      if (reach == NULL)
+        return false;
+      for (i = 0; i < dfa->nnodes; i++)
+        if (dfa->nodes[i].type == EXPR_SET && reach[dfa->nodes[i].out])
+          valid_flag = false;
+      free (reach);
+    }
+  if (eol_flag && valid_flag)
+    {
+      reach = find_reach (dfa, EXPR_SET);
+      if (reach == NULL)
+        return false;
+      for (i = 0; i < dfa->nnodes; i++)
+        if (dfa->nodes[i].type == EXPR_EOL && reach[dfa->nodes[i].out])
+          valid_flag = false;
+      free (reach);
+    }
+
+  return valid_flag;
+}
+
+/* Splits the characters into classes that no character set distinguishes.  */
+static void
+find_classes (dfa_t *dfa)
+{
+  int ids[2*(UCHAR_MAX+1)]; /* New classes by old class and membership.  */
+  int *id;
+  size_t i;
+  unsigned int c;
+  int n;
+
+  memset (dfa->classes, 0, sizeof (dfa->classes));
+  dfa->nclasses = 1;
+  for (i = 0; i < dfa->nnodes; i++)
+    {
+      if (dfa->nodes[i].type != EXPR_SET)
+        continue;
+      for (c = 0; c < 2*(UCHAR_MAX+1); c++)
+        ids[c] = -1;
+      n = 0;
+      for (c = 0; c <= UCHAR_MAX; c++)
+        {
+          id = ids + 2*dfa->classes[c]
+            + has_char (dfa->sets+dfa->nodes[i].set, c);
+          if (*id < 0)
+            *id = n++;
+          dfa->classes[c] = *id;
+        }
+      dfa->nclasses = n;
+    }
+  for (c = UCHAR_MAX+1; c-- > 0;)
+    dfa->reps[dfa->classes[c]] = c;
+}
+
+/* Frees all cached states.  */
+static void
+flush_cache (dfa_t *dfa)
+{
+  state_t *state, *next;
+  size_t i;
+
+  for (i = 0; i < HASH_SIZE; i++)
+    {
+      for (state = dfa->buckets[i]; state != NULL; state = next)
+        {
+          next = state->hash_next;
+          free (state);
+        }
+      dfa->buckets[i] = NULL;
+    }
+  dfa->starts[0] = NULL;
+  dfa->starts[1] = NULL;
+  dfa->cache_used = 0;
+  dfa->ncached = 0;
+  dfa->flush_scanned = dfa->scanned;
+  dfa->nflushes++;
+}
+
+/* Frees the automaton and its cached states.  */
+void
+free_dfa (dfa_t *dfa)
+{
+  if (dfa == NULL)
+    return;
+  flush_cache (dfa);
+  free (dfa->sets);
+  free (dfa->exprs);
+  free (dfa->nodes);
+  free (dfa->marks);
+  free (dfa->stack);
+  free (dfa->list);
+  free (dfa->closure);
+  free (dfa);
+}
+
+/* Compares two node indices for qsort.  */
+static int
+compare_nodes (const void *a, const void *b)
+{
+  return *(const int *) a - *(const int *) b;
+}
+
+/* Stores the nodes that are reached from the n nodes in list by empty
+   transitions in dfa->closure and returns their number.  Only character
+   nodes, end of line anchors and the accepting node are stored.  */
+static size_t
+find_closure (dfa_t *dfa, const int *list, size_t n, bool bol)
+{
+  const node_t *node;
+  size_t nstack, nclosure;
+  int i;
+
+  dfa->mark++;
+  nstack = 0;
+  while (n > 0)
+    dfa->stack[nstack++] = list[--n];
+  nclosure = 0;
+  while (nstack > 0)
+    {
+      i = dfa->stack[--nstack];
+      if (dfa->marks[i] == dfa->mark)
+        continue;
+      dfa->marks[i] = dfa->mark;
+      node = dfa->nodes+i;
+      switch (node->type)
+        {
+        case EXPR_SPLIT:
+          dfa->stack[nstack++] = node->out1;
+          dfa->stack[nstack++] = node->out;
+          break;
+        case EXPR_BOL:
+          if (bol)
+            dfa->stack[nstack++] = node->out;
+          break;
+        default:
+          dfa->closure[nclosure++] = i;
+          break;
+        }
+    }
+  qsort (dfa->closure, nclosure, sizeof (int), compare_nodes);
+
+  return nclosure;
+}
+
+/* Checks whether the accepting node is reached from the nodes of state if
+   the line ends.  */
+static bool
+check_eol (dfa_t *dfa, const state_t *state)
+{
+  const node_t *node;
+  size_t nstack, i;
+  int j;
+
+  dfa->mark++;
+  nstack = 0;
+  for (i = 0; i < state->nnodes; i++)
+    dfa->stack[nstack++] = state->nodes[i];
+  while (nstack > 0)
+    {
+      j = dfa->stack[--nstack];
+      if (dfa->marks[j] == dfa->mark)
+        continue;
+      dfa->marks[j] = dfa->mark;
+      node = dfa->nodes+j;
+      switch (node->type)
+        {
+        case EXPR_MATCH:
+          return true;
+        case EXPR_SPLIT:
+          dfa->stack[nstack++] = node->out1;
+          dfa->stack[nstack++] = node->out;
+          break;
+        case EXPR_BOL:
+          if (state->bol)
+            dfa->stack[nstack++] = node->out;
+          break;
+        case EXPR_EOL:
+          dfa->stack[nstack++] = node->out;
+          break;
+        default:
+          break;
+        }
+    }
+
+  return false;
+}
+
+/* Returns the cached state for the n nodes in dfa->closure or adds a new one.
+   Returns NULL if the cache is too small.  */
+static state_t *
+get_state (dfa_t *dfa, size_t n, bool bol)
+{
+  state_t *state;
+  size_t hash, i, size;
+
+  hash = bol;
+  for (i = 0; i < n; i++)
+    hash = hash*31 + dfa->closure[i];
+  hash %= HASH_SIZE;
+  for (state = dfa->buckets[hash]; state != NULL; state = state->hash_next)
+    if (state->bol == bol && state->nnodes == n
+        && memcmp (state->nodes, dfa->closure, n*sizeof (int)) == 0)
+      return state;
+
+  size = offsetof (state_t, next) + dfa->nclasses*sizeof (state_t *)
+    + n*sizeof (int);
+  if (dfa->cache_used + size > dfa->cache_size)
+    {
+      /* Give up if the cache is flushed too often.  */
+      if (dfa->scanned - dfa->flush_scanned
+          < MIN_SCAN_PER_STATE*dfa->ncached
+          || size > dfa->cache_size)
+        {
+          dfa->failed = true;
+          return NULL;
+        }
+      flush_cache (dfa);
+    }
+  state = (state_t *) malloc (size);
+  if (state == NULL)
+    {
+      dfa->failed = true;
+      return NULL;
+    }
+  for (i = 0; i < (size_t) dfa->nclasses; i++)
+    state->next[i] = NULL;
+  state->nodes = (int *) (state->next+dfa->nclasses);
+  memcpy (state->nodes, dfa->closure, n*sizeof (int));
+  state->nnodes = n;
+  state->bol = bol;
+  state->match = false;
+  for (i = 0; i < n; i++)
+    if (dfa->nodes[state->nodes[i]].type == EXPR_MATCH)
+      state->match = true;
+  state->eol_match = check_eol (dfa, state);
+  state->hash_next = dfa->buckets[hash];
+  dfa->buckets[hash] = state;
+  dfa->cache_used += size;
+  dfa->ncached++;
+
+  return state;
+}
+
+/* Computes the successor of state for character class cls.  Returns NULL if
+   the cache is too small.  */
+static state_t *
+get_next (dfa_t *dfa, state_t *state, int cls)
+{
+  const node_t *node;
+  state_t *next;
+  size_t i, n, nflushes;
+
+  n = 0;
+  for (i = 0; i < state->nnodes; i++)
+    {
+      node = dfa->nodes+state->nodes[i];
+      if (node->type == EXPR_SET
+          && has_char (dfa->sets+node->set, dfa->reps[cls]))
+        dfa->list[n++] = node->out;
+    }
+  /* A match can begin at every position.  */
+  dfa->list[n++] = dfa->start;
+  nflushes = dfa->nflushes;
+  next = get_state (dfa, find_closure (dfa, dfa->list, n, false), false);
+  /* The state is gone if the cache was flushed.  */
+  if (next != NULL && dfa->nflushes == nflushes)
+    state->next[cls] = next;
+
+  return next;
+}
+
+/* Returns the start state for a line or NULL if the cache is too small.  */
+static state_t *
+get_start (dfa_t *dfa, bool bol)
+{
+  state_t *state;
+  size_t nflushes;
+  unsigned int c;
+  int cls;
+
+  bol = bol && dfa->bol_flag;
+  if (dfa->starts[bol] != NULL)
+    return dfa->starts[bol];
+  state = get_state (dfa, find_closure (dfa, &dfa->start, 1, bol), bol);
+  dfa->starts[bol] = state;
+  if (state == NULL || bol)
+    return state;
+
+  /* Find the characters that do not leave the start state, so that the
+     search can skip them quickly.  */
+  nflushes = dfa->nflushes;
+  for (cls = 0; cls < dfa->nclasses; cls++)
+    if (state->next[cls] == NULL
+        && (get_next (dfa, state, cls) == NULL || dfa->nflushes != nflushes))
+      {
+        dfa->failed = true;
+        return NULL;
+      }
+  for (c = 0; c <= UCHAR_MAX; c++)
+    dfa->skip[c] = state->next[dfa->classes[c]] == state;
+  dfa->skip['\n'] = false;
+
+  return state;
+}
+
+/* Builds an automaton for the regular expression string compiled with cflags.
+   States are constructed on demand and cached in at most cache_size bytes.
+   Returns NULL if the expression contains constructs that the automaton does
+   not support, like back-references and word boundaries.  */
+dfa_t *
+new_dfa (const char *string, int cflags, size_t cache_size)
+{
+  dfa_t *dfa;
+  parser_t parser;
+  int expr, match;
+  size_t i;
+
+  parser.utf8 = false;
+  if (MB_CUR_MAX > 1)
+    {
+      /* Other multibyte encodings may contain ASCII bytes in characters.  */
+      if (strcmp (locale_charset (), "UTF-8") != 0)
+        return NULL;
+      parser.utf8 = true;
+    }
+
+  dfa = (dfa_t *) calloc (1, sizeof (dfa_t));
+  if (dfa == NULL)
+    return NULL;
+  dfa->sets_size = 16;
+  dfa->sets = (set_t *) malloc (dfa->sets_size*sizeof (set_t));
+  dfa->exprs_size = 64;
+  dfa->exprs = (expr_t *) malloc (dfa->exprs_size*sizeof (expr_t));
+  dfa->nodes_size = 64;
+  dfa->nodes = (node_t *) malloc (dfa->nodes_size*sizeof (node_t));
+  dfa->cache_size = cache_size;
+  if (dfa->sets == NULL || dfa->exprs == NULL || dfa->nodes == NULL)
+    {
+      free_dfa (dfa);
+      return NULL;
+    }
+
+  /* Parse regular expression into syntax tree.  */
+  parser.dfa = dfa;
+  parser.c = string;
+  parser.cflags = cflags;
+  parser.depth = 0;
+  expr = parse_alternation (&parser);
+  if (expr < 0 || *parser.c != '\0')
+    {
+      free_dfa (dfa);
+      return NULL;
+    }
+
+  /* Translate syntax tree into nodes.  */
+  match = new_node (dfa, EXPR_MATCH, 0, -1, -1);
+  dfa->start = build_nodes (dfa, expr, match);
+  free (dfa->exprs);
+  dfa->exprs = NULL;
+  for (i = 0; i < dfa->nnodes; i++)
+    if (dfa->nodes[i].type == EXPR_BOL)
+      dfa->bol_flag = true;
+  if (dfa->start < 0 || !check_anchors (dfa))
+    {
+      free_dfa (dfa);
+      return NULL;
+    }
+  find_classes (dfa);
+
+  /* Allocate work space for computing states.  */
+  dfa->marks = (int *) malloc (dfa->nnodes*sizeof (int));
+  dfa->stack = (int *) malloc ((3*dfa->nnodes+2)*sizeof (int));
+  dfa->list = (int *) malloc ((dfa->nnodes+1)*sizeof (int));
+  dfa->closure = (int *) malloc (dfa->nnodes*sizeof (int));
+  if (dfa->marks == NULL || dfa->stack == NULL || dfa->list == NULL
+      || dfa->closure == NULL)
+    {
+      free_dfa (dfa);
+      return NULL;
+    }
+  for (i = 0; i < dfa->nnodes; i++)
+    dfa->marks[i] = 0;
+
+  return dfa;
+}
+
+/* Searches the len characters at start line by line for a match of the
+   automaton as regexec would find it in each line.  If bol is false, start
+   is not the beginning of a line.  Returns 1 and stores the start of the first
+   line with a match in the last argument, 0 if no line contains a match or -1
+   if the state cache became too small.  In the last case, the start of the
+   line where the search stopped is stored.  */
+int
+dfa_search (dfa_t *dfa, const char *start, size_t len, bool bol,
+            const char **found)
+{
+  const unsigned char *p, *end, *line;
+  state_t *state, *next;
+  unsigned char c;
+
+  p = (const unsigned char *) start;
+  end = p+len;
+  *found = start;
+  if (dfa->failed)
+    return -1;
+  for (;;)
+    {
+      line = p;
+      /* The line ends behind the next newline character, which is found
+         while scanning, so that a match early in a long line does not cost
+         a pass over the whole line.  */
+      state = get_start (dfa, p == (const unsigned char *) start ? bol : true);
+      while (state != NULL && !state->match && p < end)
+        {
+          if (state == dfa->starts[0])
+            {
+              /* The newline character is never skipped.  */
+              while (p < end && dfa->skip[*p])
+                p++;
+              if (p == end)
+                break;
+            }
+          c = *p++;
+          next = state->next[dfa->classes[c]];
+          if (next == NULL)
+            {
+              dfa->scanned += p-1-line;
+              next = get_next (dfa, state, dfa->classes[c]);
+              dfa->scanned -= p-1-line;
+            }
+          state = next;
+          if (c == '\n')
+            break;
+        }
+      dfa->scanned += p-line;
+      if (state == NULL)
+        {
+          *found = (const char *) line;
+          return -1;
+        }
+      if (state->match
+          || (state->eol_match && (p > line || len == 0)))
+        {
+          *found = (const char *) line;
+          return 1;
+        }
+      if (p >= end)
+        return 0;
+    }
+}
@@ -0,0 +1,38 @@
+/* dfa.h - declarations for the lazy deterministic automaton of rrep.
+   Copyright (C) 2026 Arno Onken <asnelt@asnelt.org>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA
+   02110-1301, USA.  */
+
+/* Deterministic automaton that decides whether a regular expression matches
+   in a line.  */
+typedef struct dfa dfa_t;
+
+/* Builds an automaton for the regular expression string compiled with cflags.
+   States are constructed on demand and cached in at most cache_size bytes.
+   Returns NULL if the expression contains constructs that the automaton does
+   not support, like back-references and word boundaries.  */
+extern dfa_t *new_dfa (const char *, int, size_t);
+
+/* Frees the automaton and its cached states.  */
+extern void free_dfa (dfa_t *);
+
+/* Searches the len characters at start line by line for a match of the
+   automaton as regexec would find it in each line.  If bol is false, start
+   is not the beginning of a line.  Returns 1 and stores the start of the first
+   line with a match in the last argument, 0 if no line contains a match or -1
+   if the state cache became too small.  In the last case, the start of the
+   line where the search stopped is stored.  */
+extern int dfa_search (dfa_t *, const char *, size_t, bool, const char **);
@@ -0,0 +1,409 @@
+/* ignore.c - excluding files by .gitignore and .ignore files in rrep.
+   Copyright (C) 2026 Arno Onken <asnelt@asnelt.org>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA
+   02110-1301, USA.  */
+
+/* The ignore files of a directory are read and parsed once, when the
+   directory is opened.  Its rules are kept in a frame that points to the
+   frame of the closest directory above it with rules, so the frames of a
+   walk form a tree that follows the directories.  Frames are shared by the
+   tasks of parallel walks and freed with their last reference.
+
+   The rules follow the format of gitignore: a later rule overrides an
+   earlier one of the same file, rules of deeper directories override those
+   of directories above, a leading ! negates a rule, a trailing slash
+   restricts it to directories, and a rule with a slash in front or in the
+   middle is matched against the path relative to its directory, where two
+   stars match any number of directories.  Other rules are matched against
+   the name of the entry.  */
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <regex.h>
+#include <fnmatch.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "rrep.h"
+#include "messages.h"
+#include "ignore.h"
+
+/* Data structure for a rule of an ignore file.  */
+typedef struct
+{
+  const char *pattern; /* Null terminated pattern.  */
+  bool negate_flag; /* The rule includes what it matches.  */
+  bool dir_flag; /* The rule only matches directories.  */
+  bool anchored_flag; /* The rule matches the relative path.  */
+  bool wildcard_flag; /* The pattern has wildcards or escapes.  */
+} rule_t;
+
+/* Data structure for the rules of a directory.  */
+struct ignore
+{
+  ignore_t *parent; /* Rules of the directories above or NULL.  */
+  rule_t *rules; /* Rules in the order of the ignore files.  */
+  size_t nrules; /* Number of rules.  */
+  char *text; /* Contents of the ignore files that hold the patterns.  */
+  size_t prefix_len; /* Length of the directory path including a slash.  */
+  size_t refs; /* Number of references.  */
+};
+
+/* Names of the ignore files in the order in which they are read, so that
+   rules of later files override those of earlier ones.  */
+static const char *const ignore_files[] = { ".gitignore", ".ignore" };
+
+/* Number of ignore files.  */
+#define NIGNORE_FILES (sizeof (ignore_files) / sizeof (ignore_files[0]))
+
+/* Lock for the reference counts.  */
+static pthread_mutex_t ignore_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Returns another reference to ignore, which may be NULL.  */
+ignore_t *
+hold_ignore (ignore_t *ignore)
+{
+  if (ignore != NULL)
+    {
+      pthread_mutex_lock (&ignore_lock);
+      ignore->refs++;
+      pthread_mutex_unlock (&ignore_lock);
+    }
+
+  return ignore;
+}
+
+/* Releases a reference to ignore, which may be NULL.  */
+void
+release_ignore (ignore_t *ignore)
+{
+  ignore_t *parent;
+  size_t refs;
+
+  while (ignore != NULL)
+    {
+      pthread_mutex_lock (&ignore_lock);
+      refs = --ignore->refs;
+      pthread_mutex_unlock (&ignore_lock);
+      if (refs > 0)
+        return;
+      parent = ignore->parent;
+      free (ignore->rules);
+      free (ignore->text);
+      free (ignore);
+      ignore = parent;
+    }
+}
+
+/* Appends the contents of the file name in the directory dir_fd with path
+   dir_path to *text, which holds *len characters.  A missing file is not an
+   error.  Errors are reported with dir_path.  */
+static int
+read_ignore_file (int dir_fd, const char *dir_path, const char *name,
+                  char **text, size_t *len)
+{
+  struct stat st;
+  char *tmp;
+  ssize_t nread;
+  int fd;
+
+  fd = openat (dir_fd, name, O_RDONLY | O_NOCTTY);
+  if (fd < 0)
+    {
+      if (errno == ENOENT)
+        return SUCCESS;
+      rrep_error (ERR_READ_IGNORE, dir_path);
+      return FAILURE;
+    }
+  if (fstat (fd, &st) < 0 || !S_ISREG (st.st_mode))
+    {
+      close (fd);
+      return SUCCESS;
+    }
+  /* A newline separates the contents of both files.  */
+  tmp = (char *) realloc (*text, *len + st.st_size + 2);
+  if (tmp == NULL)
+    {
+      close (fd);
+      rrep_error (ERR_MEMORY, dir_path);
+      return FAILURE;
+    }
+  *text = tmp;
+  while ((nread = read (fd, *text + *len, st.st_size)) != 0)
+    {
+      if (nread < 0)
+        {
+          if (errno == EINTR)
+            continue;
+          rrep_error (ERR_READ_IGNORE, dir_path);
+          close (fd);
+          return FAILURE;
+        }
+      /* Only the size at the time of fstat is read.  */
+      *len += nread;
+      st.st_size -= nread;
+      if (st.st_size == 0)
+        break;
+    }
+  (*text)[(*len)++] = '\n';
+  close (fd);
+
+  return SUCCESS;
+}
+
+/* Turns the line at line into a rule of ignore unless it is empty or a
+   comment.  The line is modified in place.  */
+static void
+parse_rule (ignore_t *ignore, char *line)
+{
+  rule_t *rule = &ignore->rules[ignore->nrules];
+  size_t len = strlen (line);
+  char *p;
+
+  /* Trailing spaces are removed unless they are escaped.  */
+  while (len > 0 && line[len-1] == ' '
+         && !(len > 1 && line[len-2] == '\\'))
+    len--;
+  line[len] = '\0';
+  if (len == 0 || line[0] == '#')
+    return;
+
+  rule->negate_flag = (line[0] == '!');
+  if (rule->negate_flag)
+    {
+      line++;
+      len--;
+    }
+  rule->dir_flag = (len > 0 && line[len-1] == '/');
+  if (rule->dir_flag)
+    line[--len] = '\0';
+  if (len == 0)
+    return;
+  rule->anchored_flag = (strchr (line, '/') != NULL);
+  if (line[0] == '/')
+    line++;
+  rule->wildcard_flag = false;
+  for (p = line; *p != '\0'; p++)
+    if (*p == '*' || *p == '?' || *p == '[' || *p == '\\')
+      rule->wildcard_flag = true;
+  rule->pattern = line;
+  ignore->nrules++;
+}
+
+/* Returns true if the character c matches the bracket expression at
+   pattern, whose length is stored in *len.  A bracket expression that is not
+   closed matches the bracket itself.  */
+static bool
+match_bracket (const char *pattern, char c, size_t *len)
+{
+  char expression[256];
+  char string[2];
+  const char *p = pattern + 1;
+
+  /* Find the closing bracket, which may not come first.  */
+  if (*p == '!' || *p == '^')
+    p++;
+  if (*p == ']')
+    p++;
+  while (*p != '\0' && *p != ']')
+    {
+      if (p[0] == '[' && p[1] == ':')
+        {
+          p = strstr (p + 2, ":]");
+          if (p == NULL)
+            break;
+          p += 2;
+        }
+      else
+        p++;
+    }
+  if (p == NULL || *p != ']'
+      || (size_t) (p - pattern) + 2 > sizeof (expression))
+    {
+      *len = 1;
+      return c == '[';
+    }
+  *len = p - pattern + 1;
+  memcpy (expression, pattern, *len);
+  expression[*len] = '\0';
+  string[0] = c;
+  string[1] = '\0';
+
+  return fnmatch (expression, string, FNM_PATHNAME) == 0;
+}
+
+/* Returns true if pattern matches string.  Wildcards do not match slashes,
+   but a component of two stars matches any number of directories.  */
+static bool
+match_glob (const char *pattern, const char *string)
+{
+  size_t len;
+
+  while (*pattern != '\0')
+    {
+      switch (*pattern)
+        {
+        case '*':
+          if (pattern[1] == '*' && (pattern[2] == '/' || pattern[2] == '\0'))
+            {
+              /* Any number of directories.  */
+              if (pattern[2] == '\0')
+                return true;
+              pattern += 3;
+              for (;;)
+                {
+                  if (match_glob (pattern, string))
+                    return true;
+                  string = strchr (string, '/');
+                  if (string == NULL)
+                    return false;
+                  string++;
+                }
+            }
+          while (*pattern == '*')
+            pattern++;
+          for (;;)
+            {
+              if (match_glob (pattern, string))
+                return true;
+              if (*string == '\0' || *string == '/')
+                return false;
+              string++;
+            }
+
+        case '?':
+          if (*string == '\0' || *string == '/')
+            return false;
+          pattern++;
+          string++;
+          break;
+
+        case '[':
+          if (*string == '\0' || *string == '/'
+              || !match_bracket (pattern, *string, &len))
+            return false;
+          pattern += len;
+          string++;
+          break;
+
+        case '\\':
+          if (pattern[1] != '\0')
+            pattern++;
+          /* Fall through.  */
+        default:
+          if (*pattern != *string)
+            return false;
+          pattern++;
+          string++;
+        }
+    }
+
+  return *string == '\0';
+}
+
+/* Reads the ignore files of the directory dir_fd with path dir_path.  The
+   rules of the directories above it are given by parent, which may be NULL.
+   *ignore then holds the rules that apply to the entries of the directory
+   and must be released with release_ignore.  If the ignore files cannot be
+   read, only the rules above apply and FAILURE is returned.  */
+int
+load_ignore (int dir_fd, const char *dir_path, ignore_t *parent,
+             ignore_t **ignore)
+{
+  ignore_t *new_ignore;
+  char *text = NULL;
+  char *line, *end;
+  size_t len = 0;
+  size_t nlines = 0;
+  size_t i;
+
+  *ignore = hold_ignore (parent);
+  for (i = 0; i < NIGNORE_FILES; i++)
+    {
+      if (read_ignore_file (dir_fd, dir_path, ignore_files[i], &text, &len)
+          != SUCCESS)
+        {
+          free (text);
+          return FAILURE;
+        }
+    }
+  /* Without rules of its own, the directory shares those above.  */
+  if (len == 0)
+    return SUCCESS;
+
+  for (i = 0; i < len; i++)
+    if (text[i] == '\n')
+      nlines++;
+  new_ignore = (ignore_t *) calloc (1, sizeof (ignore_t));
+  if (new_ignore != NULL)
+    new_ignore->rules = (rule_t *) calloc (nlines, sizeof (rule_t));
+  if (new_ignore == NULL || new_ignore->rules == NULL)
+    {
+      rrep_error (ERR_MEMORY, dir_path);
+      free (new_ignore);
+      free (text);
+      return FAILURE;
+    }
+  for (line = text; line < text + len; line = end + 1)
+    {
+      end = memchr (line, '\n', text + len - line);
+      *end = '\0';
+      parse_rule (new_ignore, line);
+    }
+  new_ignore->text = text;
+  len = strlen (dir_path);
+  new_ignore->prefix_len = len > 0 && dir_path[len-1] != '/' ? len + 1 : len;
+  new_ignore->refs = 1;
+  new_ignore->parent = *ignore;
+  *ignore = new_ignore;
+
+  return SUCCESS;
+}
+
+/* Returns true if the rules of ignore exclude the entry with path path.
+   The path must start with the path of the directory that was passed to
+   load_ignore.  If dir_flag is set, the entry is a directory.  */
+bool
+ignored_path (const ignore_t *ignore, const char *path, bool dir_flag)
+{
+  const rule_t *rule;
+  const char *name, *subject;
+  size_t i;
+
+  name = strrchr (path, '/');
+  name = name != NULL ? name + 1 : path;
+  for (; ignore != NULL; ignore = ignore->parent)
+    {
+      for (i = ignore->nrules; i > 0; i--)
+        {
+          rule = &ignore->rules[i-1];
+          if (rule->dir_flag && !dir_flag)
+            continue;
+          subject = rule->anchored_flag ? path + ignore->prefix_len : name;
+          if (rule->wildcard_flag ? match_glob (rule->pattern, subject)
+                                  : !strcmp (rule->pattern, subject))
+            return !rule->negate_flag;
+        }
+    }
+
+  return false;
+}
@@ -0,0 +1,39 @@
+/* ignore.h - declarations for ignore files in rrep.
+   Copyright (C) 2026 Arno Onken <asnelt@asnelt.org>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA
+   02110-1301, USA.  */
+
+/* Rules of the ignore files of a directory and of all directories above it
+   in a walk.  */
+typedef struct ignore ignore_t;
+
+/* Reads the ignore files of the directory dir_fd with path dir_path.  The
+   rules of the directories above it are given by parent, which may be NULL.
+   *ignore then holds the rules that apply to the entries of the directory
+   and must be released with release_ignore.  If the ignore files cannot be
+   read, only the rules above apply and FAILURE is returned.  */
+extern int load_ignore (int, const char *, ignore_t *, ignore_t **);
+
+/* Returns another reference to ignore, which may be NULL.  */
+extern ignore_t *hold_ignore (ignore_t *);
+
+/* Releases a reference to ignore, which may be NULL.  */
+extern void release_ignore (ignore_t *);
+
+/* Returns true if the rules of ignore exclude the entry with path path.
+   The path must start with the path of the directory that was passed to
+   load_ignore.  If dir_flag is set, the entry is a directory.  */
+extern bool ignored_path (const ignore_t *, const char *, bool);
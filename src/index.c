@@ -0,0 +1,772 @@
+/* index.c - trigram index for selecting the files that may match in rrep.
+   Copyright (C) 2026 Arno Onken <asnelt@asnelt.org>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA
+   02110-1301, USA.  */
+
+/* The index of a directory holds a record for each regular file below it
+   with the size, modification and status change time of the file and a
+   Bloom filter of the trigrams in its contents.  Letters are folded to lower
+   case, so the same index serves searches with and without --ignore-case.
+   A file can only match a string if its filter contains all trigrams of the
+   string, so files whose filter lacks one of them are skipped without being
+   opened.  Filters may report trigrams that are not in the file, which only
+   means that the file is searched as usual.
+
+   Filters grow with the number of different trigrams of a file, so that
+   their rate of false reports stays about the same, and unlike posting
+   lists they are built and replaced one file at a time.  Files that changed
+   after the index was built, by size, modification or status change time,
+   and files that are not in the index are always searched.  The status
+   change time catches rewrites whose modification time was restored.
+
+   The index is stored in the byte order of the machine that built it.  It
+   starts with a magic string and the number of records.  Each record starts
+   with a header and is followed by the path of the file relative to the
+   directory and by the filter, padded to a multiple of eight.  */
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <regex.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "opendirat.h"
+#include "stat-time.h"
+#include "rrep.h"
+#include "messages.h"
+#include "bufferio.h"
+#include "pattern.h"
+#include "index.h"
+
+/* Magic string at the start of an index file.  */
+#define INDEX_MAGIC "RREPIDX2"
+
+/* Length of INDEX_MAGIC.  */
+#define MAGIC_LEN (8)
+
+/* Number of different trigrams.  */
+#define NTRIGRAMS (1 << 24)
+
+/* Bits of a filter per trigram of a file.  */
+#define BITS_PER_TRIGRAM (8)
+
+/* Minimum and maximum number of bits of a filter.  */
+#define MIN_FILTER_BITS (64)
+#define MAX_FILTER_BITS (1024*1024)
+
+/* Number of bits that are set in a filter for each trigram.  */
+#define FILTER_HASHES (3)
+
+/* Size of the blocks in which files are read for indexing.  */
+#define READ_SIZE (64*1024)
+
+/* Data structure for the header of a record in an index file.  */
+typedef struct
+{
+  uint64_t size; /* Size of the file.  */
+  int64_t mtime_sec; /* Seconds of the modification time.  */
+  int64_t mtime_nsec; /* Nanoseconds of the modification time.  */
+  int64_t ctime_sec; /* Seconds of the status change time.  */
+  int64_t ctime_nsec; /* Nanoseconds of the status change time.  */
+  uint32_t path_len; /* Length of the path that follows the header.  */
+  uint32_t filter_len; /* Length of the filter that follows the path.  */
+} record_t;
+
+/* Data structure for a file in the index.  */
+typedef struct
+{
+  const record_t *record; /* Header of the record.  */
+  const char *path; /* Path relative to the directory, not terminated.  */
+  const unsigned char *filter; /* Bloom filter of the trigrams.  */
+  size_t hash; /* Hash value of path.  */
+  bool candidate_flag; /* The file may contain a match.  */
+} entry_t;
+
+/* Data structure for the index of a directory.  */
+struct index
+{
+  char *data; /* Contents of the index file.  */
+  entry_t *entries; /* Files in the index.  */
+  size_t nentries; /* Number of files.  */
+  size_t *slots; /* Hash table of entry indices plus one, zero if empty.  */
+  size_t nslots; /* Number of slots, which is a power of two.  */
+  size_t prefix_len; /* Length of the directory path including a slash.  */
+};
+
+/* Data structure for building an index.  */
+typedef struct
+{
+  FILE *out; /* New index file.  */
+  const char *out_name; /* Name of the new index file for messages.  */
+  index_t *old; /* Previous index or NULL.  */
+  /* Function that classifies directory entries.  */
+  int (*entry_function) (int, const struct dirent *);
+  unsigned char *seen; /* Bit set of the trigrams of the current file.  */
+  uint32_t *trigrams; /* Different trigrams of the current file.  */
+  size_t ntrigrams; /* Number of trigrams.  */
+  size_t trigrams_size; /* Allocated number of trigrams.  */
+  unsigned char *filter; /* Filter of the current file.  */
+  char *block; /* Buffer for reading files.  */
+  char *path; /* Path of the current entry relative to the directory.  */
+  size_t path_size; /* Size of path.  */
+  uint64_t nrecords; /* Number of written records.  */
+  bool failure_flag; /* Some file could not be indexed.  */
+} builder_t;
+
+/* Returns the character c in lower case if it is an ASCII letter.  */
+static unsigned char
+fold (unsigned char c)
+{
+  return c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c;
+}
+
+/* Returns the hash value of the first len characters of string.  */
+static size_t
+hash_path (const char *string, size_t len)
+{
+  size_t hash = 2166136261u;
+  size_t i;
+
+  for (i = 0; i < len; i++)
+    hash = (hash ^ (unsigned char) string[i]) * 16777619u;
+
+  return hash;
+}
+
+/* Stores the bits of trigram in a filter of nbits bits in pos.  */
+static void
+filter_bits (uint32_t trigram, size_t nbits, size_t *pos)
+{
+  uint32_t h1 = trigram * 2654435761u;
+  uint32_t h2 = ((trigram ^ (trigram >> 7)) * 2246822519u) | 1;
+  int i;
+
+  for (i = 0; i < FILTER_HASHES; i++)
+    pos[i] = (h1 + i * h2) & (nbits - 1);
+}
+
+/* Returns the length of a record with header record including padding.  */
+static size_t
+record_len (const record_t *record)
+{
+  return sizeof (record_t)
+         + ((record->path_len + record->filter_len + 7) & ~(size_t) 7);
+}
+
+/* Frees the index, which may be NULL.  */
+void
+free_index (index_t *index)
+{
+  if (index == NULL)
+    return;
+  free (index->data);
+  free (index->entries);
+  free (index->slots);
+  free (index);
+}
+
+/* Returns the entry of the path with length len in index or NULL.  */
+static entry_t *
+find_entry (const index_t *index, const char *path, size_t len)
+{
+  entry_t *entry;
+  size_t hash = hash_path (path, len);
+  size_t i;
+
+  for (i = hash & (index->nslots - 1); index->slots[i] != 0;
+       i = (i + 1) & (index->nslots - 1))
+    {
+      entry = &index->entries[index->slots[i] - 1];
+      if (entry->hash == hash && entry->record->path_len == len
+          && !memcmp (entry->path, path, len))
+        return entry;
+    }
+
+  return NULL;
+}
+
+/* Reads the index file of the directory dir_name into *index.  Returns
+   SUCCESS with *index set to NULL if there is no index.  */
+static int
+read_index (const char *dir_name, index_t **index)
+{
+  const record_t *record;
+  index_t *new_index;
+  struct stat st;
+  char *name;
+  size_t dir_len = strlen (dir_name);
+  size_t offset, len, i, j;
+  uint64_t nrecords;
+  ssize_t nread;
+  int fd;
+
+  *index = NULL;
+  name = (char *) malloc (dir_len + sizeof (INDEX_NAME) + 1);
+  if (name == NULL)
+    {
+      rrep_error (ERR_MEMORY, dir_name);
+      return FAILURE;
+    }
+  sprintf (name, "%s/%s", dir_name, INDEX_NAME);
+  fd = open (name, O_RDONLY | O_NOCTTY);
+  free (name);
+  if (fd < 0)
+    {
+      if (errno == ENOENT)
+        return SUCCESS;
+      rrep_error (ERR_READ_INDEX, dir_name);
+      return FAILURE;
+    }
+
+  new_index = (index_t *) calloc (1, sizeof (index_t));
+  if (new_index == NULL || fstat (fd, &st) < 0)
+    {
+      rrep_error (new_index == NULL ? ERR_MEMORY : ERR_READ_INDEX, dir_name);
+      free (new_index);
+      close (fd);
+      return FAILURE;
+    }
+  len = st.st_size;
+  new_index->data = (char *) malloc (len > 0 ? len : 1);
+  if (new_index->data == NULL)
+    {
+      rrep_error (ERR_MEMORY, dir_name);
+      free_index (new_index);
+      close (fd);
+      return FAILURE;
+    }
+  for (offset = 0; offset < len; offset += nread)
+    {
+      nread = read (fd, new_index->data + offset, len - offset);
+      if (nread <= 0)
+        {
+          if (nread < 0 && errno == EINTR)
+            {
+              nread = 0;
+              continue;
+            }
+          rrep_error (ERR_READ_INDEX, dir_name);
+          free_index (new_index);
+          close (fd);
+          return FAILURE;
+        }
+    }
+  close (fd);
+
+  /* Check the records before they are used.  */
+  if (len < MAGIC_LEN + sizeof (uint64_t)
+      || memcmp (new_index->data, INDEX_MAGIC, MAGIC_LEN))
+    goto invalid;
+  memcpy (&nrecords, new_index->data + MAGIC_LEN, sizeof (uint64_t));
+  offset = MAGIC_LEN + sizeof (uint64_t);
+  if (nrecords > (len - offset) / sizeof (record_t))
+    goto invalid;
+  new_index->nentries = nrecords;
+  for (new_index->nslots = 16; new_index->nslots < 2 * nrecords;
+       new_index->nslots *= 2)
+    ;
+  new_index->entries = (entry_t *) calloc (nrecords > 0 ? nrecords : 1,
+                                           sizeof (entry_t));
+  new_index->slots = (size_t *) calloc (new_index->nslots, sizeof (size_t));
+  if (new_index->entries == NULL || new_index->slots == NULL)
+    {
+      rrep_error (ERR_MEMORY, dir_name);
+      free_index (new_index);
+      return FAILURE;
+    }
+  for (i = 0; i < nrecords; i++)
+    {
+      record = (const record_t *) (new_index->data + offset);
+      if (len - offset < sizeof (record_t)
+          || len - offset < record_len (record)
+          || (record->filter_len & (record->filter_len - 1))
+          || record->filter_len < MIN_FILTER_BITS / 8)
+        goto invalid;
+      new_index->entries[i].record = record;
+      new_index->entries[i].path = (const char *) (record + 1);
+      new_index->entries[i].filter = (const unsigned char *) (record + 1)
+                                     + record->path_len;
+      new_index->entries[i].hash = hash_path (new_index->entries[i].path,
+                                              record->path_len);
+      new_index->entries[i].candidate_flag = true;
+      for (j = new_index->entries[i].hash & (new_index->nslots - 1);
+           new_index->slots[j] != 0; j = (j + 1) & (new_index->nslots - 1))
+        ;
+      new_index->slots[j] = i + 1;
+      offset += record_len (record);
+    }
+  new_index->prefix_len = dir_len > 0 && dir_name[dir_len-1] != '/'
+                          ? dir_len + 1 : dir_len;
+  *index = new_index;
+
+  return SUCCESS;
+
+ invalid:
+  rrep_error (ERR_INDEX_FORMAT, dir_name);
+  free_index (new_index);
+  return FAILURE;
+}
+
+/* Adds the trigrams of the len characters at block, which follow the two
+   characters in *carry, to the trigrams of the current file.  Returns
+   FAILURE if memory is insufficient.  */
+static int
+add_trigrams (builder_t *builder, const char *block, size_t len,
+              unsigned char *carry)
+{
+  uint32_t *tmp;
+  uint32_t trigram;
+  size_t i;
+
+  for (i = 0; i < len; i++)
+    {
+      carry[0] = carry[1];
+      carry[1] = carry[2];
+      carry[2] = fold (block[i]);
+      if (carry[3] < 2)
+        {
+          /* The first two characters of a file do not end a trigram.  */
+          carry[3]++;
+          continue;
+        }
+      trigram = ((uint32_t) carry[0] << 16) | (carry[1] << 8) | carry[2];
+      if (builder->seen[trigram >> 3] & (1 << (trigram & 7)))
+        continue;
+      if (builder->ntrigrams == builder->trigrams_size)
+        {
+          tmp = (uint32_t *) realloc (builder->trigrams,
+                                      2 * builder->trigrams_size
+                                      * sizeof (uint32_t));
+          if (tmp == NULL)
+            return FAILURE;
+          builder->trigrams = tmp;
+          builder->trigrams_size *= 2;
+        }
+      builder->seen[trigram >> 3] |= 1 << (trigram & 7);
+      builder->trigrams[builder->ntrigrams++] = trigram;
+    }
+
+  return SUCCESS;
+}
+
+/* Returns true if the file with status st is unchanged since record was
+   written.  The status change time also reveals a rewrite whose
+   modification time was restored, as by --keep-times.  */
+static bool
+unchanged_file (const record_t *record, const struct stat *st)
+{
+  struct timespec mtime = get_stat_mtime (st);
+  struct timespec ctime = get_stat_ctime (st);
+
+  return record->size == (uint64_t) st->st_size
+         && record->mtime_sec == mtime.tv_sec
+         && record->mtime_nsec == mtime.tv_nsec
+         && record->ctime_sec == ctime.tv_sec
+         && record->ctime_nsec == ctime.tv_nsec;
+}
+
+/* Writes a record for the file with status st and the filter of len bytes
+   to the new index.  */
+static int
+write_record (builder_t *builder, const struct stat *st,
+              const unsigned char *filter, size_t filter_len)
+{
+  static const char padding[8];
+  struct timespec mtime = get_stat_mtime (st);
+  struct timespec ctime = get_stat_ctime (st);
+  record_t record;
+  size_t path_len = strlen (builder->path);
+
+  memset (&record, 0, sizeof (record));
+  record.size = st->st_size;
+  record.mtime_sec = mtime.tv_sec;
+  record.mtime_nsec = mtime.tv_nsec;
+  record.ctime_sec = ctime.tv_sec;
+  record.ctime_nsec = ctime.tv_nsec;
+  record.path_len = path_len;
+  record.filter_len = filter_len;
+  if (fwrite (&record, sizeof (record), 1, builder->out) != 1
+      || fwrite (builder->path, 1, path_len, builder->out) != path_len
+      || fwrite (filter, 1, filter_len, builder->out) != filter_len
+      || fwrite (padding, 1, record_len (&record) - sizeof (record)
+                             - path_len - filter_len, builder->out)
+         != record_len (&record) - sizeof (record) - path_len - filter_len)
+    {
+      rrep_error (ERR_WRITE_INDEX, builder->out_name);
+      return FAILURE;
+    }
+  builder->nrecords++;
+
+  return SUCCESS;
+}
+
+/* Indexes the file name in the directory dir_fd.  The path of the file is
+   in the path buffer of builder.  */
+static int
+index_file (builder_t *builder, int dir_fd, const char *name)
+{
+  const entry_t *entry;
+  struct stat st;
+  unsigned char carry[4] = { 0, 0, 0, 0 };
+  size_t nbits, pos[FILTER_HASHES];
+  size_t i;
+  ssize_t nread;
+  int fd, j;
+
+  fd = openat (dir_fd, name, O_RDONLY | O_NOCTTY | O_NOFOLLOW);
+  if (fd < 0 || fstat (fd, &st) < 0)
+    {
+      rrep_error (ERR_OPEN_READ, builder->path);
+      if (fd >= 0)
+        close (fd);
+      return FAILURE;
+    }
+
+  /* Keep the filter of an unchanged file.  */
+  if (builder->old != NULL)
+    {
+      entry = find_entry (builder->old, builder->path,
+                          strlen (builder->path));
+      if (entry != NULL && unchanged_file (entry->record, &st))
+        {
+          close (fd);
+          return write_record (builder, &st, entry->filter,
+                               entry->record->filter_len);
+        }
+    }
+
+  builder->ntrigrams = 0;
+  while ((nread = read (fd, builder->block, READ_SIZE)) != 0)
+    {
+      if (nread < 0)
+        {
+          if (errno == EINTR)
+            continue;
+          rrep_error (ERR_READ_FILE, builder->path);
+          break;
+        }
+      if (add_trigrams (builder, builder->block, nread, carry) != SUCCESS)
+        {
+          rrep_error (ERR_MEMORY, builder->path);
+          nread = -1;
+          break;
+        }
+    }
+  close (fd);
+
+  /* Size the filter for the trigrams and clear the bit set for the next
+     file.  */
+  for (nbits = MIN_FILTER_BITS;
+       nbits < BITS_PER_TRIGRAM * builder->ntrigrams
+       && nbits < MAX_FILTER_BITS;
+       nbits *= 2)
+    ;
+  memset (builder->filter, 0, nbits / 8);
+  for (i = 0; i < builder->ntrigrams; i++)
+    {
+      builder->seen[builder->trigrams[i] >> 3] = 0;
+      filter_bits (builder->trigrams[i], nbits, pos);
+      for (j = 0; j < FILTER_HASHES; j++)
+        builder->filter[pos[j] >> 3] |= 1 << (pos[j] & 7);
+    }
+  /* A file that could not be read completely is left out.  */
+  if (nread < 0)
+    return FAILURE;
+
+  return write_record (builder, &st, builder->filter, nbits / 8);
+}
+
+/* Indexes the opened directory d with file descriptor fd and all of its
+   subdirectories.  The path of the directory relative to the indexed one
+   has length path_len in the path buffer of builder.  d is closed before
+   returning.  */
+static int
+index_dir (builder_t *builder, DIR *d, int fd, size_t path_len)
+{
+  struct dirent *entry;
+  DIR *next_d;
+  char *tmp;
+  size_t name_len, size;
+  int next_fd;
+  int kind;
+
+  while ((entry = readdir (d)) != NULL)
+    {
+      /* The index itself and its temporary copies are not indexed.  */
+      if (!strncmp (entry->d_name, INDEX_NAME, sizeof (INDEX_NAME) - 1))
+        continue;
+      kind = builder->entry_function (fd, entry);
+      if (kind == ENTRY_SKIP)
+        continue;
+
+      name_len = strlen (entry->d_name);
+      size = path_len + name_len + 2;
+      if (size > builder->path_size)
+        {
+          if (size < 2 * builder->path_size)
+            size = 2 * builder->path_size;
+          tmp = (char *) realloc (builder->path, size);
+          if (tmp == NULL)
+            {
+              rrep_error (ERR_ALLOC_PATHBUFFER, entry->d_name);
+              closedir (d);
+              return FAILURE;
+            }
+          builder->path = tmp;
+          builder->path_size = size;
+        }
+      if (path_len > 0)
+        builder->path[path_len] = '/';
+      memcpy (builder->path + path_len + (path_len > 0), entry->d_name,
+              name_len + 1);
+
+      if (kind == ENTRY_FILE)
+        {
+          if (index_file (builder, fd, entry->d_name) != SUCCESS)
+            builder->failure_flag = true;
+          continue;
+        }
+      next_d = opendirat (fd, entry->d_name, O_NOFOLLOW, &next_fd);
+      if (next_d == NULL)
+        {
+          rrep_error (ERR_PROCESS_DIR, builder->path);
+          builder->failure_flag = true;
+          continue;
+        }
+      if (index_dir (builder, next_d, next_fd,
+                     path_len + (path_len > 0) + name_len) != SUCCESS)
+        {
+          closedir (d);
+          return FAILURE;
+        }
+    }
+  closedir (d);
+
+  return SUCCESS;
+}
+
+/* Writes the index of the directory dir_name.  Directory entries are
+   classified with entry_function.  The contents of files that have the same
+   size, modification and status change time as in an existing index are not
+   read again.  The new index replaces the old one only when it is complete.  */
+int
+build_index (const char *dir_name,
+             int (*entry_function) (int, const struct dirent *))
+{
+  builder_t builder;
+  DIR *d;
+  char *out_name, *name;
+  size_t dir_len = strlen (dir_name);
+  mode_t mask;
+  int fd, out_fd;
+
+  memset (&builder, 0, sizeof (builder));
+  builder.entry_function = entry_function;
+  /* A broken old index is only reported and then rebuilt.  */
+  read_index (dir_name, &builder.old);
+
+  out_name = (char *) malloc (dir_len + sizeof (INDEX_NAME) + 8);
+  name = (char *) malloc (dir_len + sizeof (INDEX_NAME) + 1);
+  builder.seen = (unsigned char *) calloc (NTRIGRAMS / 8, 1);
+  builder.trigrams_size = 1024;
+  builder.trigrams = (uint32_t *) malloc (builder.trigrams_size
+                                          * sizeof (uint32_t));
+  builder.filter = (unsigned char *) malloc (MAX_FILTER_BITS / 8);
+  builder.block = (char *) malloc (READ_SIZE);
+  builder.path_size = 256;
+  builder.path = (char *) malloc (builder.path_size);
+  if (out_name == NULL || name == NULL || builder.seen == NULL
+      || builder.trigrams == NULL || builder.filter == NULL
+      || builder.block == NULL || builder.path == NULL)
+    {
+      rrep_error (ERR_MEMORY, dir_name);
+      builder.failure_flag = true;
+      goto cleanup;
+    }
+  sprintf (out_name, "%s/%s.XXXXXX", dir_name, INDEX_NAME);
+  sprintf (name, "%s/%s", dir_name, INDEX_NAME);
+  builder.out_name = out_name;
+  builder.path[0] = '\0';
+
+  d = opendirat (AT_FDCWD, dir_name, O_NOFOLLOW, &fd);
+  if (d == NULL)
+    {
+      rrep_error (ERR_PROCESS_DIR, dir_name);
+      builder.failure_flag = true;
+      goto cleanup;
+    }
+  out_fd = mkstemp (out_name);
+  /* The index gets the permissions of a new file rather than those of a
+     temporary one.  */
+  mask = umask (0);
+  umask (mask);
+  if (out_fd < 0 || fchmod (out_fd, 0666 & ~mask) != 0
+      || (builder.out = fdopen (out_fd, "w")) == NULL)
+    {
+      rrep_error (ERR_WRITE_INDEX, out_name);
+      if (out_fd >= 0)
+        {
+          close (out_fd);
+          unlink (out_name);
+        }
+      closedir (d);
+      builder.failure_flag = true;
+      goto cleanup;
+    }
+
+  /* The number of records is written again at the end.  */
+  if (fwrite (INDEX_MAGIC, 1, MAGIC_LEN, builder.out) != MAGIC_LEN
+      || fwrite (&builder.nrecords, sizeof (uint64_t), 1, builder.out) != 1)
+    {
+      rrep_error (ERR_WRITE_INDEX, out_name);
+      closedir (d);
+      builder.failure_flag = true;
+    }
+  else if (index_dir (&builder, d, fd, 0) != SUCCESS)
+    builder.failure_flag = true;
+  else if (fseeko (builder.out, MAGIC_LEN, SEEK_SET) != 0
+           || fwrite (&builder.nrecords, sizeof (uint64_t), 1, builder.out)
+              != 1
+           || fflush (builder.out) != 0 || fsync (fileno (builder.out)) != 0)
+    {
+      rrep_error (ERR_WRITE_INDEX, out_name);
+      builder.failure_flag = true;
+    }
+  if (fclose (builder.out) != 0 && !builder.failure_flag)
+    {
+      rrep_error (ERR_WRITE_INDEX, out_name);
+      builder.failure_flag = true;
+    }
+  /* Files that could not be read are searched as if they were new.  */
+  if (rename (out_name, name) != 0)
+    {
+      rrep_error (ERR_RENAME, name);
+      unlink (out_name);
+      builder.failure_flag = true;
+    }
+
+ cleanup:
+  free_index (builder.old);
+  free (out_name);
+  free (name);
+  free (builder.seen);
+  free (builder.trigrams);
+  free (builder.filter);
+  free (builder.block);
+  free (builder.path);
+
+  if (builder.failure_flag)
+    return FAILURE;
+
+  return SUCCESS;
+}
+
+/* Reads the index of the directory dir_name and selects the files that may
+   contain a match of pattern.  Returns NULL if the directory has no index,
+   if the index cannot be read or if pattern yields no trigrams.  */
+index_t *
+load_index (const char *dir_name, const pattern_t *pattern)
+{
+  index_t *index;
+  entry_t *entry;
+  const char *string;
+  uint32_t *trigrams;
+  size_t len, ntrigrams, nbits, pos[FILTER_HASHES];
+  size_t i, k;
+  bool icase_flag = (pattern->cflags & REG_ICASE) != 0;
+  int j;
+
+  /* Every match must contain the query string.  */
+  if (pattern->automaton != NULL)
+    return NULL;
+  if (options & OPT_FIXED)
+    {
+      string = pattern->string;
+      len = pattern->string_len;
+    }
+  else
+    {
+      string = pattern->literal;
+      len = pattern->literal_len;
+    }
+  if (string == NULL || len < 3)
+    return NULL;
+
+  trigrams = (uint32_t *) malloc ((len - 2) * sizeof (uint32_t));
+  if (trigrams == NULL)
+    return NULL;
+  ntrigrams = 0;
+  for (i = 0; i + 2 < len; i++)
+    {
+      /* Other characters than ASCII letters may not fold like in the
+         index.  */
+      if (icase_flag && ((unsigned char) string[i] >= 0x80
+                         || (unsigned char) string[i+1] >= 0x80
+                         || (unsigned char) string[i+2] >= 0x80))
+        continue;
+      trigrams[ntrigrams++] = ((uint32_t) fold (string[i]) << 16)
+                              | (fold (string[i+1]) << 8)
+                              | fold (string[i+2]);
+    }
+  if (ntrigrams == 0 || read_index (dir_name, &index) != SUCCESS
+      || index == NULL)
+    {
+      free (trigrams);
+      return NULL;
+    }
+
+  for (k = 0; k < index->nentries; k++)
+    {
+      entry = &index->entries[k];
+      nbits = 8 * entry->record->filter_len;
+      for (i = 0; i < ntrigrams && entry->candidate_flag; i++)
+        {
+          filter_bits (trigrams[i], nbits, pos);
+          for (j = 0; j < FILTER_HASHES; j++)
+            if (!(entry->filter[pos[j] >> 3] & (1 << (pos[j] & 7))))
+              entry->candidate_flag = false;
+        }
+    }
+  free (trigrams);
+
+  return index;
+}
+
+/* Returns true if the file name in the directory dir_fd with path path is
+   unchanged since it was indexed and cannot contain a match.  The path must
+   start with the path of the directory that was passed to load_index.  */
+bool
+skip_indexed (const index_t *index, int dir_fd, const char *name,
+              const char *path)
+{
+  const entry_t *entry;
+  struct stat st;
+
+  path += index->prefix_len;
+  entry = find_entry (index, path, strlen (path));
+  if (entry == NULL || entry->candidate_flag
+      || fstatat (dir_fd, name, &st, AT_SYMLINK_NOFOLLOW) < 0)
+    return false;
+
+  return unchanged_file (entry->record, &st);
+}
@@ -0,0 +1,42 @@
+/* index.h - declarations for the trigram index of rrep.
+   Copyright (C) 2026 Arno Onken <asnelt@asnelt.org>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA
+   02110-1301, USA.  */
+
+/* Name of the index file in the indexed directory.  */
+#define INDEX_NAME ".rrep-index"
+
+/* Trigram index of a directory.  */
+typedef struct index index_t;
+
+/* Writes the index of the directory dir_name.  The contents of files that
+   have the same size, modification and status change time as in an
+   existing index are not read again.  Directory entries are classified with
+   entry_function.  */
+extern int build_index (const char *, int (*) (int, const struct dirent *));
+
+/* Reads the index of the directory dir_name and selects the files that may
+   contain a match of pattern.  Returns NULL if the directory has no index,
+   if the index cannot be read or if pattern yields no trigrams.  */
+extern index_t *load_index (const char *, const pattern_t *);
+
+/* Frees the index, which may be NULL.  */
+extern void free_index (index_t *);
+
+/* Returns true if the file name in the directory dir_fd with path path is
+   unchanged since it was indexed and cannot contain a match.  The path must
+   start with the path of the directory that was passed to load_index.  */
+extern bool skip_indexed (const index_t *, int, const char *, const char *);
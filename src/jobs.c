@@ -0,0 +1,1288 @@
+/* jobs.c - worker thread pool for rrep.
+   Copyright (C) 2026 Arno Onken <asnelt@asnelt.org>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA
+   02110-1301, USA.  */
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <regex.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <time.h>
+#include "opendirat.h"
+#include "stat-time.h"
+#include "rrep.h"
+#include "messages.h"
+#include "bufferio.h"
+#include "pattern.h"
+#include "index.h"
+#include "jobs.h"
+#include "uring.h"
+#include "stats.h"
+#include "ignore.h"
+
+/* Number of unreported jobs per worker at which submitting jobs blocks.  */
+#define JOBS_PER_WORKER (64)
+/* Maximum number of file names in a single task.  */
+#define FILES_PER_TASK (32)
+/* Number of chunks per thread for balancing the rewrite of a single file.  */
+#define CHUNKS_PER_THREAD (4)
+/* Number of file descriptors that are left to the main thread and to files
+   that stay open for the whole run.  */
+#define FDS_RESERVED (16)
+/* Number of file descriptors that a worker needs for reading a directory or
+   for rewriting a single file.  */
+#define FDS_PER_WORKER (4)
+
+/* Kinds of tasks.  */
+enum
+  {
+    TASK_DIR, /* Read a directory.  */
+    TASK_FILES /* Process regular files.  */
+  };
+
+/* Data structure for a submitted job.  Its files are reported together as
+   soon as all of its tasks and all earlier jobs are finished.  */
+typedef struct job
+{
+  char **found; /* Paths of files in which PATTERN was found.  */
+  size_t nfound; /* Number of paths in found.  */
+  size_t found_size; /* Number of allocated paths in found.  */
+  bool done_flag; /* All tasks of the job are finished.  */
+  struct job *next; /* Next job in submission order.  */
+} job_t;
+
+/* Data structure for a task.  A directory task stays allocated until all
+   tasks that were created while reading the directory are finished.  */
+typedef struct task
+{
+  int kind; /* Kind of the task.  */
+  char *path; /* Path of the directory for TASK_DIR.  */
+  const char *name; /* Name of the directory in path.  */
+  int fd; /* Descriptor of the directory once it was read or -1.  */
+  char *names; /* Null terminated file names for TASK_FILES.  */
+  size_t names_len; /* Length of names.  */
+  size_t nnames; /* Number of file names.  */
+  job_t *job; /* Job the task belongs to.  */
+  struct task *parent; /* Directory task that created the task.  */
+  size_t pending; /* Number of unfinished tasks, including the task.  */
+  struct timespec times[2]; /* Directory times.  */
+  bool times_saved; /* Flag for time keeping.  */
+  ignore_t *ignore; /* Rules of ignore files above the directory or NULL.  */
+  const index_t *index; /* Index of the walked directory or NULL.  */
+} task_t;
+
+/* Data structure for a double-ended queue of tasks.  The owner takes the
+   youngest task while other workers steal the oldest one.  */
+typedef struct
+{
+  task_t **tasks; /* Circular array of tasks.  */
+  size_t size; /* Number of allocated tasks.  */
+  size_t first; /* Index of the oldest task.  */
+  size_t count; /* Number of tasks.  */
+  pthread_mutex_t lock; /* Lock for the fields of the deque.  */
+} deque_t;
+
+/* Data structure for a worker.  */
+typedef struct
+{
+  pthread_t thread; /* Thread of the worker.  */
+  size_t index; /* Index of the worker.  */
+  buffer_t buf; /* Buffers of the worker.  */
+  pattern_t pattern; /* Private copy of PATTERN.  */
+  deque_t deque; /* Tasks of the worker.  */
+  char *path; /* Buffer for file paths.  */
+  size_t path_size; /* Size of path.  */
+  uring_t *ring; /* Queue for reading files ahead or NULL.  */
+  ahead_t ahead[FILES_PER_TASK]; /* Files of a task that were read ahead.  */
+  bool failure_flag; /* Some task of the worker failed.  */
+} worker_t;
+
+/* Data structure for the parallel rewrite of a single file.  */
+typedef struct
+{
+  buffer_t *buf; /* Buffers with the mapping of the file.  */
+  FILE *in; /* The file.  */
+  const replace_t *replacement; /* Shared REPLACEMENT.  */
+  const char *file_name; /* Name of the file for messages.  */
+  chunk_function_t function; /* Function that rewrites a chunk.  */
+  off_t *bounds; /* Offsets of the chunks and of the end of the file.  */
+  FILE **segments; /* Rewritten chunks.  */
+  int *results; /* Return values of function, -1 for unfinished chunks.  */
+  size_t nchunks; /* Number of chunks.  */
+  size_t next; /* Next chunk to rewrite.  */
+  bool abort_flag; /* A chunk failed and the remaining ones are skipped.  */
+  uintmax_t matches; /* Matches counted in the finished chunks.  */
+  pthread_mutex_t lock; /* Lock for the fields above.  */
+  pthread_cond_t cond; /* Signals a finished chunk.  */
+} rewrite_t;
+
+/* Data structure for a thread of a parallel rewrite.  */
+typedef struct
+{
+  pthread_t thread; /* Thread of the worker.  */
+  buffer_t buf; /* Buffers with the mapping of the current chunk.  */
+  pattern_t *pattern; /* PATTERN of the thread.  */
+  pattern_t copy; /* Private copy of PATTERN for a helper thread.  */
+  rewrite_t *rewrite; /* Rewrite the worker takes part in.  */
+} chunk_worker_t;
+
+/* Workers of the pool.  */
+static worker_t *workers = NULL;
+/* Number of workers.  */
+static size_t nworkers = 0;
+/* Number of workers with a running thread.  */
+static size_t nthreads = 0;
+/* Function that processes a file.  */
+static job_function_t job_function = NULL;
+/* Function that classifies directory entries.  */
+static entry_function_t entry_function = NULL;
+/* Shared REPLACEMENT.  */
+static const replace_t *job_replacement = NULL;
+/* Tasks that are submitted by the main thread.  */
+static deque_t submitted;
+
+/* Oldest job that has not been reported yet.  */
+static job_t *head = NULL;
+/* Youngest job.  */
+static job_t *tail = NULL;
+/* Number of jobs that have not been reported yet.  */
+static size_t njobs_queued = 0;
+/* Number of unfinished tasks.  */
+static size_t ntasks = 0;
+/* Number of pushed tasks, used to detect new tasks while searching.  */
+static size_t npushed = 0;
+/* Number of workers that wait for a task.  */
+static size_t nidle = 0;
+/* Number of waiting workers whose share of the processors is taken by the
+   helper threads of rewrites.  */
+static size_t nlent = 0;
+/* No more jobs are submitted.  */
+static bool closing_flag = false;
+/* Some job failed.  */
+static bool jobs_failure_flag = false;
+/* Number of files that a worker opens and reads ahead at once.  */
+static size_t ahead_max = 0;
+/* Number of directory descriptors that tasks may keep open.  */
+static size_t dirs_max = 0;
+/* Number of directory descriptors that tasks keep open.  */
+static size_t ndirs = 0;
+
+/* Lock for jobs, task counts and pending counts.  */
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+/* Signals a new task or the end of all tasks.  */
+static pthread_cond_t work_cond = PTHREAD_COND_INITIALIZER;
+/* Signals that reported jobs left the queue.  */
+static pthread_cond_t space_cond = PTHREAD_COND_INITIALIZER;
+
+/* Appends task to the young end of deque.  */
+static int
+push_task (deque_t *deque, task_t *task)
+{
+  task_t **tmp;
+  size_t size, i;
+
+  /* Count the task before a thief can see it, so that finishing it never
+     lets the count drop below the running tasks.  */
+  pthread_mutex_lock (&pool_lock);
+  ntasks++;
+  npushed++;
+  pthread_mutex_unlock (&pool_lock);
+
+  pthread_mutex_lock (&deque->lock);
+  if (deque->count == deque->size)
+    {
+      /* Reallocate memory and unwrap the circular array.  */
+      size = deque->size > 0 ? 2 * deque->size : 64;
+      tmp = (task_t **) malloc (size * sizeof (task_t *));
+      if (tmp == NULL)
+        {
+          pthread_mutex_unlock (&deque->lock);
+          pthread_mutex_lock (&pool_lock);
+          ntasks--;
+          pthread_mutex_unlock (&pool_lock);
+          rrep_error (ERR_ALLOC_JOB, NULL);
+          return FAILURE;
+        }
+      for (i = 0; i < deque->count; i++)
+        tmp[i] = deque->tasks[(deque->first + i) % deque->size];
+      free (deque->tasks);
+      deque->tasks = tmp;
+      deque->size = size;
+      deque->first = 0;
+    }
+  deque->tasks[(deque->first + deque->count) % deque->size] = task;
+  deque->count++;
+  pthread_mutex_unlock (&deque->lock);
+
+  pthread_mutex_lock (&pool_lock);
+  pthread_cond_signal (&work_cond);
+  pthread_mutex_unlock (&pool_lock);
+
+  return SUCCESS;
+}
+
+/* Removes the youngest task from deque if young_flag is set or the oldest
+   task otherwise.  Returns NULL if deque is empty.  */
+static task_t *
+pop_task (deque_t *deque, bool young_flag)
+{
+  task_t *task = NULL;
+
+  pthread_mutex_lock (&deque->lock);
+  if (deque->count > 0)
+    {
+      deque->count--;
+      if (young_flag)
+        task = deque->tasks[(deque->first + deque->count) % deque->size];
+      else
+        {
+          task = deque->tasks[deque->first];
+          deque->first = (deque->first + 1) % deque->size;
+        }
+    }
+  pthread_mutex_unlock (&deque->lock);
+
+  return task;
+}
+
+/* Compares two paths for sorting.  */
+static int
+compare_paths (const void *a, const void *b)
+{
+  return strcmp (*(char * const *) a, *(char * const *) b);
+}
+
+/* Reports and frees all finished jobs at the head of the queue.  Must be
+   called with pool_lock held.  */
+static void
+report_jobs ()
+{
+  job_t *job;
+  size_t i;
+
+  while (head != NULL && head->done_flag)
+    {
+      job = head;
+      /* Tasks finish in any order, so sort the files of a job by name.  */
+      qsort (job->found, job->nfound, sizeof (char *), compare_paths);
+      for (i = 0; i < job->nfound; i++)
+        {
+          print_found (NULL, job->found[i]);
+          free (job->found[i]);
+        }
+      head = job->next;
+      if (head == NULL)
+        tail = NULL;
+      free (job->found);
+      free (job);
+      njobs_queued--;
+      pthread_cond_signal (&space_cond);
+    }
+}
+
+/* Allocates a new task of kind for job.  If parent is not NULL, the parent
+   stays allocated until the new task is finished.  */
+static task_t *
+new_task (int kind, job_t *job, task_t *parent)
+{
+  task_t *task;
+
+  task = (task_t *) calloc (1, sizeof (task_t));
+  if (task == NULL)
+    {
+      rrep_error (ERR_ALLOC_JOB, NULL);
+      return NULL;
+    }
+  task->kind = kind;
+  task->job = job;
+  task->parent = parent;
+  task->pending = 1;
+  task->fd = -1;
+  if (parent != NULL)
+    {
+      pthread_mutex_lock (&pool_lock);
+      parent->pending++;
+      pthread_mutex_unlock (&pool_lock);
+    }
+
+  return task;
+}
+
+/* Finishes task and every directory task whose last pending task was
+   finished with it.  Directory times are restored when a directory is
+   finished.  Errors are recorded in *failure_flag.  */
+static void
+finish_task (task_t *task, bool *failure_flag)
+{
+  task_t *parent;
+
+  pthread_mutex_lock (&pool_lock);
+  while (task != NULL && --task->pending == 0)
+    {
+      if (task->times_saved
+          && utimensat (AT_FDCWD, task->path, task->times, 0) != 0)
+        {
+          rrep_error (ERR_KEEP_TIMES, task->path);
+          *failure_flag = true;
+        }
+      if (task->parent == NULL)
+        {
+          /* The whole job is finished.  */
+          task->job->done_flag = true;
+          report_jobs ();
+        }
+      parent = task->parent;
+      release_ignore (task->ignore);
+      if (task->fd >= 0)
+        {
+          close (task->fd);
+          ndirs--;
+        }
+      free (task->path);
+      free (task->names);
+      free (task);
+      task = parent;
+    }
+  pthread_mutex_unlock (&pool_lock);
+}
+
+/* Appends name to the file names of task.  */
+static int
+add_name (task_t *task, const char *name)
+{
+  size_t name_len = strlen (name) + 1;
+  char *tmp;
+
+  tmp = realloc (task->names, task->names_len + name_len);
+  if (tmp == NULL)
+    {
+      rrep_error (ERR_ALLOC_JOB, name);
+      return FAILURE;
+    }
+  task->names = tmp;
+  memcpy (task->names + task->names_len, name, name_len);
+  task->names_len += name_len;
+  task->nnames++;
+
+  return SUCCESS;
+}
+
+/* Writes the path of name in the directory dir_path into the path buffer of
+   worker.  */
+static int
+set_path (worker_t *worker, const char *dir_path, const char *name)
+{
+  size_t dir_len = strlen (dir_path);
+  size_t size = dir_len + strlen (name) + 2;
+  char *tmp;
+
+  if (size > worker->path_size)
+    {
+      /* Reallocate memory.  */
+      tmp = realloc (worker->path, size);
+      if (tmp == NULL)
+        {
+          rrep_error (ERR_ALLOC_PATHBUFFER, name);
+          return FAILURE;
+        }
+      worker->path = tmp;
+      worker->path_size = size;
+    }
+  strcpy (worker->path, dir_path);
+  if (dir_len == 0 || dir_path[dir_len-1] != '/')
+    strcat (worker->path, "/");
+  strcat (worker->path, name);
+
+  return SUCCESS;
+}
+
+/* Reads the directory of task and pushes tasks for its files and
+   subdirectories.  */
+static void
+run_dir_task (worker_t *worker, task_t *task)
+{
+  DIR *d; /* Directory of the task.  */
+  int fd; /* File descriptor of d.  */
+  struct dirent *entry; /* Directory entry.  */
+  struct stat st; /* The stat for obtaining directory times.  */
+  task_t *files = NULL; /* Task for the next files.  */
+  task_t *sub; /* Task for a subdirectory.  */
+  ignore_t *ignore = NULL; /* Rules of ignore files for the entries.  */
+  int kind; /* Kind of an entry.  */
+
+  /* Subdirectories are opened relative to their parent, so the path is not
+     looked up again and cannot lead elsewhere after a rename.  */
+  if (task->parent != NULL && task->parent->fd >= 0)
+    d = opendirat (task->parent->fd, task->name, O_NOFOLLOW, &fd);
+  else
+    d = opendirat (AT_FDCWD, task->path, O_NOFOLLOW, &fd);
+  if (d == NULL)
+    {
+      rrep_error (ERR_PROCESS_DIR, task->path);
+      worker->failure_flag = true;
+      return;
+    }
+  /* Keep the directory open for the tasks of its entries while the share of
+     descriptors for directories lasts.  Without a descriptor, they fall back
+     to the path.  */
+  pthread_mutex_lock (&pool_lock);
+  if (ndirs < dirs_max)
+    {
+      task->fd = fcntl (fd, F_DUPFD_CLOEXEC, 0);
+      if (task->fd >= 0)
+        ndirs++;
+    }
+  pthread_mutex_unlock (&pool_lock);
+  if (options & OPT_GITIGNORE
+      && load_ignore (fd, task->path, task->ignore, &ignore) != SUCCESS)
+    worker->failure_flag = true;
+
+  while ((entry = readdir (d)))
+    {
+      kind = entry_function (fd, entry);
+      if (kind != ENTRY_SKIP
+          && (options & OPT_GITIGNORE
+              || (kind == ENTRY_FILE && task->index != NULL)))
+        {
+          /* Ignored directories are not even opened.  */
+          if (set_path (worker, task->path, entry->d_name) != SUCCESS)
+            {
+              worker->failure_flag = true;
+              break;
+            }
+          if (options & OPT_GITIGNORE
+              && ignored_path (ignore, worker->path, kind == ENTRY_DIR))
+            {
+              if (kind == ENTRY_FILE)
+                count_stat (STAT_FILES_IGNORED, 1);
+              continue;
+            }
+          if (kind == ENTRY_FILE && task->index != NULL
+              && skip_indexed (task->index, fd, entry->d_name, worker->path))
+            {
+              count_stat (STAT_FILES_INDEXED, 1);
+              continue;
+            }
+        }
+      switch (kind)
+        {
+        case ENTRY_FILE:
+          if (files == NULL)
+            {
+              files = new_task (TASK_FILES, task->job, task);
+              if (files == NULL)
+                break;
+            }
+          if (add_name (files, entry->d_name) != SUCCESS)
+            break;
+          if (files->nnames == FILES_PER_TASK)
+            {
+              if (push_task (&worker->deque, files) != SUCCESS)
+                break;
+              files = NULL;
+            }
+          continue;
+
+        case ENTRY_DIR:
+          sub = new_task (TASK_DIR, task->job, task);
+          if (sub == NULL)
+            break;
+          if (set_path (worker, task->path, entry->d_name) != SUCCESS)
+            {
+              finish_task (sub, &worker->failure_flag);
+              break;
+            }
+          sub->path = strdup (worker->path);
+          if (sub->path == NULL)
+            {
+              rrep_error (ERR_ALLOC_JOB, worker->path);
+              finish_task (sub, &worker->failure_flag);
+              break;
+            }
+          sub->name = sub->path + strlen (sub->path) - strlen (entry->d_name);
+          sub->ignore = hold_ignore (ignore);
+          sub->index = task->index;
+          if (options & OPT_KEEP_TIMES)
+            {
+              /* Obtain directory times.  */
+              if (fstatat (fd, entry->d_name, &st, AT_SYMLINK_NOFOLLOW) < 0)
+                {
+                  rrep_error (ERR_KEEP_TIMES, sub->path);
+                  worker->failure_flag = true;
+                }
+              else
+                {
+                  sub->times[0] = get_stat_atime (&st);
+                  sub->times[1] = get_stat_mtime (&st);
+                  sub->times_saved = true;
+                }
+            }
+          if (push_task (&worker->deque, sub) != SUCCESS)
+            {
+              finish_task (sub, &worker->failure_flag);
+              break;
+            }
+          continue;
+
+        default:
+          continue;
+        }
+      /* Only errors break out of the switch.  */
+      worker->failure_flag = true;
+      break;
+    }
+  if (files != NULL && push_task (&worker->deque, files) != SUCCESS)
+    {
+      worker->failure_flag = true;
+      finish_task (files, &worker->failure_flag);
+    }
+  release_ignore (ignore);
+  closedir (d);
+}
+
+/* Closes the n files at ahead that were opened ahead but never
+   processed.  */
+static void
+close_ahead (ahead_t *ahead, size_t n)
+{
+  size_t i;
+
+  for (i = 0; i < n; i++)
+    if (ahead[i].fd >= 0)
+      {
+        close (ahead[i].fd);
+        ahead[i].fd = -1;
+      }
+}
+
+/* Processes the files of task and records those in which PATTERN was
+   found.  */
+static void
+run_files_task (worker_t *worker, task_t *task)
+{
+  const char *name; /* Next file name.  */
+  const char *path; /* Path of the file for messages.  */
+  char *found; /* Copy of path.  */
+  char **tmp;
+  int dir_fd = AT_FDCWD; /* Directory of the files.  */
+  bool close_flag = false; /* Flag for a descriptor opened for the task.  */
+  size_t i;
+  size_t first = 0; /* Index of the first file that was read ahead.  */
+  size_t nahead = 0; /* Number of files that were read ahead.  */
+  bool replaced_flag; /* Flag for replaced pattern.  */
+
+  if (task->parent != NULL)
+    {
+      /* Files of a directory task are opened relative to the directory,
+         which the directory task keeps open if it can.  */
+      dir_fd = task->parent->fd;
+      if (dir_fd < 0)
+        {
+          dir_fd = open (task->parent->path, O_RDONLY | O_DIRECTORY);
+          if (dir_fd < 0)
+            {
+              rrep_error (ERR_PROCESS_DIR, task->parent->path);
+              worker->failure_flag = true;
+              return;
+            }
+          close_flag = true;
+        }
+    }
+
+  name = task->names;
+  for (i = 0; i < task->nnames; i++, name += strlen (name) + 1)
+    {
+      if (i == first + nahead && worker->ring != NULL && ahead_max > 0)
+        {
+          /* Let the kernel open and read the next files at once, as many
+             as the share of descriptors of the worker allows.  */
+          close_ahead (worker->ahead, nahead);
+          first = i;
+          nahead = task->nnames - i;
+          if (nahead > ahead_max)
+            nahead = ahead_max;
+          read_ahead (worker->ring, dir_fd, name, nahead, worker->ahead);
+        }
+      path = name;
+      if (task->parent != NULL)
+        {
+          if (set_path (worker, task->parent->path, name) != SUCCESS)
+            {
+              worker->failure_flag = true;
+              continue;
+            }
+          path = worker->path;
+        }
+      if (i < first + nahead)
+        {
+          /* Hand the file that was read ahead to job_function.  The later
+             files are closed if it runs out of descriptors.  */
+          worker->buf.ahead_fd = worker->ahead[i - first].fd;
+          worker->ahead[i - first].fd = -1;
+          if (worker->ahead[i - first].len > 0)
+            {
+              worker->buf.ahead_data = worker->ahead[i - first].data;
+              worker->buf.ahead_len = worker->ahead[i - first].len;
+            }
+          worker->buf.held = worker->ahead + (i - first) + 1;
+          worker->buf.nheld = first + nahead - i - 1;
+        }
+      if (job_function (&worker->buf, dir_fd, name, path, &worker->pattern,
+                        job_replacement, &replaced_flag) != SUCCESS)
+        worker->failure_flag = true;
+      /* job_function may skip a file without opening it, for example by
+         the no-match cache.  Its descriptor and contents must not be taken
+         for the next file.  */
+      if (worker->buf.ahead_fd >= 0)
+        close (worker->buf.ahead_fd);
+      worker->buf.ahead_fd = -1;
+      worker->buf.ahead_data = NULL;
+      worker->buf.ahead_len = 0;
+      worker->buf.held = NULL;
+      worker->buf.nheld = 0;
+      if (!replaced_flag || options & OPT_QUIET)
+        continue;
+
+      /* Record the file for the report.  */
+      found = strdup (path);
+      pthread_mutex_lock (&pool_lock);
+      if (found != NULL && task->job->nfound == task->job->found_size)
+        {
+          tmp = realloc (task->job->found, (2 * task->job->found_size + 16)
+                                           * sizeof (char *));
+          if (tmp == NULL)
+            {
+              free (found);
+              found = NULL;
+            }
+          else
+            {
+              task->job->found = tmp;
+              task->job->found_size = 2 * task->job->found_size + 16;
+            }
+        }
+      if (found != NULL)
+        task->job->found[task->job->nfound++] = found;
+      pthread_mutex_unlock (&pool_lock);
+      if (found == NULL)
+        {
+          rrep_error (ERR_ALLOC_JOB, path);
+          worker->failure_flag = true;
+        }
+    }
+
+  close_ahead (worker->ahead, nahead);
+  if (close_flag)
+    close (dir_fd);
+}
+
+/* Returns the next task for worker or NULL if all tasks are finished.  The
+   worker takes its own youngest task first and otherwise steals the oldest
+   task of another worker.  */
+static task_t *
+get_task (worker_t *worker)
+{
+  task_t *task;
+  size_t generation; /* Value of npushed before searching.  */
+  size_t i;
+
+  while (true)
+    {
+      pthread_mutex_lock (&pool_lock);
+      generation = npushed;
+      if (ntasks == 0 && closing_flag)
+        {
+          pthread_mutex_unlock (&pool_lock);
+          return NULL;
+        }
+      pthread_mutex_unlock (&pool_lock);
+
+      task = pop_task (&worker->deque, true);
+      if (task == NULL)
+        task = pop_task (&submitted, false);
+      for (i = 1; task == NULL && i < nworkers; i++)
+        task = pop_task (&workers[(worker->index + i) % nworkers].deque,
+                         false);
+      if (task != NULL)
+        return task;
+
+      /* Sleep until a new task is pushed or all tasks are finished.  */
+      pthread_mutex_lock (&pool_lock);
+      nidle++;
+      while (npushed == generation && !(ntasks == 0 && closing_flag))
+        pthread_cond_wait (&work_cond, &pool_lock);
+      nidle--;
+      pthread_mutex_unlock (&pool_lock);
+    }
+}
+
+/* Runs tasks until all tasks are finished.  */
+static void *
+run_worker (void *arg)
+{
+  worker_t *worker = (worker_t *) arg;
+  task_t *task;
+
+  start_stats ();
+  while ((task = get_task (worker)) != NULL)
+    {
+      switch_phase (PHASE_TRAVERSAL);
+      if (task->kind == TASK_DIR)
+        run_dir_task (worker, task);
+      else
+        run_files_task (worker, task);
+      finish_task (task, &worker->failure_flag);
+
+      pthread_mutex_lock (&pool_lock);
+      ntasks--;
+      if (ntasks == 0 && closing_flag)
+        pthread_cond_broadcast (&work_cond);
+      pthread_mutex_unlock (&pool_lock);
+      /* Waiting for the next task is not part of any phase.  */
+      switch_phase (PHASE_NONE);
+    }
+
+  return NULL;
+}
+
+/* Appends a new job with a root task of kind to the queue.  Returns the root
+   task or NULL on failure.  */
+static task_t *
+new_job (int kind)
+{
+  job_t *job;
+  task_t *task;
+
+  job = (job_t *) calloc (1, sizeof (job_t));
+  if (job == NULL)
+    {
+      rrep_error (ERR_ALLOC_JOB, NULL);
+      return NULL;
+    }
+  task = new_task (kind, job, NULL);
+  if (task == NULL)
+    {
+      free (job);
+      return NULL;
+    }
+
+  pthread_mutex_lock (&pool_lock);
+  /* Bound the memory for jobs if the main thread is faster than the
+     workers.  */
+  while (njobs_queued >= JOBS_PER_WORKER * nthreads)
+    pthread_cond_wait (&space_cond, &pool_lock);
+  njobs_queued++;
+  if (tail == NULL)
+    head = job;
+  else
+    tail->next = job;
+  tail = job;
+  pthread_mutex_unlock (&pool_lock);
+
+  return task;
+}
+
+/* Frees the workers of the pool.  */
+static void
+free_workers ()
+{
+  size_t i, j;
+
+  for (i = 0; i < nworkers; i++)
+    {
+      free_buffer (&workers[i].buf);
+      free_pattern (&workers[i].pattern);
+      free_uring (workers[i].ring);
+      for (j = 0; j < FILES_PER_TASK; j++)
+        free (workers[i].ahead[j].data);
+      free (workers[i].deque.tasks);
+      pthread_mutex_destroy (&workers[i].deque.lock);
+      free (workers[i].path);
+    }
+  free (workers);
+  workers = NULL;
+  nworkers = 0;
+  free (submitted.tasks);
+  submitted.tasks = NULL;
+  submitted.size = 0;
+}
+
+/* Starts a pool of njobs workers that walk queued directories with
+   entry_function and process files with job_function.  Each worker compiles
+   its own copy of pattern.  There are fewer workers if the limit of file
+   descriptors does not suffice for njobs.  */
+int
+init_jobs (size_t njobs, job_function_t function, entry_function_t entry,
+           const pattern_t *pattern, const replace_t *replacement)
+{
+  struct rlimit limit; /* Limit of file descriptors.  */
+  size_t nfds = 0; /* Number of descriptors that are left for sharing.  */
+  size_t i;
+  int err;
+
+  /* Each worker needs its own descriptors.  */
+  if (getrlimit (RLIMIT_NOFILE, &limit) != 0)
+    limit.rlim_cur = RLIM_INFINITY;
+  if (limit.rlim_cur < FDS_RESERVED + FDS_PER_WORKER * (rlim_t) njobs)
+    njobs = limit.rlim_cur > FDS_RESERVED + FDS_PER_WORKER
+            ? (limit.rlim_cur - FDS_RESERVED) / FDS_PER_WORKER : 1;
+  workers = (worker_t *) calloc (njobs, sizeof (worker_t));
+  if (workers == NULL)
+    {
+      rrep_error (ERR_ALLOC_JOB, NULL);
+      return FAILURE;
+    }
+  /* Half of the descriptors beyond those that the workers need anyway keep
+     directories open and each worker gets a share of the other half for
+     reading files ahead.  */
+  if (limit.rlim_cur > FDS_RESERVED + FDS_PER_WORKER * (rlim_t) njobs)
+    {
+      limit.rlim_cur -= FDS_RESERVED + FDS_PER_WORKER * (rlim_t) njobs;
+      nfds = limit.rlim_cur < SIZE_MAX ? limit.rlim_cur : SIZE_MAX;
+    }
+  dirs_max = nfds / 2;
+  ndirs = 0;
+  ahead_max = nfds / 2 / njobs;
+  if (ahead_max > FILES_PER_TASK)
+    ahead_max = FILES_PER_TASK;
+  for (i = 0; i < njobs; i++)
+    {
+      nworkers++;
+      workers[i].index = i;
+      pthread_mutex_init (&workers[i].deque.lock, NULL);
+      /* A private copy avoids contention on the lock inside regexec.  */
+      if (init_buffer (&workers[i].buf) != SUCCESS
+          || copy_pattern (pattern, &workers[i].pattern) != SUCCESS)
+        {
+          free_workers ();
+          return FAILURE;
+        }
+      /* Each file that is read ahead needs up to two requests at once.  */
+      if (ahead_max > 0)
+        workers[i].ring = new_uring (2 * ahead_max);
+    }
+  pthread_mutex_init (&submitted.lock, NULL);
+  job_function = function;
+  entry_function = entry;
+  job_replacement = replacement;
+  closing_flag = false;
+  jobs_failure_flag = false;
+
+  for (i = 0; i < nworkers; i++)
+    {
+      err = pthread_create (&workers[i].thread, NULL, run_worker, &workers[i]);
+      if (err != 0)
+        {
+          errno = err;
+          rrep_error (ERR_CREATE_THREAD, NULL);
+          break;
+        }
+      nthreads++;
+    }
+  if (nthreads == 0)
+    {
+      free_workers ();
+      return FAILURE;
+    }
+
+  return SUCCESS;
+}
+
+/* Queues the regular file file_name for processing by the workers.  */
+int
+submit_file_job (const char *file_name)
+{
+  task_t *task;
+
+  task = new_job (TASK_FILES);
+  if (task == NULL)
+    return FAILURE;
+  if (add_name (task, file_name) != SUCCESS
+      || push_task (&submitted, task) != SUCCESS)
+    {
+      finish_task (task, &jobs_failure_flag);
+      return FAILURE;
+    }
+
+  return SUCCESS;
+}
+
+/* Queues the directory dir_name for a parallel walk by the workers.  If times
+   is not NULL, the directory times are restored as soon as all files and
+   subdirectories in the directory are finished.  Unless index is NULL, files
+   that it rules out are skipped.  The index must stay valid until the jobs
+   are finished.  */
+int
+submit_dir_job (const char *dir_name, const struct timespec *times,
+                const index_t *index)
+{
+  task_t *task;
+
+  task = new_job (TASK_DIR);
+  if (task == NULL)
+    return FAILURE;
+  task->path = strdup (dir_name);
+  if (task->path == NULL)
+    {
+      rrep_error (ERR_ALLOC_JOB, dir_name);
+      finish_task (task, &jobs_failure_flag);
+      return FAILURE;
+    }
+  task->name = task->path;
+  if (times != NULL)
+    {
+      task->times[0] = times[0];
+      task->times[1] = times[1];
+      task->times_saved = true;
+    }
+  task->index = index;
+  if (push_task (&submitted, task) != SUCCESS)
+    {
+      finish_task (task, &jobs_failure_flag);
+      return FAILURE;
+    }
+
+  return SUCCESS;
+}
+
+/* Waits until all queued jobs are processed, reports the results and frees
+   the pool.  Files are reported in the order of the queued jobs and, within a
+   directory job, sorted by name.  */
+int
+finish_jobs ()
+{
+  size_t i;
+
+  pthread_mutex_lock (&pool_lock);
+  closing_flag = true;
+  pthread_cond_broadcast (&work_cond);
+  pthread_mutex_unlock (&pool_lock);
+  for (i = 0; i < nthreads; i++)
+    {
+      pthread_join (workers[i].thread, NULL);
+      jobs_failure_flag |= workers[i].failure_flag;
+    }
+  nthreads = 0;
+  free_workers ();
+
+  if (jobs_failure_flag)
+    return FAILURE;
+
+  return SUCCESS;
+}
+
+/* Rewrites chunk i of the rewrite of worker into a temporary segment and
+   stores the segment and the result.  */
+static void
+rewrite_chunk (chunk_worker_t *worker, size_t i)
+{
+  rewrite_t *rewrite = worker->rewrite;
+  FILE *segment; /* Rewritten chunk.  */
+  int rr; /* Return value of the rewrite function.  */
+
+  segment = tmpfile ();
+  if (segment == NULL)
+    {
+      rrep_error (ERR_CREATE_TEMP, rewrite->file_name);
+      rr = FAILURE;
+    }
+  else
+    {
+      map_chunk (&worker->buf, rewrite->buf, rewrite->bounds[i],
+                 rewrite->bounds[i+1] - rewrite->bounds[i]);
+      rr = rewrite->function (&worker->buf, rewrite->in, segment,
+                              worker->pattern, rewrite->replacement,
+                              rewrite->file_name, NULL, 0,
+                              rewrite->bounds[i], true, NULL);
+      if (rr == SUCCESS && fflush (segment) != 0)
+        {
+          rrep_error (ERR_WRITE_TEMP, rewrite->file_name);
+          rr = FAILURE;
+        }
+    }
+
+  pthread_mutex_lock (&rewrite->lock);
+  rewrite->segments[i] = segment;
+  rewrite->results[i] = rr;
+  if (rr != SUCCESS)
+    rewrite->abort_flag = true;
+  pthread_cond_broadcast (&rewrite->cond);
+  pthread_mutex_unlock (&rewrite->lock);
+}
+
+/* Rewrites chunks of the rewrite of the helper thread worker until all
+   chunks are taken or a chunk failed.  */
+static void *
+run_chunk_worker (void *arg)
+{
+  chunk_worker_t *worker = (chunk_worker_t *) arg;
+  rewrite_t *rewrite = worker->rewrite;
+  size_t i;
+
+  start_stats ();
+  switch_phase (PHASE_REWRITE);
+  for (;;)
+    {
+      pthread_mutex_lock (&rewrite->lock);
+      if (rewrite->abort_flag || rewrite->next == rewrite->nchunks)
+        {
+          /* The matches belong to the file, which the caller counts.  */
+          rewrite->matches += take_stat (STAT_MATCHES);
+          pthread_mutex_unlock (&rewrite->lock);
+          switch_phase (PHASE_NONE);
+          return NULL;
+        }
+      i = rewrite->next++;
+      pthread_mutex_unlock (&rewrite->lock);
+
+      rewrite_chunk (worker, i);
+    }
+}
+
+/* Appends the flushed temporary file segment to out.  */
+static int
+append_segment (FILE *segment, FILE *out, const char *file_name)
+{
+  char chunk[BUFSIZ];
+  off_t offset, end;
+  ssize_t nc; /* Number of characters copied or read.  */
+
+  end = ftello (segment);
+  if (end < 0 || fflush (out) != 0)
+    {
+      rrep_error (ERR_WRITE_TEMP, file_name);
+      return FAILURE;
+    }
+  /* Copy inside the kernel where the files allow it.  */
+  offset = 0;
+  while (offset < end
+         && copy_file_range (fileno (segment), &offset, fileno (out), NULL,
+                             end-offset, 0) > 0)
+    ;
+  while (offset < end)
+    {
+      nc = pread (fileno (segment), chunk, end-offset < BUFSIZ ? end-offset
+                  : BUFSIZ, offset);
+      if (nc <= 0)
+        {
+          rrep_error (ERR_READ_TEMP, file_name);
+          return FAILURE;
+        }
+      if (fwrite (chunk, sizeof (char), nc, out) != (size_t) nc)
+        {
+          rrep_error (ERR_WRITE_TEMP, file_name);
+          return FAILURE;
+        }
+      offset += nc;
+    }
+
+  return SUCCESS;
+}
+
+/* Splits the mapped file in buf from the file offset offset on into chunks
+   of at least chunk_len characters that end at line boundaries.  The offsets
+   of the chunks and of the end of the file are stored in bounds.  Returns the
+   number of chunks.  */
+static size_t
+split_chunks (const buffer_t *buf, off_t offset, size_t chunk_len,
+              off_t *bounds)
+{
+  const char *end;
+  off_t file_end;
+  size_t n = 0;
+
+  file_end = buf->map_offset + buf->map_size;
+  bounds[0] = offset;
+  while (bounds[n] < file_end)
+    {
+      if ((size_t) (file_end - bounds[n]) <= chunk_len)
+        bounds[n+1] = file_end;
+      else
+        {
+          end = memchr (buf->map + (bounds[n] + chunk_len - buf->map_offset),
+                        '\n', file_end - bounds[n] - chunk_len);
+          bounds[n+1] = end == NULL ? file_end
+            : end - buf->map + buf->map_offset + 1;
+        }
+      n++;
+    }
+
+  return n;
+}
+
+/* Copies the mapped file in of buf from the file offset offset on to out and
+   replaces pattern by replacement.  The rest of the file is split into chunks
+   at line boundaries.  The calling worker and up to njobs - 1 helper threads
+   rewrite the chunks with function into temporary segments, which are
+   appended to out in order.  Helper threads are only started for workers of
+   the pool that wait for a task, so that the threads do not outnumber the
+   jobs.  Returns SUCCESS, FAILURE or BINARY_FOUND like function.  */
+int
+replace_chunks (buffer_t *buf, FILE *in, FILE *out, pattern_t *pattern,
+                const replace_t *replacement, const char *file_name,
+                off_t offset, size_t njobs, chunk_function_t function)
+{
+  rewrite_t rewrite;
+  chunk_worker_t *chunk_workers;
+  size_t len; /* Length of the rest of the file.  */
+  size_t chunk_len; /* Minimum length of a chunk.  */
+  size_t nhelpers; /* Number of reserved helper threads.  */
+  size_t ninit, nstarted, i, j;
+  int rr, err;
+
+  len = buf->map_offset + buf->map_size - offset;
+  chunk_len = len / (njobs * CHUNKS_PER_THREAD);
+  if (chunk_len < CHUNK_SIZE)
+    chunk_len = CHUNK_SIZE;
+  /* Every chunk but the last one has at least chunk_len characters.  */
+  rewrite.nchunks = len / chunk_len + 1;
+  rewrite.bounds = (off_t *) malloc ((rewrite.nchunks + 1) * sizeof (off_t));
+  rewrite.segments = (FILE **) calloc (rewrite.nchunks, sizeof (FILE *));
+  rewrite.results = (int *) malloc (rewrite.nchunks * sizeof (int));
+  chunk_workers = (chunk_worker_t *) calloc (njobs, sizeof (chunk_worker_t));
+  if (rewrite.bounds == NULL || rewrite.segments == NULL
+      || rewrite.results == NULL || chunk_workers == NULL)
+    {
+      rrep_error (ERR_ALLOC_JOB, file_name);
+      free (rewrite.bounds);
+      free (rewrite.segments);
+      free (rewrite.results);
+      free (chunk_workers);
+      return FAILURE;
+    }
+  rewrite.nchunks = split_chunks (buf, offset, chunk_len, rewrite.bounds);
+  for (i = 0; i < rewrite.nchunks; i++)
+    rewrite.results[i] = -1;
+  rewrite.buf = buf;
+  rewrite.in = in;
+  rewrite.replacement = replacement;
+  rewrite.file_name = file_name;
+  rewrite.function = function;
+  rewrite.next = 0;
+  rewrite.abort_flag = false;
+  rewrite.matches = 0;
+  pthread_mutex_init (&rewrite.lock, NULL);
+  pthread_cond_init (&rewrite.cond, NULL);
+
+  /* The calling worker is busy anyway.  Other workers that wait for a task
+     leave their share of the processors to helper threads.  */
+  pthread_mutex_lock (&pool_lock);
+  nhelpers = nidle > nlent ? nidle - nlent : 0;
+  if (nhelpers > njobs - 1)
+    nhelpers = njobs - 1;
+  if (nhelpers > rewrite.nchunks - 1)
+    nhelpers = rewrite.nchunks - 1;
+  nlent += nhelpers;
+  pthread_mutex_unlock (&pool_lock);
+
+  /* Each thread needs its own automaton states and match registers.  The
+     calling worker uses its own pattern.  */
+  chunk_workers[0].pattern = pattern;
+  ninit = 0;
+  rr = SUCCESS;
+  for (i = 0; i <= nhelpers; i++)
+    {
+      chunk_workers[i].rewrite = &rewrite;
+      if (i > 0)
+        chunk_workers[i].pattern = &chunk_workers[i].copy;
+      if (init_buffer (&chunk_workers[i].buf) != SUCCESS
+          || (i > 0 && copy_pattern (pattern, &chunk_workers[i].copy)
+              != SUCCESS))
+        {
+          ninit = i + 1;
+          rr = FAILURE;
+          break;
+        }
+      ninit++;
+    }
+  nstarted = 0;
+  for (i = 1; rr == SUCCESS && i <= nhelpers; i++)
+    {
+      err = pthread_create (&chunk_workers[i].thread, NULL, run_chunk_worker,
+                            &chunk_workers[i]);
+      if (err != 0)
+        {
+          /* The calling worker rewrites the remaining chunks.  */
+          errno = err;
+          rrep_error (ERR_CREATE_THREAD, NULL);
+          break;
+        }
+      nstarted++;
+    }
+
+  /* Append the segments in order as soon as they are finished.  While a
+     segment is missing, the calling worker rewrites the next chunk.  */
+  for (i = 0; rr == SUCCESS && i < rewrite.nchunks; i++)
+    {
+      pthread_mutex_lock (&rewrite.lock);
+      while (rewrite.results[i] < 0)
+        {
+          if (rewrite.abort_flag || rewrite.next == rewrite.nchunks)
+            {
+              pthread_cond_wait (&rewrite.cond, &rewrite.lock);
+              continue;
+            }
+          j = rewrite.next++;
+          pthread_mutex_unlock (&rewrite.lock);
+          rewrite_chunk (&chunk_workers[0], j);
+          pthread_mutex_lock (&rewrite.lock);
+        }
+      rr = rewrite.results[i];
+      pthread_mutex_unlock (&rewrite.lock);
+      if (rr == SUCCESS)
+        rr = append_segment (rewrite.segments[i], out, file_name);
+    }
+  if (rr != SUCCESS)
+    {
+      pthread_mutex_lock (&rewrite.lock);
+      rewrite.abort_flag = true;
+      pthread_mutex_unlock (&rewrite.lock);
+    }
+
+  for (i = 1; i <= nstarted; i++)
+    pthread_join (chunk_workers[i].thread, NULL);
+  pthread_mutex_lock (&pool_lock);
+  nlent -= nhelpers;
+  pthread_mutex_unlock (&pool_lock);
+  count_stat (STAT_MATCHES, rewrite.matches);
+  for (i = 0; i < rewrite.nchunks; i++)
+    if (rewrite.segments[i] != NULL)
+      fclose (rewrite.segments[i]);
+  for (i = 0; i < ninit; i++)
+    {
+      free_buffer (&chunk_workers[i].buf);
+      if (i > 0)
+        free_pattern (&chunk_workers[i].copy);
+    }
+  pthread_mutex_destroy (&rewrite.lock);
+  pthread_cond_destroy (&rewrite.cond);
+  free (rewrite.bounds);
+  free (rewrite.segments);
+  free (rewrite.results);
+  free (chunk_workers);
+
+  return rr;
+}
@@ -0,0 +1,70 @@
+/* jobs.h - declarations for the worker thread pool of rrep.
+   Copyright (C) 2026 Arno Onken <asnelt@asnelt.org>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA
+   02110-1301, USA.  */
+
+/* Minimum length of the chunks of a file that is rewritten in parallel.  */
+#define CHUNK_SIZE (16*1024*1024)
+
+/* Function that processes the regular file file_name relative to a directory
+   file descriptor with the buffers of a worker.  The second name is used for
+   messages.  The last argument is set to true if PATTERN was found.  */
+typedef int (*job_function_t) (buffer_t *, int, const char *, const char *,
+                               pattern_t *, const replace_t *, bool *);
+
+/* Function that copies the lines of the first file to the second one and
+   replaces PATTERN by REPLACEMENT, like replace_string.  */
+typedef int (*chunk_function_t) (buffer_t *, FILE *, FILE *, pattern_t *,
+                                 const replace_t *, const char *, char *,
+                                 size_t, off_t, bool, size_t *);
+
+/* Function that classifies an entry of the directory with the given file
+   descriptor as ENTRY_FILE, ENTRY_DIR or ENTRY_SKIP.  */
+typedef int (*entry_function_t) (int, const struct dirent *);
+
+/* Starts a pool of njobs workers that walk queued directories with
+   entry_function and process files with job_function.  Each worker compiles
+   its own copy of pattern.  There are fewer workers if the limit of file
+   descriptors does not suffice for njobs.  */
+extern int init_jobs (size_t, job_function_t, entry_function_t,
+                      const pattern_t *, const replace_t *);
+
+/* Queues the regular file file_name for processing by the workers.  */
+extern int submit_file_job (const char *);
+
+/* Queues the directory dir_name for a parallel walk by the workers.  If times
+   is not NULL, the directory times are restored as soon as all files and
+   subdirectories in the directory are finished.  Unless index is NULL, files
+   that it rules out are skipped.  The index must stay valid until the jobs
+   are finished.  */
+extern int submit_dir_job (const char *, const struct timespec *,
+                           const index_t *);
+
+/* Waits until all queued jobs are processed, reports the results and frees
+   the pool.  Files are reported in the order of the queued jobs and, within a
+   directory job, sorted by name.  */
+extern int finish_jobs (void);
+
+/* Copies the mapped file in of buf from the file offset offset on to out and
+   replaces pattern by replacement.  The rest of the file is split into chunks
+   at line boundaries.  The calling worker and up to njobs - 1 helper threads
+   rewrite the chunks with function into temporary segments, which are
+   appended to out in order.  Helper threads are only started for workers of
+   the pool that wait for a task.  Returns SUCCESS, FAILURE or BINARY_FOUND
+   like function.  */
+extern int replace_chunks (buffer_t *, FILE *, FILE *, pattern_t *,
+                           const replace_t *, const char *, off_t, size_t,
+                           chunk_function_t);
@@ -20,6 +20,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <string.h>
 #include <errno.h>
 #include <regex.h>
 #include "gettext.h"
@@ -82,19 +83,36 @@ Options:\n\
   -S, --suffix=SUFFIX            override default backup suffix\n\
   -V, --version                  print version information and exit\n\
   -a, --all                      do not ignore files starting with .\n\
+      --atomic                   write a temporary copy and rename it over\
+ each file\n\
   -b                             backup before overwriting files\n\
       --backup[=CONTROL]         like -b but accepts a version control\
  argument\n\
       --binary                   do not ignore binary files\n\
+      --buffer-limit=SIZE        keep buffers up to SIZE KiB between files\n\
+      --build-index=DIR          write a trigram index of DIR and exit\n\
+      --dfa-cache=SIZE           limit the DFA state cache to SIZE KiB\n\
       --dry-run                  simulation mode\n\
   -e, --regex=PATTERN            use PATTERN for matching\n\
+      --files0-from=FILE         read null terminated file names from FILE\n\
+      --fsync                    synchronize modified files to disk\n\
+      --gitignore                skip files that .gitignore or .ignore\
+ exclude\n\
   -h, --help                     display this help and exit\n\
   -i, --ignore-case              ignore case distinctions\n\
+  -j, --jobs=N                   process up to N files in parallel\n\
       --keep-times               keep access and modification times\n\
   -p, --replace-with=REPLACEMENT use REPLACEMENT for substitution\n\
+      --pairs-file=FILE          read fixed PATTERN and REPLACEMENT pairs from\
+ FILE\n\
       --interactive              prompt before modifying a file\n\
   -q, --quiet, --silent          suppress all normal messages\n\
   -s, --no-messages              suppress error messages\n\
+      --no-match-cache=FILE      skip unchanged files that did not match in\
+ runs with FILE\n\
+      --stats[=FORMAT]           report statistics as text or json\n\
+      --use-index                skip files that the index of a directory\
+ rules out\n\
   -w, --word-regexp              force PATTERN to match only whole words\n\
   -x, --line-regexp              force PATTERN to match only whole lines\n"));
   printf ("\n");
@@ -147,15 +165,50 @@ rrep_error (const int errcode, const char *file_name)
       fprintf (stderr, _("%s: PATTERN must have at least one character\n"),
                program_name);
       break;
+    case ERR_JOBS:
+      fprintf (stderr, _("%s: %s: invalid number of jobs\n"),
+               program_name, file_name);
+      break;
+    case ERR_BUFFER_LIMIT:
+      fprintf (stderr, _("%s: %s: invalid buffer limit\n"),
+               program_name, file_name);
+      break;
+    case ERR_DFA_CACHE:
+      fprintf (stderr, _("%s: %s: invalid DFA cache size\n"),
+               program_name, file_name);
+      break;
+    case ERR_STATS_FORMAT:
+      fprintf (stderr, _("%s: %s: invalid statistics format\n"),
+               program_name, file_name);
+      break;
+    case ERR_INDEX_FORMAT:
+      fprintf (stderr, _("%s: %s: invalid index\n"),
+               program_name, file_name);
+      break;
+    case ERR_CACHE_FORMAT:
+      fprintf (stderr, _("%s: %s: invalid no-match cache\n"),
+               program_name, file_name);
+      break;
+    case ERR_FILES0_OPERAND:
+      fprintf (stderr, _("%s: %s: file operands cannot be combined with\
+ --files0-from\n"), program_name, file_name);
+      break;
+    case ERR_FILES0_PROMPT:
+      fprintf (stderr, _("%s: file names and prompt answers cannot both be\
+ read from standard input\n"), program_name);
+      break;
+    case ERR_EMPTY_NAME:
+      fprintf (stderr, _("%s: %s: invalid zero-length file name\n"),
+               program_name, file_name);
+      break;
+    case ERR_PAIRS:
+      fprintf (stderr, _("%s: %s: line without PATTERN and tab separated\
+ REPLACEMENT\n"), program_name, file_name);
+      break;
     case ERR_UNKNOWN_ESCAPE:
       fprintf (stderr, _("%s: %s: unknown escape sequence in REPLACEMENT\n"),
                program_name, file_name);
       break;
-    case ERR_SAVE_DIR:
-      fprintf (stderr, _("%s: could not save current working directory: "),
-               program_name);
-      perror (NULL);
-      break;
     case ERR_ALLOC_SUFFIX:
       fprintf (stderr, _("%s: could not allocate memory for suffix: "),
                program_name);
@@ -197,6 +250,11 @@ rrep_error (const int errcode, const char *file_name)
                file_name);
       perror (NULL);
       break;
+    case ERR_ALLOC_JOB:
+      fprintf (stderr, _("%s: could not allocate memory for job: "),
+               program_name);
+      perror (NULL);
+      break;
     case ERR_REALLOC_BUFFER:
       fprintf (stderr, _("%s: %s: could not reallocate memory for buffer: "),
                program_name, file_name);
@@ -238,6 +296,31 @@ rrep_error (const int errcode, const char *file_name)
                program_name, file_name);
       perror (NULL);
       break;
+    case ERR_READ_IGNORE:
+      fprintf (stderr, _("%s: %s: could not read ignore file: "),
+               program_name, file_name);
+      perror (NULL);
+      break;
+    case ERR_READ_INDEX:
+      fprintf (stderr, _("%s: %s: could not read index: "),
+               program_name, file_name);
+      perror (NULL);
+      break;
+    case ERR_WRITE_INDEX:
+      fprintf (stderr, _("%s: %s: could not write index: "),
+               program_name, file_name);
+      perror (NULL);
+      break;
+    case ERR_READ_CACHE:
+      fprintf (stderr, _("%s: %s: could not read no-match cache: "),
+               program_name, file_name);
+      perror (NULL);
+      break;
+    case ERR_WRITE_CACHE:
+      fprintf (stderr, _("%s: %s: could not write no-match cache: "),
+               program_name, file_name);
+      perror (NULL);
+      break;
     case ERR_WRITE_BACKUP:
       fprintf (stderr, _("%s: %s: could not write backup file: "),
                program_name, file_name);
@@ -248,11 +331,41 @@ rrep_error (const int errcode, const char *file_name)
                program_name, file_name);
       perror (NULL);
       break;
+    case ERR_CREATE_TEMP:
+      fprintf (stderr, _("%s: %s: could not create temporary file: "),
+               program_name, file_name);
+      perror (NULL);
+      break;
+    case ERR_WRITE_TEMP:
+      fprintf (stderr, _("%s: %s: could not write temporary file: "),
+               program_name, file_name);
+      perror (NULL);
+      break;
+    case ERR_WRITE_OUTPUT:
+      fprintf (stderr, _("%s: %s: could not write output: "),
+               program_name, file_name);
+      perror (NULL);
+      break;
+    case ERR_COPY_ACL:
+      fprintf (stderr, _("%s: %s: could not copy permissions: "),
+               program_name, file_name);
+      perror (NULL);
+      break;
+    case ERR_RENAME:
+      fprintf (stderr, _("%s: %s: could not rename temporary file: "),
+               program_name, file_name);
+      perror (NULL);
+      break;
     case ERR_KEEP_TIMES:
       fprintf (stderr, _("%s: %s: could keep file times: "),
                program_name, file_name);
       perror (NULL);
       break;
+    case ERR_CREATE_THREAD:
+      fprintf (stderr, _("%s: could not create worker thread: "),
+               program_name);
+      perror (NULL);
+      break;
     }
 }
 
@@ -277,13 +390,26 @@ print_confirmation (const char *file_name)
   printf (_("%s: pattern replaced\n"), file_name);
 }
 
-/* Prints directory omission.  */
+/* Prints the name of a file in which PATTERN was found or replaced.  */
 void
-print_dir_skip (const char *file_name)
+print_found (const char *relative_path, const char *file_name)
 {
-  if (!(options & OPT_QUIET))
-    printf (_("%s: %s: omitting directory\n"), program_name,
-            file_name);
+  size_t path_len;
+
+  if (options & OPT_QUIET)
+    return;
+
+  if (relative_path != NULL)
+    {
+      printf ("%s", relative_path);
+      path_len = strlen (relative_path);
+      if (path_len == 0 || relative_path[path_len-1] != '/')
+        printf ("/");
+    }
+  if (options & OPT_DRY)
+    printf ("%s\n", file_name);
+  else
+    print_confirmation (file_name);
 }
 
 /* Prints the simulation message.  */
@@ -22,8 +22,17 @@ enum
     ERR_PROCESS_ARG, /* Could not process an argument.  */
     ERR_PROCESS_DIR, /* Could not process a directory.  */
     ERR_PATTERN, /* Error in PATTERN.  */
+    ERR_JOBS, /* Invalid number of jobs.  */
+    ERR_BUFFER_LIMIT, /* Invalid buffer limit.  */
+    ERR_DFA_CACHE, /* Invalid size of the DFA cache.  */
+    ERR_STATS_FORMAT, /* Invalid format of the statistics.  */
+    ERR_PAIRS, /* Invalid line in a pairs file.  */
+    ERR_INDEX_FORMAT, /* Invalid index file.  */
+    ERR_CACHE_FORMAT, /* Invalid no-match cache file.  */
+    ERR_FILES0_OPERAND, /* File operand with --files0-from.  */
+    ERR_FILES0_PROMPT, /* Prompts with file names from standard input.  */
+    ERR_EMPTY_NAME, /* Empty file name in a file list.  */
     ERR_UNKNOWN_ESCAPE, /* Unknown escape sequence encountered.  */
-    ERR_SAVE_DIR, /* Could not save a directory.  */
     ERR_ALLOC_SUFFIX, /* Error for allocating suffix string.  */
     ERR_ALLOC_BUFFER, /* Error for allocating buffer.  */
     ERR_ALLOC_FILEBUFFER, /* Error for allocating file_buffer.  */
@@ -32,6 +41,7 @@ enum
     ERR_ALLOC_PATTERN, /* Error for allocating pattern.  */
     ERR_ALLOC_REPLACEMENT, /* Error for allocating replacement.  */
     ERR_ALLOC_BACKUP, /* Error for allocating backup string.  */
+    ERR_ALLOC_JOB, /* Error for allocating a job.  */
     ERR_REALLOC_BUFFER, /* Error for reallocating buffer.  */
     ERR_REALLOC_FILEBUFFER, /* Error for reallocating file_buffer.  */
     ERR_MEMORY, /* Error for insufficient memory.  */
@@ -40,9 +50,20 @@ enum
     ERR_OPEN_DIR, /* Could not open a directory.  */
     ERR_READ_FILE, /* Could not read from a file.  */
     ERR_READ_TEMP, /* Could not read from a temporary file.  */
+    ERR_READ_IGNORE, /* Could not read the ignore files of a directory.  */
+    ERR_READ_INDEX, /* Could not read the index of a directory.  */
+    ERR_WRITE_INDEX, /* Could not write the index of a directory.  */
+    ERR_READ_CACHE, /* Could not read the no-match cache.  */
+    ERR_WRITE_CACHE, /* Could not write the no-match cache.  */
     ERR_WRITE_BACKUP, /* Could not write to backup file.  */
     ERR_OVERWRITE, /* Could not overwrite a file.  */
-    ERR_KEEP_TIMES /* Could not keep file times.  */
+    ERR_CREATE_TEMP, /* Could not create a temporary file.  */
+    ERR_WRITE_TEMP, /* Could not write to a temporary file.  */
+    ERR_WRITE_OUTPUT, /* Could not write to the output.  */
+    ERR_COPY_ACL, /* Could not copy the permissions of a file.  */
+    ERR_RENAME, /* Could not rename a temporary file.  */
+    ERR_KEEP_TIMES, /* Could not keep file times.  */
+    ERR_CREATE_THREAD /* Could not create a worker thread.  */
   };
 
 /* Prints version information.  */
@@ -66,8 +87,8 @@ extern void print_regerror (const int, regex_t *);
 /* Prints replacement confirmation.  */
 extern void print_confirmation (const char *);
 
-/* Prints directory omission.  */
-extern void print_dir_skip (const char *);
+/* Prints the name of a file in which PATTERN was found or replaced.  */
+extern void print_found (const char *, const char *);
 
 /* Prints the simulation message.  */
 extern void print_dry ();
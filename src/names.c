@@ -0,0 +1,394 @@
+/* names.c - matching file names against include and exclude patterns.
+   Copyright (C) 2026 Arno Onken <asnelt@asnelt.org>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA
+   02110-1301, USA.  */
+
+/* The patterns of all sets are sorted into one matcher when the options are
+   parsed.  Patterns without wildcards, like Makefile, and patterns that are
+   a star followed or preceded by a plain string, like *.o or build*, are
+   looked up in hash tables, so that their number does not matter.  Only the
+   remaining patterns are matched one by one with fnmatch.  Each table entry
+   records all sets that contain the pattern, so a name is classified for
+   all sets at once.  Since the same base names occur in many directories,
+   the results of names that need fnmatch are cached per thread.  */
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <fnmatch.h>
+#include "rrep.h"
+#include "names.h"
+
+/* Number of slots of the cache for base names.  */
+#define CACHE_SLOTS (512)
+
+/* Maximum length of a base name in the cache.  */
+#define CACHE_NAME_SIZE (48)
+
+/* Data structure for a string in a table.  */
+typedef struct
+{
+  char *string; /* Null terminated string or NULL for an empty slot.  */
+  size_t len; /* Length of string.  */
+  size_t hash; /* Hash value of string.  */
+  int sets; /* Sets whose patterns contain the string.  */
+} entry_t;
+
+/* Data structure for a hash table of strings.  */
+typedef struct
+{
+  entry_t *entries; /* Slots of the table.  */
+  size_t size; /* Number of slots, which is a power of two.  */
+  size_t count; /* Number of strings in the table.  */
+  size_t *lens; /* Different lengths of the strings in ascending order.  */
+  size_t nlens; /* Number of different lengths.  */
+} table_t;
+
+/* Data structure for the matcher.  */
+struct names
+{
+  table_t literals; /* Patterns without wildcards.  */
+  table_t suffixes; /* Ends of patterns that start with a star.  */
+  table_t prefixes; /* Starts of patterns that end with a star.  */
+  char **globs; /* All other patterns.  */
+  int *glob_sets; /* Sets of the patterns in globs.  */
+  size_t nglobs; /* Number of patterns in globs.  */
+  int sets; /* Sets that have patterns.  */
+};
+
+/* Data structure for a cached base name.  */
+typedef struct
+{
+  const names_t *names; /* Matcher of the result or NULL.  */
+  size_t hash; /* Hash value of name.  */
+  char name[CACHE_NAME_SIZE]; /* Null terminated base name.  */
+  int reject; /* Sets that reject the name.  */
+} cached_t;
+
+/* Cache of the calling thread.  */
+static _Thread_local cached_t cache[CACHE_SLOTS];
+
+/* Returns the hash value of the first len characters of string.  */
+static size_t
+hash_string (const char *string, size_t len)
+{
+  size_t hash = 2166136261u;
+  size_t i;
+
+  for (i = 0; i < len; i++)
+    hash = (hash ^ (unsigned char) string[i]) * 16777619u;
+
+  return hash;
+}
+
+/* Returns the sets of the string with length len and hash value hash in
+   table or 0 if the string is not in the table.  */
+static int
+lookup (const table_t *table, const char *string, size_t len, size_t hash)
+{
+  const entry_t *entry;
+  size_t i;
+
+  if (table->count == 0)
+    return 0;
+  for (i = hash & (table->size - 1); table->entries[i].string != NULL;
+       i = (i + 1) & (table->size - 1))
+    {
+      entry = &table->entries[i];
+      if (entry->hash == hash && entry->len == len
+          && !memcmp (entry->string, string, len))
+        return entry->sets;
+    }
+
+  return 0;
+}
+
+/* Puts entry into the first free slot of table.  */
+static void
+put_entry (table_t *table, const entry_t *entry)
+{
+  size_t i;
+
+  for (i = entry->hash & (table->size - 1); table->entries[i].string != NULL;
+       i = (i + 1) & (table->size - 1))
+    ;
+  table->entries[i] = *entry;
+}
+
+/* Adds the first len characters of string to the sets of table.  Returns
+   FAILURE if memory is insufficient.  */
+static int
+insert (table_t *table, const char *string, size_t len, int sets)
+{
+  entry_t entry;
+  table_t grown;
+  size_t *lens;
+  size_t i;
+
+  entry.hash = hash_string (string, len);
+  for (i = table->count > 0 ? entry.hash & (table->size - 1) : 0;
+       table->count > 0 && table->entries[i].string != NULL;
+       i = (i + 1) & (table->size - 1))
+    {
+      if (table->entries[i].hash == entry.hash
+          && table->entries[i].len == len
+          && !memcmp (table->entries[i].string, string, len))
+        {
+          table->entries[i].sets |= sets;
+          return SUCCESS;
+        }
+    }
+
+  /* Keep the table at most half full.  */
+  if (2 * (table->count + 1) > table->size)
+    {
+      grown.size = table->size > 0 ? 2 * table->size : 16;
+      grown.entries = (entry_t *) calloc (grown.size, sizeof (entry_t));
+      if (grown.entries == NULL)
+        return FAILURE;
+      for (i = 0; i < table->size; i++)
+        if (table->entries[i].string != NULL)
+          put_entry (&grown, &table->entries[i]);
+      free (table->entries);
+      table->entries = grown.entries;
+      table->size = grown.size;
+    }
+
+  /* Record the length if it is new.  */
+  for (i = 0; i < table->nlens && table->lens[i] < len; i++)
+    ;
+  if (i == table->nlens || table->lens[i] != len)
+    {
+      lens = (size_t *) realloc (table->lens,
+                                 (table->nlens + 1) * sizeof (size_t));
+      if (lens == NULL)
+        return FAILURE;
+      table->lens = lens;
+      memmove (lens + i + 1, lens + i, (table->nlens - i) * sizeof (size_t));
+      lens[i] = len;
+      table->nlens++;
+    }
+
+  entry.string = (char *) malloc (len + 1);
+  if (entry.string == NULL)
+    return FAILURE;
+  memcpy (entry.string, string, len);
+  entry.string[len] = '\0';
+  entry.len = len;
+  entry.sets = sets;
+  put_entry (table, &entry);
+  table->count++;
+
+  return SUCCESS;
+}
+
+/* Frees the strings and slots of table.  */
+static void
+free_table (table_t *table)
+{
+  size_t i;
+
+  for (i = 0; i < table->size; i++)
+    free (table->entries[i].string);
+  free (table->entries);
+  free (table->lens);
+}
+
+/* Returns a new matcher without patterns or NULL if memory is
+   insufficient.  */
+names_t *
+new_names ()
+{
+  return (names_t *) calloc (1, sizeof (names_t));
+}
+
+/* Frees the matcher.  */
+void
+free_names (names_t *names)
+{
+  size_t i;
+
+  if (names == NULL)
+    return;
+  free_table (&names->literals);
+  free_table (&names->suffixes);
+  free_table (&names->prefixes);
+  for (i = 0; i < names->nglobs; i++)
+    free (names->globs[i]);
+  free (names->globs);
+  free (names->glob_sets);
+  free (names);
+}
+
+/* Returns true if pattern has wildcards.  A backslash escapes the next
+   character like in fnmatch.  */
+static bool
+has_wildcards (const char *pattern)
+{
+  for (; *pattern != '\0'; pattern++)
+    {
+      if (*pattern == '\\' && pattern[1] != '\0')
+        pattern++;
+      else if (*pattern == '*' || *pattern == '?' || *pattern == '[')
+        return true;
+    }
+
+  return false;
+}
+
+/* Adds the wildcard pattern to the set of the matcher.  Returns FAILURE if
+   memory is insufficient.  */
+int
+add_name_pattern (names_t *names, const char *pattern, int set)
+{
+  char **globs;
+  int *glob_sets;
+  char *string;
+  size_t len = strlen (pattern);
+  size_t i, j;
+  int result;
+
+  names->sets |= set;
+  if (!has_wildcards (pattern))
+    {
+      /* Remove the escapes, since the name is compared as it is.  */
+      string = (char *) malloc (len + 1);
+      if (string == NULL)
+        return FAILURE;
+      for (i = 0, j = 0; i < len; i++)
+        {
+          if (pattern[i] == '\\' && i + 1 < len)
+            i++;
+          string[j++] = pattern[i];
+        }
+      result = insert (&names->literals, string, j, set);
+      free (string);
+      return result;
+    }
+  if (pattern[0] == '*' && strcspn (pattern + 1, "*?[\\") == len - 1)
+    return insert (&names->suffixes, pattern + 1, len - 1, set);
+  if (len > 0 && pattern[len-1] == '*'
+      && strcspn (pattern, "*?[\\") == len - 1)
+    return insert (&names->prefixes, pattern, len - 1, set);
+
+  globs = (char **) realloc (names->globs,
+                             (names->nglobs + 1) * sizeof (char *));
+  if (globs == NULL)
+    return FAILURE;
+  names->globs = globs;
+  glob_sets = (int *) realloc (names->glob_sets,
+                               (names->nglobs + 1) * sizeof (int));
+  if (glob_sets == NULL)
+    return FAILURE;
+  names->glob_sets = glob_sets;
+  globs[names->nglobs] = strdup (pattern);
+  if (globs[names->nglobs] == NULL)
+    return FAILURE;
+  glob_sets[names->nglobs] = set;
+  names->nglobs++;
+
+  return SUCCESS;
+}
+
+/* Returns the sets with a pattern that matches the name with length len and
+   hash value hash.  Patterns with wildcards are only tried if wildcard_flag
+   is set.  */
+static int
+match_part (const names_t *names, const char *name, size_t len, size_t hash,
+            bool wildcard_flag)
+{
+  const table_t *table;
+  size_t i;
+  int sets;
+
+  sets = lookup (&names->literals, name, len, hash);
+  if (!wildcard_flag)
+    return sets;
+
+  table = &names->suffixes;
+  for (i = 0; i < table->nlens && table->lens[i] <= len; i++)
+    sets |= lookup (table, name + len - table->lens[i], table->lens[i],
+                    hash_string (name + len - table->lens[i],
+                                 table->lens[i]));
+  table = &names->prefixes;
+  for (i = 0; i < table->nlens && table->lens[i] <= len; i++)
+    sets |= lookup (table, name, table->lens[i],
+                    hash_string (name, table->lens[i]));
+  /* Patterns of sets that already match need not be tried.  */
+  for (i = 0; i < names->nglobs && sets != names->sets; i++)
+    if ((names->glob_sets[i] & ~sets)
+        && fnmatch (names->globs[i], name, 0) == 0)
+      sets |= names->glob_sets[i];
+
+  return sets;
+}
+
+/* Returns the sets that reject a name that is matched by the patterns of the
+   sets matched.  */
+static int
+rejecting_sets (const names_t *names, int matched)
+{
+  return (names->sets & NAMES_INCLUDE & ~matched)
+         | (matched & (NAMES_EXCLUDE | NAMES_EXCLUDE_DIR));
+}
+
+/* Returns the sets that reject the file name.  A name is rejected by
+   NAMES_INCLUDE if the set has patterns and none of them matches, and by the
+   other sets if one of their patterns matches.  As with the exclude module
+   of gnulib, patterns also match any part of the name behind a slash.  */
+int
+reject_name (const names_t *names, const char *name)
+{
+  cached_t *cached;
+  const char *p;
+  size_t len, hash;
+  int matched;
+
+  if (names == NULL || names->sets == 0)
+    return 0;
+  len = strlen (name);
+  hash = hash_string (name, len);
+
+  if (strchr (name, '/') != NULL)
+    {
+      matched = match_part (names, name, len, hash, true);
+      for (p = name; *p != '\0' && matched != names->sets; p++)
+        if (*p == '/')
+          matched |= match_part (names, p + 1, len - (p + 1 - name),
+                                 hash_string (p + 1, len - (p + 1 - name)),
+                                 p[1] != '/');
+      return rejecting_sets (names, matched);
+    }
+
+  /* Hash lookups are as fast as the cache.  */
+  if (names->nglobs == 0 || len >= CACHE_NAME_SIZE)
+    return rejecting_sets (names, match_part (names, name, len, hash, true));
+  cached = &cache[hash % CACHE_SLOTS];
+  if (cached->names != names || cached->hash != hash
+      || strcmp (cached->name, name))
+    {
+      cached->reject = rejecting_sets (names, match_part (names, name, len,
+                                                          hash, true));
+      cached->names = names;
+      cached->hash = hash;
+      memcpy (cached->name, name, len + 1);
+    }
+
+  return cached->reject;
+}
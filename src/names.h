@@ -0,0 +1,45 @@
+/* names.h - declarations for matching file names in rrep.
+   Copyright (C) 2026 Arno Onken <asnelt@asnelt.org>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA
+   02110-1301, USA.  */
+
+/* Sets of file name patterns.  */
+enum
+  {
+    NAMES_INCLUDE = 0x1, /* Patterns of --include.  */
+    NAMES_EXCLUDE = 0x2, /* Patterns of --exclude.  */
+    NAMES_EXCLUDE_DIR = 0x4 /* Patterns of --exclude-dir.  */
+  };
+
+/* Matcher for the file name patterns of all sets.  */
+typedef struct names names_t;
+
+/* Returns a new matcher without patterns or NULL if memory is
+   insufficient.  */
+extern names_t *new_names (void);
+
+/* Frees the matcher.  */
+extern void free_names (names_t *);
+
+/* Adds the wildcard pattern to the set of the matcher.  Returns FAILURE if
+   memory is insufficient.  */
+extern int add_name_pattern (names_t *, const char *, int);
+
+/* Returns the sets that reject the file name.  A name is rejected by
+   NAMES_INCLUDE if the set has patterns and none of them matches, and by the
+   other sets if one of their patterns matches.  As with the exclude module
+   of gnulib, patterns also match any part of the name behind a slash.  */
+extern int reject_name (const names_t *, const char *);
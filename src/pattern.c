@@ -19,62 +19,274 @@
 #include <config.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
 #include <stdbool.h>
 #include <string.h>
+#include <wchar.h>
 #include <regex.h>
 #include "rrep.h"
 #include "messages.h"
 #include "pattern.h"
+#include "search.h"
+#include "dfa.h"
 
-/* Checks the whole word and whole line options.  */
-bool
-check_whole (const char *line, const char *start, size_t len)
+/* Node of the Aho-Corasick automaton.  Children are kept in sibling lists;
+   the transitions of the root are kept in a table.  */
+typedef struct
+{
+  int child; /* First child or -1.  */
+  int sibling; /* Next sibling or -1.  */
+  int fail; /* Node of the longest proper suffix.  */
+  int dict; /* Next node with a pair on the fail path or -1.  */
+  int pair; /* Index of the pair that ends here or -1.  */
+  size_t depth; /* Length of the string that leads to the node.  */
+  unsigned char c; /* Character of the edge from the parent.  */
+} node_t;
+
+/* Aho-Corasick automaton for the fixed strings of a pairs file.  */
+struct automaton
+{
+  node_t *nodes; /* Nodes; the root has index 0.  */
+  size_t nnodes; /* Number of nodes.  */
+  size_t nodes_size; /* Number of allocated nodes.  */
+  int root[UCHAR_MAX+1]; /* Transitions of the root.  */
+};
+
+/* Returns the child of node for character c or -1.  */
+static inline int
+find_child (const automaton_t *automaton, int node, unsigned char c)
+{
+  int child;
+
+  if (node == 0)
+    return automaton->root[c];
+  for (child = automaton->nodes[node].child; child >= 0;
+       child = automaton->nodes[child].sibling)
+    if (automaton->nodes[child].c == c)
+      return child;
+
+  return -1;
+}
+
+/* Follows the transition from node for character c.  */
+static inline int
+next_node (const automaton_t *automaton, int node, unsigned char c)
 {
-  char c;
+  int child;
+
+  while ((child = find_child (automaton, node, c)) < 0 && node != 0)
+    node = automaton->nodes[node].fail;
+
+  return child < 0 ? 0 : child;
+}
 
-  /* Check whether any of these options was selected.  */
-  if (!(options & OPT_WHOLE_WORD) && !(options & OPT_WHOLE_LINE))
-    return true;
+/* Adds a node for character c below parent and returns its index or -1 if
+   memory is exhausted.  */
+static int
+add_node (automaton_t *automaton, int parent, unsigned char c)
+{
+  node_t *tmp, *node;
 
-  /* Check beginning.  */
-  if (start > line)
+  if (automaton->nnodes == automaton->nodes_size)
+    {
+      tmp = realloc (automaton->nodes,
+                     2*automaton->nodes_size*sizeof (node_t));
+      if (tmp == NULL)
+        return -1;
+      automaton->nodes = tmp;
+      automaton->nodes_size *= 2;
+    }
+  node = automaton->nodes+automaton->nnodes;
+  node->child = -1;
+  node->sibling = -1;
+  node->fail = 0;
+  node->dict = -1;
+  node->pair = -1;
+  node->depth = automaton->nodes[parent].depth+1;
+  node->c = c;
+  if (parent == 0)
+    automaton->root[c] = automaton->nnodes;
+  else
     {
-      if (options & OPT_WHOLE_LINE)
-        return false;
+      node->sibling = automaton->nodes[parent].child;
+      automaton->nodes[parent].child = automaton->nnodes;
+    }
+
+  return automaton->nnodes++;
+}
+
+/* Frees the memory of automaton.  */
+static void
+free_automaton (automaton_t *automaton)
+{
+  free (automaton->nodes);
+  free (automaton);
+}
+
+/* Allocates an automaton with only the root.  */
+static automaton_t *
+new_automaton (void)
+{
+  automaton_t *automaton;
+  int i;
 
-      c = *(start-1);
-      if ((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z')
-          || (c >= '0' && c <= '9') || c == '_')
-        return false;
+  automaton = (automaton_t *) malloc (sizeof (automaton_t));
+  if (automaton == NULL)
+    return NULL;
+  automaton->nodes_size = 256;
+  automaton->nodes = (node_t *) malloc (automaton->nodes_size
+                                        * sizeof (node_t));
+  if (automaton->nodes == NULL)
+    {
+      free (automaton);
+      return NULL;
     }
+  for (i = 0; i <= UCHAR_MAX; i++)
+    automaton->root[i] = -1;
+  automaton->nodes[0].child = -1;
+  automaton->nodes[0].sibling = -1;
+  automaton->nodes[0].fail = 0;
+  automaton->nodes[0].dict = -1;
+  automaton->nodes[0].pair = -1;
+  automaton->nodes[0].depth = 0;
+  automaton->nnodes = 1;
+
+  return automaton;
+}
+
+/* Adds string with index pair to automaton.  A string that was added before
+   keeps its first pair.  */
+static int
+add_string (automaton_t *automaton, const char *string, size_t pair)
+{
+  int node, child;
 
-  /* Check end.  */
-  c = *(start + len);
-  if (c != '\n')
+  node = 0;
+  for (; *string != '\0'; string++)
     {
-      if (options & OPT_WHOLE_LINE)
-        return false;
+      child = find_child (automaton, node, *string);
+      if (child < 0)
+        {
+          child = add_node (automaton, node, *string);
+          if (child < 0)
+            return FAILURE;
+        }
+      node = child;
+    }
+  if (automaton->nodes[node].pair < 0)
+    automaton->nodes[node].pair = pair;
+
+  return SUCCESS;
+}
+
+/* Computes the fail and dictionary links of automaton in breadth-first
+   order.  */
+static int
+link_automaton (automaton_t *automaton)
+{
+  node_t *nodes;
+  int *queue;
+  int node, child, fail;
+  size_t head, tail;
 
-      if ((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z')
-          || (c >= '0' && c <= '9') || c == '_')
-        return false;
+  queue = (int *) malloc (automaton->nnodes * sizeof (int));
+  if (queue == NULL)
+    return FAILURE;
+  nodes = automaton->nodes;
+  head = tail = 0;
+  queue[tail++] = 0;
+  while (head < tail)
+    {
+      node = queue[head++];
+      for (child = node == 0 ? -1 : nodes[node].child; child >= 0;
+           child = nodes[child].sibling)
+        queue[tail++] = child;
+      if (node == 0)
+        {
+          /* Children of the root fail to the root.  */
+          for (child = 0; child <= UCHAR_MAX; child++)
+            if (automaton->root[child] >= 0)
+              queue[tail++] = automaton->root[child];
+          continue;
+        }
+      if (nodes[node].depth > 1)
+        {
+          /* Find the longest proper suffix through the parent's fail link,
+             which is already known.  */
+          fail = nodes[node].fail;
+          nodes[node].fail = next_node (automaton, fail, nodes[node].c);
+        }
+      fail = nodes[node].fail;
+      nodes[node].dict = nodes[fail].pair >= 0 ? fail : nodes[fail].dict;
+      /* Children start their fail search at the fail node of this node.  */
+      for (child = nodes[node].child; child >= 0; child = nodes[child].sibling)
+        nodes[child].fail = nodes[node].fail;
     }
+  free (queue);
 
-  return true;
+  return SUCCESS;
 }
 
-/* Matches regular expression or string in start.  Returns 0 if a match was
-   found, REG_NOMATCH if no match was found or regerror error value if a
-   regerror occurred.  Match offsets are stored in match.  */
+/* Returns the leftmost occurrence of any string of automaton in the len
+   characters at start that passes the whole word and whole line options.
+   Among occurrences at the same position, the longest one is chosen.  The
+   index of its pair is stored in *pair and its length in *found_len.  The
+   characters between context and start are only used for the whole word and
+   whole line checks.  */
+static const char *
+search_automaton (const automaton_t *automaton, const char *context,
+                  const char *start, size_t len, size_t *pair,
+                  size_t *found_len)
+{
+  const node_t *nodes;
+  const char *p, *end, *found, *best;
+  int node, out;
+
+  nodes = automaton->nodes;
+  end = start+len;
+  best = NULL;
+  node = 0;
+  for (p = start; p < end; p++)
+    {
+      node = next_node (automaton, node, *p);
+      for (out = nodes[node].pair >= 0 ? node : nodes[node].dict; out >= 0;
+           out = nodes[out].dict)
+        {
+          found = p+1-nodes[out].depth;
+          if ((best == NULL || found < best
+               || (found == best && nodes[out].depth > *found_len))
+              && check_found (context, found, end, nodes[out].depth))
+            {
+              best = found;
+              *found_len = nodes[out].depth;
+              *pair = nodes[out].pair;
+            }
+        }
+      /* No later occurrence can start before best.  */
+      if (best != NULL && nodes[node].depth < (size_t) (p+1-best))
+        break;
+    }
+
+  return best;
+}
+
+/* Matches regular expression or string in the line with length line_len from
+   start on.  Returns 0 if a match was found, REG_NOMATCH if no match was found
+   or regerror error value if a regerror occurred.  Match offsets relative to
+   start are stored in match.  */
 int
-match_pattern (pattern_t *pattern, const char *line, const char *start,
-               regmatch_t *match)
+match_pattern (pattern_t *pattern, const char *line, size_t line_len,
+               const char *start, regmatch_t *match)
 {
-  int i;
+  size_t i;
+  const char *end; /* End of line.  */
   const char *first; /* Start of first occurrence of pattern->string.  */
+  size_t len; /* Length of the occurrence.  */
   int errcode; /* Return value of regexec.  */
   int eflags; /* Flags for regexec.  */
 
+  end = line + line_len;
   if (options & OPT_FIXED)
     {
       /* Prepare match.  */
@@ -84,13 +296,15 @@ match_pattern (pattern_t *pattern, const char *line, const char *start,
           match[i].rm_eo = -1;
         }
       /* Match string.  */
-      first = start - pattern->string_len;
-      do
+      if (pattern->automaton != NULL)
+        first = search_automaton (pattern->automaton, line, start, end-start,
+                                  &pattern->pair, &len);
+      else
         {
-          first += pattern->string_len;
-          first = strstr (first, pattern->string);
+          first = search_string (line, start, end-start, pattern->string,
+                                 pattern->string_len);
+          len = pattern->string_len;
         }
-      while (first != NULL && !check_whole (line, first, pattern->string_len));
 
       if (first == NULL)
         {
@@ -103,13 +317,28 @@ match_pattern (pattern_t *pattern, const char *line, const char *start,
         {
           /* Set offsets in match[0].  */
           match[0].rm_so = first - start;
-          match[0].rm_eo = match[0].rm_so + pattern->string_len;
+          match[0].rm_eo = match[0].rm_so + len;
           return 0;
         }
     }
   else
     {
       /* Match regular expression.  */
+      if (pattern->literal != NULL
+          && find_string (start, end-start, pattern->literal,
+                          pattern->literal_len) == NULL)
+        return REG_NOMATCH;
+      /* The automaton checks each line once.  Later matches in a line that
+         it accepted are left to regexec.  */
+      if (pattern->dfa != NULL && start == line
+          && dfa_search (pattern->dfa, line, line_len, true, &first) == 0)
+        return REG_NOMATCH;
+      /* Subpatterns that the replacement does not refer to stay unset.  */
+      for (i = pattern->nmatch; i < 10; i++)
+        {
+          match[i].rm_so = -1;
+          match[i].rm_eo = -1;
+        }
       match[0].rm_eo = 0;
       first = start - 1; /* Decrement due to increment in loop.  */
       do
@@ -117,7 +346,7 @@ match_pattern (pattern_t *pattern, const char *line, const char *start,
           if (match[0].rm_eo == 0)
             {
               /* Initial iteration or found PATTERN has zero length.  */
-              if (first >= start && (*first == '\n' || *first == '\0'))
+              if (first >= start && (first == end || *first == '\n'))
                   return REG_NOMATCH;
               first++;
             }
@@ -125,16 +354,19 @@ match_pattern (pattern_t *pattern, const char *line, const char *start,
             first += match[0].rm_eo;
           /* Set flags for regexec.  */
           if (first == line)
-            eflags = 0;
+            eflags = REG_STARTEND;
           else
-            eflags = REG_NOTBOL;
-          errcode = regexec (pattern->compiled, first, 10, match, eflags);
+            eflags = REG_STARTEND | REG_NOTBOL;
+          match[0].rm_so = 0;
+          match[0].rm_eo = end - first;
+          errcode = regexec (pattern->compiled, first, pattern->nmatch, match,
+                             eflags);
         }
       while (errcode == 0
-             && !check_whole (line, first+match[0].rm_so,
+             && !check_found (line, first+match[0].rm_so, end,
                               match[0].rm_eo-match[0].rm_so));
       /* Correct offsets.  */
-      for (i = 0; i < 10; i++)
+      for (i = 0; i < pattern->nmatch; i++)
         {
           if (match[i].rm_eo > -1)
             {
@@ -147,6 +379,416 @@ match_pattern (pattern_t *pattern, const char *line, const char *start,
     }
 }
 
+/* Checks whether the regular expression or string matches in the line with
+   length line_len without determining the match offsets.  Returns 0 if a
+   match was found, REG_NOMATCH if no match was found or regerror error value
+   if a regerror occurred.  */
+int
+detect_pattern (pattern_t *pattern, const char *line, size_t line_len)
+{
+  regmatch_t match[10]; /* Offsets for match_pattern and the line range.  */
+  const char *first; /* Start of the line found by the automaton.  */
+
+  /* Whole word and line matches must be checked at the match offsets.  */
+  if (pattern->detector == NULL
+      || (options & (OPT_WHOLE_WORD | OPT_WHOLE_LINE)))
+    return match_pattern (pattern, line, line_len, line, match);
+
+  if (pattern->literal != NULL
+      && find_string (line, line_len, pattern->literal,
+                      pattern->literal_len) == NULL)
+    return REG_NOMATCH;
+  if (pattern->dfa != NULL
+      && dfa_search (pattern->dfa, line, line_len, true, &first) == 0)
+    return REG_NOMATCH;
+  match[0].rm_so = 0;
+  match[0].rm_eo = line_len;
+  return regexec (pattern->detector, line, 0, match, REG_STARTEND);
+}
+
+/* Searches the characters from offset so to offset eo in the buffer start
+   with the locator of pattern.  Returns the start of the first match, NULL if
+   there is none or the start of the range if an error occurred.  */
+static const char *
+locate_regex (const pattern_t *pattern, const char *start, regoff_t so,
+              regoff_t eo)
+{
+  regmatch_t match[1]; /* Range of the buffer and located match.  */
+
+  match[0].rm_so = so;
+  match[0].rm_eo = eo;
+  switch (regexec (pattern->locator, start, 1, match, REG_STARTEND))
+    {
+    case 0:
+      return start + match[0].rm_so;
+    case REG_NOMATCH:
+      return NULL;
+    default:
+      /* Let match_pattern report the error.  */
+      return start + so;
+    }
+}
+
+/* Returns the first position in the buffer start with length len at which a
+   match of pattern may begin or NULL if no line in the buffer contains a
+   match.  The buffer must begin at the start of a line.  Candidates must be
+   confirmed with match_pattern on their line.  */
+const char *
+locate_pattern (pattern_t *pattern, const char *start, size_t len)
+{
+  const char *pos, *found, *line_start, *line_end;
+  size_t pair, found_len; /* Unused pair and length of an occurrence.  */
+
+  if (pattern->automaton != NULL)
+    return search_automaton (pattern->automaton, start, start, len, &pair,
+                             &found_len);
+  if (options & OPT_FIXED)
+    return search_string (start, start, len, pattern->string,
+                          pattern->string_len);
+  if (pattern->literal == NULL)
+    {
+      if (pattern->dfa != NULL)
+        switch (dfa_search (pattern->dfa, start, len, true, &found))
+          {
+          case 0:
+            return NULL;
+          case 1:
+            return found;
+          default:
+            /* Continue with the locator after the cache became too small.  */
+            if (found > start || pattern->locator == NULL)
+              return found;
+          }
+      return locate_regex (pattern, start, 0, len);
+    }
+
+  /* Only run the regular expression on lines with the literal.  */
+  for (pos = start; pos < start+len; pos = line_end)
+    {
+      found = find_string (pos, start+len-pos, pattern->literal,
+                           pattern->literal_len);
+      if (found == NULL)
+        return NULL;
+      if (pattern->locator == NULL && pattern->dfa == NULL)
+        return found;
+      line_start = memrchr (start, '\n', found-start);
+      line_start = line_start == NULL ? start : line_start+1;
+      line_end = memchr (found, '\n', start+len-found);
+      line_end = line_end == NULL ? start+len : line_end+1;
+      if (pattern->dfa != NULL)
+        {
+          if (dfa_search (pattern->dfa, line_start, line_end-line_start, true,
+                          &found) != 0)
+            return line_start;
+          continue;
+        }
+      found = locate_regex (pattern, start, line_start-start,
+                            line_end-start);
+      if (found != NULL)
+        return found;
+    }
+
+  return NULL;
+}
+
+/* Returns true if locate_pattern can search whole buffers for pattern.  */
+bool
+can_locate (const pattern_t *pattern)
+{
+  return (options & OPT_FIXED || pattern->literal != NULL
+          || pattern->dfa != NULL || pattern->locator != NULL);
+}
+
+/* Mixes the len bytes at data into the hash value hash.  */
+static uint64_t
+mix_hash (uint64_t hash, const void *data, size_t len)
+{
+  const unsigned char *p = data;
+  size_t i;
+
+  for (i = 0; i < len; i++)
+    hash = (hash ^ p[i]) * 1099511628211u;
+
+  return hash;
+}
+
+/* Returns a hash value of pattern and of the options that decide which
+   files contain a match.  The strings of a pairs file are hashed through
+   the nodes of their automaton, which only depend on the strings.  */
+uint64_t
+hash_pattern (const pattern_t *pattern)
+{
+  const node_t *node;
+  uint64_t hash = 14695981039346656037u;
+  int flags;
+  size_t i;
+
+  flags = options & (OPT_FIXED | OPT_BINARY | OPT_WHOLE_LINE
+                     | OPT_WHOLE_WORD);
+  hash = mix_hash (hash, &flags, sizeof (flags));
+  if (pattern->string != NULL)
+    {
+      hash = mix_hash (hash, &pattern->cflags, sizeof (pattern->cflags));
+      hash = mix_hash (hash, pattern->string, pattern->string_len);
+    }
+  if (pattern->automaton != NULL)
+    for (i = 0; i < pattern->automaton->nnodes; i++)
+      {
+        node = &pattern->automaton->nodes[i];
+        hash = mix_hash (hash, &node->c, sizeof (node->c));
+        hash = mix_hash (hash, &node->depth, sizeof (node->depth));
+        hash = mix_hash (hash, &node->pair, sizeof (node->pair));
+      }
+
+  return hash;
+}
+
+/* Checks whether every match of the regular expression string in a line is
+   also found by the same expression compiled with REG_NEWLINE in a buffer of
+   lines.  This fails if the match can end with the newline character of the
+   line or depends on the end of the string.  */
+static bool
+check_locator (const char *string)
+{
+  const char *c;
+
+  for (c = string; *c != '\0'; c++)
+    {
+      switch (*c)
+        {
+        case '.':
+        case '\n':
+          return false;
+        case '[':
+          if (*(c+1) == '^')
+            return false;
+          break;
+        case '\\':
+          if (*(c+1) == 'W' || *(c+1) == 'S' || *(c+1) == '\''
+              || *(c+1) == '`')
+            return false;
+          if (*(c+1) != '\0')
+            c++;
+          break;
+        }
+    }
+
+  return true;
+}
+
+/* Returns the character after the bracket expression that starts at c or NULL
+   if the expression is not terminated.  */
+static const char *
+skip_bracket (const char *c)
+{
+  char delim; /* Delimiter of a character class.  */
+
+  c++;
+  if (*c == '^')
+    c++;
+  if (*c == ']')
+    c++;
+  while (*c != ']')
+    {
+      if (*c == '\0')
+        return NULL;
+      if (*c == '[' && (*(c+1) == ':' || *(c+1) == '=' || *(c+1) == '.'))
+        {
+          /* Skip character class, equivalence class or collating symbol.  */
+          delim = *(c+1);
+          for (c += 2; *c != delim || *(c+1) != ']'; c++)
+            if (*c == '\0')
+              return NULL;
+          c++;
+        }
+      c++;
+    }
+
+  return c+1;
+}
+
+/* Returns the length of the repetition operator at c or 0 if c does not
+   start with one.  If the operator allows the preceding atom to be absent,
+   *optional_flag is set.  */
+static size_t
+get_repetition (const char *c, int cflags, bool *optional_flag)
+{
+  const char *end;
+
+  *optional_flag = true;
+  if (cflags & REG_EXTENDED)
+    {
+      switch (*c)
+        {
+        case '*':
+        case '?':
+          return 1;
+        case '+':
+          *optional_flag = false;
+          return 1;
+        case '{':
+          end = strchr (c, '}');
+          return end == NULL ? strlen (c) : (size_t) (end-c+1);
+        default:
+          return 0;
+        }
+    }
+  if (*c == '*')
+    return 1;
+  if (*c != '\\')
+    return 0;
+  switch (*(c+1))
+    {
+    case '?':
+      return 2;
+    case '+':
+      *optional_flag = false;
+      return 2;
+    case '{':
+      end = strstr (c, "\\}");
+      return end == NULL ? strlen (c) : (size_t) (end-c+2);
+    default:
+      return 0;
+    }
+}
+
+/* Returns the longest string that every match of the regular expression
+   string compiled with cflags must contain or NULL if no such string is
+   known.  The length of the string is stored in *literal_len.  The
+   expression is parsed conservatively: everything that is not an ordinary
+   character at the top level, like groups, bracket expressions and escape
+   sequences, ends the current run of characters.  */
+static char *
+find_literal (const char *string, int cflags, size_t *literal_len)
+{
+  const char *c, *atom;
+  char *run, *best;
+  size_t run_len, best_len, atom_len, rep_len;
+  int depth; /* Depth of nested groups.  */
+  bool optional_flag, end_flag;
+  mbstate_t state;
+
+  if (cflags & REG_ICASE)
+    return NULL;
+  run = (char *) malloc ((strlen (string) + 1) * sizeof (char));
+  best = (char *) malloc ((strlen (string) + 1) * sizeof (char));
+  if (run == NULL || best == NULL)
+    goto fail;
+
+  memset (&state, 0, sizeof (state));
+  run_len = 0;
+  best_len = 0;
+  depth = 0;
+  c = string;
+  while (*c != '\0')
+    {
+      atom = NULL;
+      atom_len = 0;
+      if (*c == '\\')
+        {
+          if (*(c+1) == '\0')
+            goto fail;
+          if (strchr (".[]*^$\\", *(c+1)) != NULL
+              || ((cflags & REG_EXTENDED)
+                  && strchr ("+?(){}|", *(c+1)) != NULL))
+            {
+              /* Quoted special character.  */
+              atom = c+1;
+              atom_len = 1;
+            }
+          else if (!(cflags & REG_EXTENDED) && *(c+1) == '(')
+            depth++;
+          else if (!(cflags & REG_EXTENDED) && *(c+1) == ')')
+            depth--;
+          else if (!(cflags & REG_EXTENDED) && *(c+1) == '|' && depth == 0)
+            goto fail;
+          c += 2;
+        }
+      else if (*c == '[')
+        {
+          c = skip_bracket (c);
+          if (c == NULL)
+            goto fail;
+        }
+      else if ((cflags & REG_EXTENDED) && *c == '(')
+        {
+          depth++;
+          c++;
+        }
+      else if ((cflags & REG_EXTENDED) && *c == ')')
+        {
+          depth--;
+          c++;
+        }
+      else if ((cflags & REG_EXTENDED) && *c == '|')
+        {
+          if (depth == 0)
+            goto fail;
+          c++;
+        }
+      else if (strchr (".*^$\n", *c) != NULL
+               || ((cflags & REG_EXTENDED) && strchr ("+?{", *c) != NULL))
+        c++;
+      else
+        {
+          /* Ordinary character, possibly with several bytes.  */
+          if (MB_CUR_MAX == 1)
+            atom_len = 1;
+          else
+            atom_len = mbrlen (c, MB_CUR_MAX, &state);
+          if (atom_len == (size_t) -1 || atom_len == (size_t) -2
+              || atom_len == 0)
+            goto fail;
+          atom = c;
+          c += atom_len;
+        }
+
+      /* Handle repetitions of the atom.  */
+      end_flag = atom == NULL || depth > 0;
+      while ((rep_len = get_repetition (c, cflags, &optional_flag)) > 0)
+        {
+          if (optional_flag)
+            atom = NULL;
+          end_flag = true;
+          c += rep_len;
+        }
+      if (atom != NULL && depth == 0)
+        {
+          memcpy (run+run_len, atom, atom_len);
+          run_len += atom_len;
+        }
+      if (end_flag && run_len > 0)
+        {
+          if (run_len > best_len)
+            {
+              memcpy (best, run, run_len);
+              best_len = run_len;
+            }
+          run_len = 0;
+        }
+    }
+  if (run_len > best_len)
+    {
+      memcpy (best, run, run_len);
+      best_len = run_len;
+    }
+  free (run);
+  if (best_len == 0)
+    {
+      free (best);
+      return NULL;
+    }
+  best[best_len] = '\0';
+  *literal_len = best_len;
+
+  return best;
+
+ fail:
+  free (run);
+  free (best);
+  return NULL;
+}
+
 /* Frees the memory that was allocated for the fields of pattern.  */
 void
 free_pattern (pattern_t *pattern)
@@ -163,6 +805,63 @@ free_pattern (pattern_t *pattern)
       free (pattern->compiled);
       pattern->compiled = NULL;
     }
+  if (pattern->locator != NULL)
+    {
+      regfree (pattern->locator);
+      free (pattern->locator);
+      pattern->locator = NULL;
+    }
+  if (pattern->detector != NULL)
+    {
+      regfree (pattern->detector);
+      free (pattern->detector);
+      pattern->detector = NULL;
+    }
+  if (pattern->literal != NULL)
+    {
+      free (pattern->literal);
+      pattern->literal = NULL;
+    }
+  if (pattern->dfa != NULL)
+    {
+      free_dfa (pattern->dfa);
+      pattern->dfa = NULL;
+    }
+  if (pattern->automaton != NULL)
+    {
+      if (pattern->automaton_owner)
+        free_automaton (pattern->automaton);
+      pattern->automaton = NULL;
+    }
+}
+
+/* Sets up the pattern in the second argument as a copy of the first one for
+   use in another thread.  An automaton is shared with the original.  */
+int
+copy_pattern (const pattern_t *pattern, pattern_t *copy)
+{
+  if (pattern->automaton == NULL)
+    {
+      if (parse_pattern (pattern->string, copy, pattern->cflags) == FAILURE)
+        return FAILURE;
+      copy->nmatch = pattern->nmatch;
+      return SUCCESS;
+    }
+
+  copy->string = NULL;
+  copy->string_len = 0;
+  copy->compiled = NULL;
+  copy->cflags = pattern->cflags;
+  copy->locator = NULL;
+  copy->detector = NULL;
+  copy->nmatch = pattern->nmatch;
+  copy->literal = NULL;
+  copy->dfa = NULL;
+  copy->automaton = pattern->automaton;
+  copy->automaton_owner = false;
+  copy->pair = 0;
+
+  return SUCCESS;
 }
 
 /* Allocates memory for the fields of pattern and compiles the regular
@@ -172,6 +871,12 @@ parse_pattern (const char *string, pattern_t *pattern, int cflags)
 {
   int errcode; /* Error code for regcomp.  */
 
+  pattern->locator = NULL;
+  pattern->detector = NULL;
+  pattern->nmatch = 10;
+  pattern->literal = NULL;
+  pattern->dfa = NULL;
+  pattern->automaton = NULL;
   pattern->string_len = strlen (string);
   if (pattern->string_len < 1)
     {
@@ -187,6 +892,7 @@ parse_pattern (const char *string, pattern_t *pattern, int cflags)
       return FAILURE;
     }
   strcpy (pattern->string, string);
+  pattern->cflags = cflags;
 
   if (options & OPT_FIXED)
     return SUCCESS;
@@ -207,6 +913,31 @@ parse_pattern (const char *string, pattern_t *pattern, int cflags)
       return FAILURE;
     }
 
+  if (check_locator (string))
+    {
+      /* The locator is optional; matching works line by line without it.  */
+      pattern->locator = (regex_t *) malloc (sizeof (regex_t));
+      if (pattern->locator != NULL
+          && regcomp (pattern->locator, string, cflags | REG_NEWLINE) != 0)
+        {
+          free (pattern->locator);
+          pattern->locator = NULL;
+        }
+    }
+  /* The detector is optional as well; it speeds up checking for matches.  */
+  pattern->detector = (regex_t *) malloc (sizeof (regex_t));
+  if (pattern->detector != NULL
+      && regcomp (pattern->detector, string, cflags | REG_NOSUB) != 0)
+    {
+      free (pattern->detector);
+      pattern->detector = NULL;
+    }
+  /* Lines without the literal are skipped before calling regexec.  */
+  pattern->literal = find_literal (string, cflags, &pattern->literal_len);
+  /* Without the automaton, regexec decides on every line.  */
+  if (dfa_cache_size > 0)
+    pattern->dfa = new_dfa (string, cflags, dfa_cache_size);
+
   return SUCCESS;
 }
 
@@ -214,7 +945,7 @@ parse_pattern (const char *string, pattern_t *pattern, int cflags)
 void
 free_replace (replace_t *replacement)
 {
-  int i;
+  size_t i;
 
   if (replacement->string != NULL)
     {
@@ -243,6 +974,19 @@ free_replace (replace_t *replacement)
       free (replacement->part_len);
       replacement->part_len = NULL;
     }
+  if (replacement->pairs != NULL)
+    {
+      for (i = 0; i < replacement->npairs; i++)
+        free (replacement->pairs[i]);
+      free (replacement->pairs);
+      replacement->pairs = NULL;
+    }
+  if (replacement->pair_len != NULL)
+    {
+      free (replacement->pair_len);
+      replacement->pair_len = NULL;
+    }
+  replacement->npairs = 0;
 }
 
 /* Prepares replacement string for quick processing.  The string can contain
@@ -267,6 +1011,7 @@ parse_replace (const char *string, replace_t *replacement)
       return FAILURE;
     }
   strcpy (replacement->string, string);
+  replacement->max_sub = 0;
 
   if (options & OPT_FIXED)
     return SUCCESS;
@@ -374,6 +1119,8 @@ parse_replace (const char *string, replace_t *replacement)
             {
               replacement->part[i][j] = '\0';
               replacement->sub[i] = *(next+1)-'0';
+              if (replacement->sub[i] > replacement->max_sub)
+                replacement->max_sub = replacement->sub[i];
               i++;
               j = 0;
             }
@@ -398,3 +1145,128 @@ parse_replace (const char *string, replace_t *replacement)
 
   return SUCCESS;
 }
+
+/* Reads the pattern and replacement pairs from the file with the given name.
+   Each line holds a fixed string and its replacement, separated by a tab
+   character.  The patterns are compiled into an automaton in pattern and the
+   replacements are stored in replacement.  */
+int
+parse_pairs (const char *file_name, pattern_t *pattern,
+             replace_t *replacement)
+{
+  FILE *fp;
+  char *line, *tab;
+  char **tmp_pairs;
+  size_t *tmp_len;
+  size_t line_size, pairs_size;
+  ssize_t line_len;
+
+  pattern->string = NULL;
+  pattern->string_len = 0;
+  pattern->compiled = NULL;
+  pattern->locator = NULL;
+  pattern->detector = NULL;
+  pattern->nmatch = 1;
+  pattern->literal = NULL;
+  pattern->dfa = NULL;
+  pattern->automaton_owner = true;
+  pattern->pair = 0;
+  replacement->max_sub = 0;
+  replacement->pairs = NULL;
+  replacement->pair_len = NULL;
+  replacement->npairs = 0;
+
+  fp = fopen (file_name, "r");
+  if (fp == NULL)
+    {
+      rrep_error (ERR_OPEN_READ, file_name);
+      return FAILURE;
+    }
+  pattern->automaton = new_automaton ();
+  if (pattern->automaton == NULL)
+    {
+      rrep_error (ERR_ALLOC_PATTERN, NULL);
+      fclose (fp);
+      return FAILURE;
+    }
+
+  line = NULL;
+  line_size = 0;
+  pairs_size = 0;
+  while ((line_len = getline (&line, &line_size, fp)) > 0)
+    {
+      if (line[line_len-1] == '\n')
+        line[--line_len] = '\0';
+      if (line_len == 0)
+        continue;
+      /* Split line into pattern and replacement.  */
+      tab = strchr (line, '\t');
+      if (tab == NULL || tab == line)
+        {
+          rrep_error (ERR_PAIRS, file_name);
+          goto fail;
+        }
+      *tab = '\0';
+
+      if (replacement->npairs == pairs_size)
+        {
+          pairs_size = pairs_size == 0 ? 64 : 2*pairs_size;
+          tmp_pairs = realloc (replacement->pairs,
+                               pairs_size * sizeof (char *));
+          if (tmp_pairs == NULL)
+            {
+              rrep_error (ERR_ALLOC_REPLACEMENT, NULL);
+              goto fail;
+            }
+          replacement->pairs = tmp_pairs;
+          tmp_len = realloc (replacement->pair_len,
+                             pairs_size * sizeof (size_t));
+          if (tmp_len == NULL)
+            {
+              rrep_error (ERR_ALLOC_REPLACEMENT, NULL);
+              goto fail;
+            }
+          replacement->pair_len = tmp_len;
+        }
+      replacement->pairs[replacement->npairs] = strdup (tab+1);
+      if (replacement->pairs[replacement->npairs] == NULL)
+        {
+          rrep_error (ERR_ALLOC_REPLACEMENT, NULL);
+          goto fail;
+        }
+      replacement->pair_len[replacement->npairs] = strlen (tab+1);
+      replacement->npairs++;
+      if (add_string (pattern->automaton, line, replacement->npairs-1)
+          != SUCCESS)
+        {
+          rrep_error (ERR_ALLOC_PATTERN, NULL);
+          goto fail;
+        }
+    }
+  if (ferror (fp))
+    {
+      rrep_error (ERR_READ_FILE, file_name);
+      goto fail;
+    }
+  if (replacement->npairs == 0)
+    {
+      rrep_error (ERR_PATTERN, NULL);
+      goto fail;
+    }
+  if (link_automaton (pattern->automaton) != SUCCESS)
+    {
+      rrep_error (ERR_ALLOC_PATTERN, NULL);
+      goto fail;
+    }
+  free (line);
+  fclose (fp);
+
+  return SUCCESS;
+
+ fail:
+  free (line);
+  fclose (fp);
+  free_pattern (pattern);
+  free_replace (replacement);
+  return FAILURE;
+}
@@ -17,12 +17,25 @@
    Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA
    02110-1301, USA.  */
 
+/* Aho-Corasick automaton for the fixed strings of a pairs file.  */
+typedef struct automaton automaton_t;
+
 /* Data structure for PATTERN.  */
 typedef struct
 {
   char *string; /* Original pattern string.  */
   size_t string_len; /* Length of string.  */
   regex_t *compiled; /* Data structure for regular expression.  */
+  int cflags; /* Flags the regular expression was compiled with.  */
+  regex_t *locator; /* Regular expression for searching whole buffers.  */
+  regex_t *detector; /* Regular expression without subpattern matches.  */
+  size_t nmatch; /* Number of subpattern matches that match_pattern finds.  */
+  char *literal; /* String that every match contains or NULL.  */
+  size_t literal_len; /* Length of literal.  */
+  struct dfa *dfa; /* Automaton for finding lines with matches or NULL.  */
+  automaton_t *automaton; /* Patterns of a pairs file or NULL.  */
+  bool automaton_owner; /* Flag for freeing automaton with the pattern.  */
+  size_t pair; /* Index of the pair of the last match in automaton.  */
 } pattern_t;
 
 /* Data structure for REPLACEMENT.  */
@@ -34,17 +47,51 @@ typedef struct
   size_t *part_len; /* Lengths of the parts.  */
   int *sub; /* Indices of regular expression subpatterns.  */
   size_t nsub; /* Number of subpatterns in replacement.  */
+  int max_sub; /* Highest index in sub.  */
+  char **pairs; /* Replacements of the pairs of a pairs file.  */
+  size_t *pair_len; /* Lengths of the pair replacements.  */
+  size_t npairs; /* Number of pairs.  */
 } replace_t;
 
-/* Matches regular expression or string in start.  Returns 0 if a match was
-   found, REG_NOMATCH if no match was found or regerror error value if a
-   regerror occurred.  Match offsets are stored in match.  */
-extern int match_pattern (pattern_t *, const char *, const char *,
+/* Matches regular expression or string in the line with length line_len from
+   start on.  Returns 0 if a match was found, REG_NOMATCH if no match was found
+   or regerror error value if a regerror occurred.  Match offsets relative to
+   start are stored in match.  */
+extern int match_pattern (pattern_t *, const char *, size_t, const char *,
                           regmatch_t *);
 
+/* Checks whether the regular expression or string matches in the line with
+   length line_len without determining the match offsets.  Returns 0 if a
+   match was found, REG_NOMATCH if no match was found or regerror error value
+   if a regerror occurred.  */
+extern int detect_pattern (pattern_t *, const char *, size_t);
+
+/* Returns the first position in the buffer start with length len at which a
+   match of pattern may begin or NULL if no line in the buffer contains a
+   match.  The buffer must begin at the start of a line.  Candidates must be
+   confirmed with match_pattern on their line.  */
+extern const char *locate_pattern (pattern_t *, const char *, size_t);
+
+/* Returns true if locate_pattern can search whole buffers for pattern.  */
+extern bool can_locate (const pattern_t *);
+
+/* Returns a hash value of pattern and of the options that decide which
+   files contain a match.  */
+extern uint64_t hash_pattern (const pattern_t *);
+
 /* Frees the memory that was allocated for the fields of pattern.  */
 extern void free_pattern (pattern_t *);
 
+/* Sets up the pattern in the second argument as a copy of the first one for
+   use in another thread.  An automaton is shared with the original.  */
+extern int copy_pattern (const pattern_t *, pattern_t *);
+
+/* Reads the pattern and replacement pairs from the file with the given name.
+   Each line holds a fixed string and its replacement, separated by a tab
+   character.  The patterns are compiled into an automaton in pattern and the
+   replacements are stored in replacement.  */
+extern int parse_pairs (const char *, pattern_t *, replace_t *);
+
 /* Allocates memory for the fields of pattern and compiles the regular
    expression in string with cflags.  */
 extern int parse_pattern (const char *, pattern_t *, int);
@@ -0,0 +1,398 @@
+/* pipeline.c - streaming pipeline of rrep.
+   Copyright (C) 2026 Arno Onken <asnelt@asnelt.org>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA
+   02110-1301, USA.  */
+
+/* The pipeline has three stages that run in their own threads: a reader, a
+   matcher and a writer.  Blocks circulate between two neighbouring stages
+   through a pair of single producer, single consumer rings, one for filled
+   and one for empty blocks.  Each ring can hold all blocks of its pair, so
+   pushing never waits and only a stage that runs out of blocks sleeps.  */
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <regex.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/types.h>
+#include <pthread.h>
+#ifdef HAVE_STDATOMIC_H
+# include <stdatomic.h>
+#endif
+#include <dirent.h>
+#include "rrep.h"
+#include "messages.h"
+#include "bufferio.h"
+#include "pattern.h"
+#include "index.h"
+#include "jobs.h"
+#include "pipeline.h"
+#include "stats.h"
+
+#ifdef HAVE_STDATOMIC_H
+
+/* Number of blocks between two stages.  */
+#define NBLOCKS (4)
+/* Minimum size of a block that the reader reads into.  */
+#define BLOCK_SIZE (65536)
+
+/* Data structure for a block of the pipeline.  */
+typedef struct
+{
+  char *data; /* Characters of the block.  */
+  size_t size; /* Allocated size of data.  */
+  size_t len; /* Number of characters in data.  */
+  bool eof_flag; /* The block is the last one.  */
+  int status; /* SUCCESS or FAILURE of the stage that filled the block.  */
+} block_t;
+
+/* Data structure for a single producer, single consumer ring of blocks.  The
+   indices count all pushed and popped blocks.  */
+typedef struct
+{
+  block_t *slots[NBLOCKS]; /* Circular array of blocks.  */
+  atomic_size_t head; /* Number of popped blocks.  */
+  atomic_size_t tail; /* Number of pushed blocks.  */
+  atomic_bool waiting_flag; /* The consumer sleeps on cond.  */
+  pthread_mutex_t lock; /* Lock for sleeping on cond.  */
+  pthread_cond_t cond; /* Signals a pushed block to a sleeping consumer.  */
+} ring_t;
+
+/* Data structure for the pipeline.  */
+typedef struct
+{
+  int in_fd; /* File descriptor of the input.  */
+  int out_fd; /* File descriptor of the output.  */
+  const char *file_name; /* Name of the input for messages.  */
+  block_t in_blocks[NBLOCKS]; /* Blocks between reader and matcher.  */
+  block_t out_blocks[NBLOCKS]; /* Blocks between matcher and writer.  */
+  ring_t free_in; /* Empty blocks for the reader.  */
+  ring_t full_in; /* Read blocks for the matcher.  */
+  ring_t free_out; /* Empty blocks for the matcher.  */
+  ring_t full_out; /* Rewritten blocks for the writer.  */
+  int write_status; /* SUCCESS or FAILURE of the writer.  */
+} pipeline_t;
+
+/* Initializes the empty ring.  */
+static void
+init_ring (ring_t *ring)
+{
+  atomic_init (&ring->head, 0);
+  atomic_init (&ring->tail, 0);
+  atomic_init (&ring->waiting_flag, false);
+  pthread_mutex_init (&ring->lock, NULL);
+  pthread_cond_init (&ring->cond, NULL);
+}
+
+/* Frees the resources of ring.  */
+static void
+destroy_ring (ring_t *ring)
+{
+  pthread_mutex_destroy (&ring->lock);
+  pthread_cond_destroy (&ring->cond);
+}
+
+/* Appends block to ring.  Must only be called by the producer of ring.  The
+   consumer is only woken up if it sleeps.  */
+static void
+push_block (ring_t *ring, block_t *block)
+{
+  size_t tail;
+
+  tail = atomic_load_explicit (&ring->tail, memory_order_relaxed);
+  ring->slots[tail % NBLOCKS] = block;
+  atomic_store (&ring->tail, tail + 1);
+  if (atomic_load (&ring->waiting_flag))
+    {
+      pthread_mutex_lock (&ring->lock);
+      pthread_cond_signal (&ring->cond);
+      pthread_mutex_unlock (&ring->lock);
+    }
+}
+
+/* Removes the oldest block from ring and waits for one if ring is empty.
+   Must only be called by the consumer of ring.  */
+static block_t *
+pop_block (ring_t *ring)
+{
+  block_t *block;
+  size_t head;
+
+  head = atomic_load_explicit (&ring->head, memory_order_relaxed);
+  if (atomic_load_explicit (&ring->tail, memory_order_acquire) == head)
+    {
+      /* The producer checks waiting_flag after publishing a block, so the
+         block is either seen here or the producer signals cond.  */
+      pthread_mutex_lock (&ring->lock);
+      atomic_store (&ring->waiting_flag, true);
+      while (atomic_load (&ring->tail) == head)
+        pthread_cond_wait (&ring->cond, &ring->lock);
+      atomic_store (&ring->waiting_flag, false);
+      pthread_mutex_unlock (&ring->lock);
+    }
+  block = ring->slots[head % NBLOCKS];
+  atomic_store_explicit (&ring->head, head + 1, memory_order_release);
+
+  return block;
+}
+
+/* Reads the input into blocks and hands over blocks that end with a complete
+   line as soon as they are read.  The partial line at the end of a block is
+   moved to the next block.  */
+static void *
+run_reader (void *arg)
+{
+  pipeline_t *pipeline = (pipeline_t *) arg;
+  block_t *block, *next;
+  const char *end; /* End of the last complete line.  */
+  size_t rest; /* Length of the partial line.  */
+  ssize_t nr; /* Number of characters read.  */
+
+  /* The matcher cancels the reader only while it waits for input.  */
+  pthread_setcancelstate (PTHREAD_CANCEL_DISABLE, NULL);
+  start_stats ();
+  block = pop_block (&pipeline->free_in);
+  block->len = 0;
+  for (;;)
+    {
+      if (block->size - block->len < BLOCK_SIZE / 2
+          && grow_buffer (&block->data, &block->size,
+                          block->len + BLOCK_SIZE) != SUCCESS)
+        {
+          rrep_error (ERR_REALLOC_BUFFER, pipeline->file_name);
+          break;
+        }
+      pthread_setcancelstate (PTHREAD_CANCEL_ENABLE, NULL);
+      nr = read (pipeline->in_fd, block->data + block->len,
+                 block->size - block->len);
+      pthread_setcancelstate (PTHREAD_CANCEL_DISABLE, NULL);
+      if (nr < 0 && errno == EINTR)
+        continue;
+      if (nr < 0)
+        {
+          rrep_error (ERR_READ_FILE, pipeline->file_name);
+          break;
+        }
+      if (nr == 0)
+        {
+          /* End of input.  */
+          block->eof_flag = true;
+          block->status = SUCCESS;
+          push_block (&pipeline->full_in, block);
+          return NULL;
+        }
+      block->len += nr;
+      count_stat (STAT_BYTES_READ, nr);
+      /* Earlier characters of the block contain no newline.  */
+      end = memrchr (block->data + block->len - nr, '\n', nr);
+      if (end == NULL)
+        continue;
+
+      next = pop_block (&pipeline->free_in);
+      rest = block->data + block->len - (end + 1);
+      if (grow_buffer (&next->data, &next->size, rest + BLOCK_SIZE)
+          != SUCCESS)
+        {
+          rrep_error (ERR_REALLOC_BUFFER, pipeline->file_name);
+          /* Only the matcher returns blocks to free_in, so next carries the
+             failure instead.  */
+          block = next;
+          break;
+        }
+      memcpy (next->data, end + 1, rest);
+      next->len = rest;
+      block->len -= rest;
+      block->eof_flag = false;
+      block->status = SUCCESS;
+      push_block (&pipeline->full_in, block);
+      block = next;
+    }
+
+  block->len = 0;
+  block->eof_flag = true;
+  block->status = FAILURE;
+  push_block (&pipeline->full_in, block);
+  return NULL;
+}
+
+/* Writes rewritten blocks to the output until the last block.  After an
+   error, the remaining blocks are discarded.  */
+static void *
+run_writer (void *arg)
+{
+  pipeline_t *pipeline = (pipeline_t *) arg;
+  block_t *block;
+  size_t written; /* Number of written characters of the block.  */
+  ssize_t nw; /* Return value of write.  */
+  bool eof_flag;
+
+  start_stats ();
+  do
+    {
+      block = pop_block (&pipeline->full_out);
+      for (written = 0;
+           pipeline->write_status == SUCCESS && written < block->len;
+           written += nw)
+        {
+          nw = write (pipeline->out_fd, block->data + written,
+                      block->len - written);
+          if (nw < 0 && errno == EINTR)
+            nw = 0;
+          else if (nw < 0)
+            {
+              rrep_error (ERR_WRITE_OUTPUT, pipeline->file_name);
+              pipeline->write_status = FAILURE;
+            }
+          else
+            count_stat (STAT_BYTES_WRITTEN, nw);
+        }
+      eof_flag = block->eof_flag;
+      push_block (&pipeline->free_out, block);
+    }
+  while (!eof_flag);
+
+  return NULL;
+}
+
+/* Copies in to out and replaces pattern by replacement with function.  A
+   reader thread hands blocks of complete lines to the calling thread, which
+   rewrites them with function and hands the results to a writer thread, so
+   that reading, matching and writing overlap.  If the threads cannot be
+   started, function copies in to out directly.  */
+int
+replace_pipeline (buffer_t *buf, FILE *in, FILE *out, pattern_t *pattern,
+                  const replace_t *replacement, const char *file_name,
+                  chunk_function_t function)
+{
+  pipeline_t *pipeline;
+  pthread_t reader, writer;
+  buffer_t work; /* Buffers for rewriting a block.  */
+  block_t *in_block, *out_block;
+  bool eof_flag;
+  int rr, err, i;
+
+  if (fflush (out) != 0)
+    {
+      rrep_error (ERR_WRITE_OUTPUT, file_name);
+      return FAILURE;
+    }
+  pipeline = (pipeline_t *) calloc (1, sizeof (pipeline_t));
+  if (pipeline == NULL || init_buffer (&work) != SUCCESS)
+    {
+      free (pipeline);
+      return function (buf, in, out, pattern, replacement, file_name, NULL,
+                       0, -1, false, NULL);
+    }
+  pipeline->in_fd = fileno (in);
+  pipeline->out_fd = fileno (out);
+  pipeline->file_name = file_name;
+  pipeline->write_status = SUCCESS;
+  init_ring (&pipeline->free_in);
+  init_ring (&pipeline->full_in);
+  init_ring (&pipeline->free_out);
+  init_ring (&pipeline->full_out);
+  for (i = 0; i < NBLOCKS; i++)
+    {
+      push_block (&pipeline->free_in, &pipeline->in_blocks[i]);
+      push_block (&pipeline->free_out, &pipeline->out_blocks[i]);
+    }
+
+  if (pthread_create (&reader, NULL, run_reader, pipeline) != 0)
+    rr = function (buf, in, out, pattern, replacement, file_name, NULL, 0,
+                   -1, false, NULL);
+  else if ((err = pthread_create (&writer, NULL, run_writer, pipeline)) != 0)
+    {
+      /* Let the reader run into the end of the pipeline.  */
+      pthread_cancel (reader);
+      pthread_join (reader, NULL);
+      rr = FAILURE;
+      errno = err;
+      rrep_error (ERR_CREATE_THREAD, NULL);
+    }
+  else
+    {
+      /* Rewrite each block as a mapping into the file buffer of work, which
+         is taken from an output block.  */
+      rr = SUCCESS;
+      do
+        {
+          in_block = pop_block (&pipeline->full_in);
+          out_block = pop_block (&pipeline->free_out);
+          eof_flag = in_block->eof_flag;
+          out_block->len = 0;
+          if (in_block->status != SUCCESS)
+            rr = FAILURE;
+          else if (in_block->len > 0)
+            {
+              map_memory (&work, in_block->data, in_block->len);
+              work.file_buffer = out_block->data;
+              work.file_buffer_size = out_block->size;
+              rr = function (&work, in, NULL, pattern, replacement,
+                             file_name, NULL, 0, -1, false, &out_block->len);
+              out_block->data = work.file_buffer;
+              out_block->size = work.file_buffer_size;
+            }
+          out_block->eof_flag = eof_flag || rr != SUCCESS;
+          push_block (&pipeline->free_in, in_block);
+          push_block (&pipeline->full_out, out_block);
+        }
+      while (!eof_flag && rr == SUCCESS);
+
+      if (!eof_flag)
+        pthread_cancel (reader);
+      pthread_join (reader, NULL);
+      pthread_join (writer, NULL);
+      if (pipeline->write_status != SUCCESS)
+        rr = FAILURE;
+    }
+
+  work.file_buffer = NULL;
+  work.map = NULL;
+  free_buffer (&work);
+  for (i = 0; i < NBLOCKS; i++)
+    {
+      free (pipeline->in_blocks[i].data);
+      free (pipeline->out_blocks[i].data);
+    }
+  destroy_ring (&pipeline->free_in);
+  destroy_ring (&pipeline->full_in);
+  destroy_ring (&pipeline->free_out);
+  destroy_ring (&pipeline->full_out);
+  free (pipeline);
+
+  return rr;
+}
+
+#else /* !HAVE_STDATOMIC_H */
+
+/* Copies in to out and replaces pattern by replacement with function.
+   Without atomic operations for the rings, the stages run one after another
+   in the calling thread.  */
+int
+replace_pipeline (buffer_t *buf, FILE *in, FILE *out, pattern_t *pattern,
+                  const replace_t *replacement, const char *file_name,
+                  chunk_function_t function)
+{
+  return function (buf, in, out, pattern, replacement, file_name, NULL, 0, -1,
+                   false, NULL);
+}
+
+#endif /* !HAVE_STDATOMIC_H */
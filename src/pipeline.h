@@ -0,0 +1,26 @@
+/* pipeline.h - declarations for the streaming pipeline of rrep.
+   Copyright (C) 2026 Arno Onken <asnelt@asnelt.org>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA
+   02110-1301, USA.  */
+
+/* Copies in to out and replaces pattern by replacement with function.  A
+   reader thread hands blocks of complete lines to the calling thread, which
+   rewrites them with function and hands the results to a writer thread, so
+   that reading, matching and writing overlap.  If the threads cannot be
+   started, function copies in to out directly.  */
+extern int replace_pipeline (buffer_t *, FILE *, FILE *, pattern_t *,
+                             const replace_t *, const char *,
+                             chunk_function_t);
@@ -19,28 +19,45 @@
 #include <config.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <limits.h>
 #include <stdbool.h>
 #include <string.h>
+#include <errno.h>
 #include <unistd.h>
 #include <dirent.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <regex.h>
-#include <utime.h>
 #include <locale.h>
 #include <getopt.h>
+#include <time.h>
 #include "gettext.h"
 #include "progname.h"
 #include "backupfile.h"
 #include "copy-file.h"
-#include "exclude.h"
+#include "opendirat.h"
+#include "stat-time.h"
+#include "tempname.h"
+#include "acl.h"
 #include "rrep.h"
 #include "messages.h"
 #include "bufferio.h"
 #include "pattern.h"
+#include "search.h"
+#include "index.h"
+#include "jobs.h"
+#include "pipeline.h"
+#include "stats.h"
+#include "names.h"
+#include "ignore.h"
+#include "cache.h"
 
-static char const short_options[] = "EFRrS:Vabe:hip:qswx";
+/* Minimal length of an unchanged span that is copied with copy_file_range
+   instead of being written from user space.  */
+#define MIN_COPY_SIZE (65536)
+
+static char const short_options[] = "EFRrS:Vabe:hij:p:qswx";
 
 /* Long options that have no equivalent short option.  */
 enum
@@ -49,9 +66,20 @@ enum
   EXCLUDE_OPTION,
   EXCLUDE_DIR_OPTION,
   BINARY_OPTION,
+  BUFFER_LIMIT_OPTION,
   DRY_RUN_OPTION,
+  DFA_CACHE_OPTION,
+  ATOMIC_OPTION,
+  FSYNC_OPTION,
+  PAIRS_FILE_OPTION,
   KEEP_TIMES_OPTION,
-  INTERACTIVE_OPTION
+  INTERACTIVE_OPTION,
+  STATS_OPTION,
+  GITIGNORE_OPTION,
+  BUILD_INDEX_OPTION,
+  USE_INDEX_OPTION,
+  NO_MATCH_CACHE_OPTION,
+  FILES0_FROM_OPTION
 };
 
 /* Long options equivalences.  */
@@ -67,55 +95,107 @@ static struct option const long_options[] =
   {"suffix", required_argument, NULL, 'S'},
   {"version", no_argument, NULL, 'V'},
   {"all", no_argument, NULL, 'a'},
+  {"atomic", no_argument, NULL, ATOMIC_OPTION},
   {"backup", optional_argument, NULL, 'b'},
   {"binary", no_argument, NULL, BINARY_OPTION},
+  {"buffer-limit", required_argument, NULL, BUFFER_LIMIT_OPTION},
+  {"build-index", required_argument, NULL, BUILD_INDEX_OPTION},
   {"dry-run", no_argument, NULL, DRY_RUN_OPTION},
+  {"dfa-cache", required_argument, NULL, DFA_CACHE_OPTION},
+  {"files0-from", required_argument, NULL, FILES0_FROM_OPTION},
   {"regex", required_argument, NULL, 'e'},
+  {"fsync", no_argument, NULL, FSYNC_OPTION},
+  {"gitignore", no_argument, NULL, GITIGNORE_OPTION},
   {"help", no_argument, NULL, 'h'},
   {"ignore-case", no_argument, NULL, 'i'},
+  {"jobs", required_argument, NULL, 'j'},
   {"keep-times", no_argument, NULL, KEEP_TIMES_OPTION},
   {"replace-with", no_argument, NULL, 'p'},
+  {"pairs-file", required_argument, NULL, PAIRS_FILE_OPTION},
   {"interactive", no_argument, NULL, INTERACTIVE_OPTION},
   {"quiet", no_argument, NULL, 'q'},
   {"silent", no_argument, NULL, 'q'},
   {"no-messages", no_argument, NULL, 's'},
+  {"no-match-cache", required_argument, NULL, NO_MATCH_CACHE_OPTION},
+  {"stats", optional_argument, NULL, STATS_OPTION},
+  {"use-index", no_argument, NULL, USE_INDEX_OPTION},
   {"word-regexp", no_argument, NULL, 'w'},
   {"line-regexp", no_argument, NULL, 'x'},
   {NULL, 0, NULL, 0}
 };
 
-static struct exclude *included_patterns = NULL;
-static struct exclude *excluded_patterns = NULL;
-static struct exclude *excluded_directory_patterns = NULL;
+/* Data structure for a directory on the stack of a directory walk.  */
+typedef struct
+{
+  DIR *d; /* Directory stream.  */
+  int fd; /* File descriptor of the directory.  */
+  size_t name_offset; /* Offset of the directory name in the path arena.  */
+  size_t path_len; /* Length of the directory path in the path arena.  */
+  struct timespec times[2]; /* Directory times.  */
+  bool times_saved; /* Flag for time keeping.  */
+  ignore_t *ignore; /* Rules of ignore files for the entries or NULL.  */
+} walk_dir_t;
+
+/* Data structure for a directory walk.  */
+typedef struct
+{
+  walk_dir_t *dirs; /* Stack of open directories.  */
+  size_t ndirs; /* Number of directories on the stack.  */
+  size_t dirs_size; /* Number of allocated directories.  */
+  char *path; /* Path arena that holds the path of the current entry.  */
+  size_t path_size; /* Size of path.  */
+  const index_t *index; /* Index of the walked directory or NULL.  */
+} walk_t;
+
+/* Patterns of --include, --exclude and --exclude-dir.  */
+static names_t *name_patterns = NULL;
+
+/* Indexes of the directories in the file list, which are freed after all
+   jobs are finished.  */
+static index_t **indexes = NULL;
+
+/* Number of indexes.  */
+static size_t nindexes = 0;
+
+/* Files that did not match in earlier runs or NULL.  */
+static cache_t *no_match_cache = NULL;
 
 enum backup_type backup_method = no_backups;
 
 /* Option flags set by arguments.  */
 int options = 0;
 
-/* Writes string to fp or file_buffer and reallocates memory of file_buffer if
-   necessary.  *pos points to the end of the written string.  */
+/* Memory limit for the state cache of the DFA in bytes.  */
+size_t dfa_cache_size = DFA_CACHE_SIZE*1024;
+
+/* Size up to which buffers are kept for the next file in bytes.  */
+size_t buffer_limit = BUFFER_LIMIT*1024;
+
+/* Number of files that are processed in parallel.  */
+static size_t jobs = 1;
+
+/* Writes string to fp or the file_buffer of buf and reallocates memory of
+   file_buffer if necessary.  *pos points to the end of the written string.  */
 static inline int
-write_string (FILE *fp, const char *string, const size_t string_len,
-              const char *file_name, char **pos)
+write_string (buffer_t *buf, FILE *fp, const char *string,
+              const size_t string_len, const char *file_name, char **pos)
 {
-  char *tmp;
+  size_t used; /* Number of characters in file_buffer.  */
 
   if (fp == NULL)
     {
       /* Check if remaining file_buffer space is sufficient.  */
-      while (file_buffer_size-(*pos-file_buffer) < string_len)
+      used = *pos - buf->file_buffer;
+      if (buf->file_buffer_size-used < string_len)
         {
           /* Reallocate memory.  */
-          tmp = realloc (file_buffer, file_buffer_size+INIT_BUFFER_SIZE);
-          if (tmp == NULL)
+          if (grow_buffer (&buf->file_buffer, &buf->file_buffer_size,
+                           used+string_len) != SUCCESS)
             {
               rrep_error (ERR_REALLOC_FILEBUFFER, file_name);
               return FAILURE;
             }
-          *pos = tmp + (*pos - file_buffer);
-          file_buffer = tmp;
-          file_buffer_size += INIT_BUFFER_SIZE;
+          *pos = buf->file_buffer + used;
         }
       /* Copy string to file_buffer and increase pos.  */
       memcpy (*pos, string, string_len * sizeof (char));
@@ -129,35 +209,44 @@ write_string (FILE *fp, const char *string, const size_t string_len,
   return SUCCESS;
 }
 
-/* Writes the replacement to fp or file_buffer.  *pos points to the end
+/* Writes the replacement to fp or file_buffer.  With a pairs file, the
+   replacement of the pair with index pair is written.  *pos points to the end
    of the written string.  */
 static inline int
-write_replacement (FILE *fp, const char *start, const regmatch_t *match,
-                   const replace_t *replacement, const char *file_name,
-                   char **pos)
+write_replacement (buffer_t *buf, FILE *fp, const char *start,
+                   const regmatch_t *match, const replace_t *replacement,
+                   size_t pair, const char *file_name, char **pos)
 {
   bool failure_flag = false;
   size_t i;
 
-  if (options & OPT_FIXED)
+  if (replacement->npairs > 0)
+    {
+      /* REPLACEMENT is the fixed string of a pair.  */
+      failure_flag |= write_string (buf, fp, replacement->pairs[pair],
+                                    replacement->pair_len[pair], file_name,
+                                    pos);
+    }
+  else if (options & OPT_FIXED)
     {
       /* REPLACEMENT is a fixed string.  */
-      failure_flag |= write_string (fp, replacement->string,
+      failure_flag |= write_string (buf, fp, replacement->string,
                                     replacement->string_len, file_name, pos);
     }
   else
     {
-      failure_flag |= write_string (fp, replacement->part[0],
+      failure_flag |= write_string (buf, fp, replacement->part[0],
                                     replacement->part_len[0], file_name, pos);
       for (i = 0; i < replacement->nsub; i++)
         {
           /* Match for next index available?  */
           if (match[replacement->sub[i]].rm_so > -1)
             failure_flag |=
-              write_string (fp, start + match[replacement->sub[i]].rm_so,
+              write_string (buf, fp,
+                            start + match[replacement->sub[i]].rm_so,
                             match[replacement->sub[i]].rm_eo
                             - match[replacement->sub[i]].rm_so, file_name, pos);
-          failure_flag |= write_string (fp, replacement->part[i+1],
+          failure_flag |= write_string (buf, fp, replacement->part[i+1],
                                         replacement->part_len[i+1], file_name,
                                         pos);
         }
@@ -169,67 +258,226 @@ write_replacement (FILE *fp, const char *start, const regmatch_t *match,
   return SUCCESS;
 }
 
-/* Copies in to out and replaces pattern by replacement.  */
+/* Writes the len unchanged bytes at offset in the regular file in to out.
+   If *copy_flag is set, long spans are copied inside the kernel with
+   copy_file_range, which can share extents on file systems with reflinks.
+   *copy_flag is cleared if copy_file_range is not supported for the files.
+   Otherwise the bytes are written from the mapping of in or read with
+   pread.  */
+static int
+write_span (buffer_t *buf, FILE *in, FILE *out, off_t offset, size_t len,
+            const char *file_name, bool *copy_flag)
+{
+  char chunk[BUFSIZ];
+  off_t end;
+  ssize_t nc; /* Number of characters copied or read.  */
+
+  end = offset + len;
+  if (*copy_flag && len >= MIN_COPY_SIZE)
+    {
+      if (fflush (out) != 0)
+        {
+          rrep_error (ERR_WRITE_TEMP, file_name);
+          return FAILURE;
+        }
+      while (offset < end)
+        {
+          nc = copy_file_range (fileno (in), &offset, fileno (out), NULL,
+                                end-offset, 0);
+          if (nc > 0)
+            continue;
+          if (nc < 0 && (errno == EXDEV || errno == ENOSYS || errno == EINVAL
+                         || errno == EOPNOTSUPP || errno == EBADF))
+            {
+              /* Fall back to copying in user space.  */
+              *copy_flag = false;
+              break;
+            }
+          rrep_error (nc < 0 ? ERR_WRITE_TEMP : ERR_READ_FILE, file_name);
+          return FAILURE;
+        }
+    }
+
+  if (buf->map != NULL)
+    {
+      if (fwrite (buf->map+(offset-buf->map_offset), sizeof (char),
+                  end-offset, out)
+          != (size_t) (end-offset))
+        {
+          rrep_error (ERR_WRITE_TEMP, file_name);
+          return FAILURE;
+        }
+      return SUCCESS;
+    }
+  while (offset < end)
+    {
+      nc = pread (fileno (in), chunk, end-offset < BUFSIZ ? end-offset
+                  : BUFSIZ, offset);
+      if (nc <= 0)
+        {
+          rrep_error (ERR_READ_FILE, file_name);
+          return FAILURE;
+        }
+      if (fwrite (chunk, sizeof (char), nc, out) != (size_t) nc)
+        {
+          rrep_error (ERR_WRITE_TEMP, file_name);
+          return FAILURE;
+        }
+      offset += nc;
+    }
+
+  return SUCCESS;
+}
+
+/* Skips the lines of the mapped file in buf behind *line that cannot contain a
+   match of pattern, so that the next read_line returns the first line with a
+   candidate from locate_pattern.  The length of the skipped lines is stored
+   in *skipped.  If binary files are ignored and the skipped lines contain a
+   null character, BINARY_FOUND is returned.  */
+static int
+skip_lines (buffer_t *buf, pattern_t *pattern, char **line, size_t *skipped)
+{
+  const char *rest, *candidate, *end;
+  size_t rest_len;
+
+  *skipped = 0;
+  if (buf->map == NULL || !can_locate (pattern))
+    return SUCCESS;
+  rest_len = get_rest (buf, line, &rest);
+  candidate = locate_pattern (pattern, rest, rest_len);
+  if (candidate == NULL)
+    *skipped = rest_len;
+  else
+    {
+      /* Find the start of the line with the candidate.  */
+      end = memrchr (rest, '\n', candidate-rest);
+      if (end != NULL)
+        *skipped = end-rest+1;
+    }
+  if (!(options & OPT_BINARY) && memchr (rest, '\0', *skipped) != NULL)
+    return BINARY_FOUND;
+  skip_rest (buf, *skipped);
+
+  return SUCCESS;
+}
+
+/* Copies in to out and replaces pattern by replacement.  If line is not NULL,
+   it is the current line of in with length line_len that was already read by
+   read_line, and copying starts with this line.  If in is a regular file,
+   offset is the position of the first line in it and runs of unchanged lines
+   are copied with write_span, otherwise offset is -1.  If binary files are
+   ignored and check_binary_flag is set, BINARY_FOUND is returned as soon as a
+   line contains a null character.  */
 int
-replace_string (FILE *in, FILE *out, pattern_t *pattern,
+replace_string (buffer_t *buf, FILE *in, FILE *out, pattern_t *pattern,
                 const replace_t *replacement, const char *file_name,
-                size_t *file_len)
+                char *line, size_t line_len, off_t offset,
+                bool check_binary_flag, size_t *file_len)
 {
-  size_t line_len;
-  char *line, *start, *pos;
+  char *start;
+  char *pos = NULL; /* Current position in file_buffer if out is NULL.  */
+  off_t span_start; /* Position of unchanged lines in in.  */
+  size_t span_len; /* Length of unchanged lines.  */
+  size_t skipped; /* Length of lines skipped by skip_lines.  */
+  bool read_flag; /* Flag for reading the next line.  */
+  bool span_flag; /* Flag for deferring unchanged lines.  */
+  bool copy_flag; /* Flag for copying with copy_file_range.  */
   int rr; /* Return value of read_line.  */
   int errcode; /* Return value of regexec.  */
   regmatch_t match[10]; /* Matched regular expression.  */
   bool last_empty_flag; /* Last regular expression had zero length.  */
   bool break_flag; /* Signals break of while loop.  */
-  char tmp_c; /* Buffer for a single character.  */
 
   if (out == NULL)
     {
       /* Try to use file_buffer instead of tmpfile.  */
-      if (file_buffer == NULL)
+      if (buf->file_buffer == NULL
+          && grow_buffer (&buf->file_buffer, &buf->file_buffer_size,
+                          INIT_BUFFER_SIZE) != SUCCESS)
         {
-          file_buffer = (char *) malloc (INIT_BUFFER_SIZE * sizeof (char));
-          if (file_buffer == NULL)
-            {
-              rrep_error (ERR_ALLOC_FILEBUFFER, file_name);
-              return FAILURE;
-            }
-          file_buffer_size = INIT_BUFFER_SIZE;
+          rrep_error (ERR_ALLOC_FILEBUFFER, file_name);
+          return FAILURE;
         }
       /* Current position in file_buffer.  */
-      pos = file_buffer;
+      pos = buf->file_buffer;
     }
 
-  line = NULL;
+  span_flag = (out != NULL && offset >= 0);
+  span_start = offset;
+  span_len = 0;
+  copy_flag = true;
+  read_flag = (line == NULL);
   /* Copy in to out with replaced string.  */
-  while ((rr = read_line (in, &line, &line_len, file_name)) == SUCCESS)
+  for (;;)
     {
+      if (read_flag)
+        {
+          if (span_flag)
+            {
+              /* Defer lines that cannot contain a match.  */
+              rr = skip_lines (buf, pattern, &line, &skipped);
+              if (rr != SUCCESS)
+                return rr;
+              if (span_len == 0)
+                span_start = offset;
+              span_len += skipped;
+              offset += skipped;
+            }
+          rr = read_line (buf, in, &line, &line_len, file_name);
+          if (rr != SUCCESS)
+            break;
+        }
+      read_flag = true;
+
+      if (check_binary_flag && !(options & OPT_BINARY)
+          && memchr (line, '\0', line_len) != NULL)
+        return BINARY_FOUND;
+
       start = line;
       last_empty_flag = true;
+      errcode = match_pattern (pattern, line, line_len, start, match);
+      if (span_flag)
+        {
+          if (errcode == REG_NOMATCH)
+            {
+              /* Defer unchanged line.  */
+              if (span_len == 0)
+                span_start = offset;
+              span_len += line_len;
+              offset += line_len;
+              continue;
+            }
+          if (span_len > 0)
+            {
+              if (write_span (buf, in, out, span_start, span_len, file_name,
+                              &copy_flag) != SUCCESS)
+                return FAILURE;
+              span_len = 0;
+            }
+        }
       /* Search for regular expression or pattern string.  */
-      while ((errcode = match_pattern (pattern, line, start, match)) == 0)
+      for (; errcode == 0;
+           errcode = match_pattern (pattern, line, line_len, start, match))
         {
-          break_flag = (*start == '\0');
+          break_flag = (start == line+line_len);
           if (break_flag && start > line && *(start-1) == '\n')
             break;
 
           if (match[0].rm_eo > 0)
             {
-              /* Save character in tmp_c.  */
-              tmp_c = *(start+match[0].rm_so);
               /* Write beginning of line before matched pattern.  */
-              *(start+match[0].rm_so) = '\0';
-              if (write_string (out, start, match[0].rm_so, file_name, &pos)
-                  != SUCCESS)
+              if (write_string (buf, out, start, match[0].rm_so, file_name,
+                                &pos) != SUCCESS)
                 return FAILURE;
-              /* Restore character from tmp_c.  */
-              *(start+match[0].rm_so) = tmp_c;
             }
           if (last_empty_flag || match[0].rm_eo > 0)
-            if (write_replacement (out, start, match, replacement, file_name,
-                                   &pos) != SUCCESS)
-              return FAILURE;
+            {
+              if (write_replacement (buf, out, start, match, replacement,
+                                     pattern->pair, file_name, &pos)
+                  != SUCCESS)
+                return FAILURE;
+              count_stat (STAT_MATCHES, 1);
+            }
 
           if (break_flag)
             break;
@@ -237,7 +485,8 @@ replace_string (FILE *in, FILE *out, pattern_t *pattern,
           if (match[0].rm_eo == 0)
             {
               /* Found string has zero length.  */
-              if (write_string (out, start, 1, file_name, &pos) != SUCCESS)
+              if (write_string (buf, out, start, 1, file_name, &pos)
+                  != SUCCESS)
                 return FAILURE;
 
               start++;
@@ -255,13 +504,20 @@ replace_string (FILE *in, FILE *out, pattern_t *pattern,
           return FAILURE;
         }
       /* Flush rest of line into out or file_buffer.  */
-      if (write_string (out, start, line_len-(start-line), file_name, &pos)
-          != SUCCESS)
+      if (write_string (buf, out, start, line_len-(start-line), file_name,
+                        &pos) != SUCCESS)
+        return FAILURE;
+      offset += line_len;
+    }
+  if (rr == END_REACHED && span_len > 0)
+    {
+      if (write_span (buf, in, out, span_start, span_len, file_name,
+                      &copy_flag) != SUCCESS)
         return FAILURE;
     }
   /* Set file_len if we are using file_buffer.  */
   if (out == NULL && file_len != NULL)
-    *file_len = pos - file_buffer;
+    *file_len = pos - buf->file_buffer;
 
   /* End of file reached?  */
   if (rr != END_REACHED)
@@ -293,178 +549,542 @@ backup_file (const char *file_name)
   return SUCCESS;
 }
 
-/* Replace pattern by replacement in the file file_name.  */
+/* Opens the file file_name relative to the directory dir_fd with the open
+   flags and returns a stream with the fopen mode.  */
+static FILE *
+open_file_at (int dir_fd, const char *file_name, int flags, const char *mode)
+{
+  FILE *fp;
+  int fd;
+
+  fd = openat (dir_fd, file_name, flags);
+  if (fd < 0)
+    return NULL;
+  fp = fdopen (fd, mode);
+  if (fp == NULL)
+    close (fd);
+
+  return fp;
+}
+
+/* Writes the len bytes in tmp or, if tmp is NULL, in the file_buffer of buf
+   over the file file_name relative to dir_fd, starting at offset.  The bytes
+   before offset are left untouched and the file is truncated behind the
+   written bytes.  */
+static int
+overwrite_file (buffer_t *buf, int dir_fd, const char *file_name,
+                const char *path, FILE *tmp, off_t offset, size_t len)
+{
+  FILE *fp;
+  off_t copied; /* Number of characters copied from tmp.  */
+  size_t nr; /* Number of characters read by fread.  */
+
+  fp = open_file_at (dir_fd, file_name, O_WRONLY, "w");
+  if (fp == NULL)
+    {
+      rrep_error (ERR_OPEN_WRITE, path);
+      return FAILURE;
+    }
+  if (fseeko (fp, offset, SEEK_SET) != 0)
+    {
+      rrep_error (ERR_OVERWRITE, path);
+      fclose (fp);
+      return FAILURE;
+    }
+  if (tmp == NULL)
+    {
+      /* Use file_buffer.  */
+      if (fwrite (buf->file_buffer, sizeof (char), len, fp) != len)
+        {
+          rrep_error (ERR_OVERWRITE, path);
+          fclose (fp);
+          return FAILURE;
+        }
+    }
+  else
+    {
+      /* Use tmp.  Copy inside the kernel where the files allow it, like
+         write_span.  */
+      copied = 0;
+      while ((size_t) copied < len
+             && copy_file_range (fileno (tmp), &copied, fileno (fp), NULL,
+                                 len-copied, 0) > 0)
+        ;
+      /* Copy the rest in user space.  */
+      if (fseeko (tmp, copied, SEEK_SET) != 0
+          || fseeko (fp, offset+copied, SEEK_SET) != 0)
+        {
+          rrep_error (ERR_OVERWRITE, path);
+          fclose (fp);
+          return FAILURE;
+        }
+      while (!feof (tmp))
+        {
+          nr = fread (buf->buffer, sizeof (char), buf->buffer_size, tmp);
+          if (nr != buf->buffer_size && ferror (tmp))
+            {
+              rrep_error (ERR_READ_TEMP, path);
+              fclose (fp);
+              return FAILURE;
+            }
+          if (fwrite (buf->buffer, sizeof (char), nr, fp) != nr)
+            {
+              rrep_error (ERR_OVERWRITE, path);
+              fclose (fp);
+              return FAILURE;
+            }
+        }
+    }
+  /* Cut off the rest of a longer original file.  */
+  if (fflush (fp) != 0 || ftruncate (fileno (fp), offset + len) != 0
+      || ((options & OPT_FSYNC) && fsync (fileno (fp)) != 0))
+    {
+      rrep_error (ERR_OVERWRITE, path);
+      fclose (fp);
+      return FAILURE;
+    }
+  if (fclose (fp) != 0)
+    {
+      rrep_error (ERR_OVERWRITE, path);
+      return FAILURE;
+    }
+
+  return SUCCESS;
+}
+
+/* Creates a temporary file with the name in the template tmpl relative to the
+   directory file descriptor in args.  */
+static int
+try_create_file (char *tmpl, void *args)
+{
+  return openat (*(int *) args, tmpl, O_RDWR | O_CREAT | O_EXCL, S_IRUSR
+                 | S_IWUSR);
+}
+
+/* Creates a temporary file in the directory of the file file_name relative to
+   dir_fd and returns a stream for writing it.  The name of the temporary file
+   relative to dir_fd is stored in *tmp_name.  */
+static FILE *
+create_temp_file (int dir_fd, const char *file_name, const char *path,
+                  char **tmp_name)
+{
+  FILE *fp;
+  const char *base_name;
+  size_t dir_len; /* Length of the directory part of file_name.  */
+  int fd;
+
+  base_name = strrchr (file_name, '/');
+  dir_len = base_name == NULL ? 0 : base_name-file_name+1;
+  *tmp_name = (char *) malloc (dir_len+sizeof (".rrepXXXXXX"));
+  if (*tmp_name == NULL)
+    {
+      rrep_error (ERR_MEMORY, path);
+      return NULL;
+    }
+  memcpy (*tmp_name, file_name, dir_len);
+  strcpy (*tmp_name+dir_len, ".rrepXXXXXX");
+  fd = try_tempname (*tmp_name, 0, &dir_fd, try_create_file);
+  if (fd < 0)
+    {
+      rrep_error (ERR_CREATE_TEMP, path);
+      free (*tmp_name);
+      *tmp_name = NULL;
+      return NULL;
+    }
+  fp = fdopen (fd, "w");
+  if (fp == NULL)
+    {
+      rrep_error (ERR_CREATE_TEMP, path);
+      close (fd);
+      unlinkat (dir_fd, *tmp_name, 0);
+      free (*tmp_name);
+      *tmp_name = NULL;
+    }
+
+  return fp;
+}
+
+/* Closes the output tmp, if any, and removes it if it is the temporary file
+   tmp_name relative to dir_fd.  */
+static void
+discard_output (int dir_fd, FILE *tmp, char *tmp_name)
+{
+  if (tmp != NULL)
+    fclose (tmp);
+  if (tmp_name != NULL)
+    {
+      unlinkat (dir_fd, tmp_name, 0);
+      free (tmp_name);
+    }
+}
+
+/* Gives the temporary file tmp with the name tmp_name the owner, mode and
+   access control list of the original file in and renames it over the file
+   file_name relative to dir_fd, so that file_name is never left partially
+   written.  tmp and tmp_name are released in any case.  */
+static int
+rename_file (int dir_fd, const char *file_name, const char *path, FILE *in,
+             FILE *tmp, char *tmp_name)
+{
+  struct stat st;
+  char *base_name;
+  int sync_fd;
+
+  if (fflush (tmp) != 0)
+    {
+      rrep_error (ERR_WRITE_TEMP, path);
+      discard_output (dir_fd, tmp, tmp_name);
+      return FAILURE;
+    }
+  if (fstat (fileno (in), &st) != 0)
+    {
+      rrep_error (ERR_READ_FILE, path);
+      discard_output (dir_fd, tmp, tmp_name);
+      return FAILURE;
+    }
+  /* Copy owner, mode and access control list.  The owner can only be kept
+     with sufficient privileges.  */
+  if (fchown (fileno (tmp), st.st_uid, st.st_gid) != 0)
+    st.st_mode &= ~(S_ISUID | S_ISGID);
+  if (qcopy_acl (path, fileno (in), tmp_name, fileno (tmp), st.st_mode) != 0)
+    {
+      rrep_error (ERR_COPY_ACL, path);
+      discard_output (dir_fd, tmp, tmp_name);
+      return FAILURE;
+    }
+  if ((options & OPT_FSYNC) && fsync (fileno (tmp)) != 0)
+    {
+      rrep_error (ERR_WRITE_TEMP, path);
+      discard_output (dir_fd, tmp, tmp_name);
+      return FAILURE;
+    }
+  if (fclose (tmp) != 0)
+    {
+      rrep_error (ERR_WRITE_TEMP, path);
+      discard_output (dir_fd, NULL, tmp_name);
+      return FAILURE;
+    }
+
+  if (renameat (dir_fd, tmp_name, dir_fd, file_name) != 0)
+    {
+      rrep_error (ERR_RENAME, path);
+      discard_output (dir_fd, NULL, tmp_name);
+      return FAILURE;
+    }
+  if (options & OPT_FSYNC)
+    {
+      /* Make the rename durable.  */
+      base_name = strrchr (tmp_name, '/');
+      if (base_name != NULL)
+        *(base_name+1) = '\0';
+      else
+        strcpy (tmp_name, ".");
+      sync_fd = openat (dir_fd, tmp_name, O_RDONLY | O_DIRECTORY);
+      if (sync_fd >= 0)
+        {
+          fsync (sync_fd);
+          close (sync_fd);
+        }
+    }
+  free (tmp_name);
+
+  return SUCCESS;
+}
+
+/* Replace pattern by replacement in the file file_name, which is relative to
+   the directory dir_fd.  path is the name of the file for messages and
+   backups.  *replaced_flag is set to true if the file was modified or, in
+   simulation mode, would have been modified.  The file is read only once:
+   lines are scanned until the first match and the rewrite continues from the
+   matching line.  The unchanged prefix is not written again or, with
+   OPT_ATOMIC, copied with copy_file_range.  */
 int
-process_file (const char *relative_path, const char *file_name,
-              pattern_t *pattern, const replace_t *replacement)
+process_file (buffer_t *buf, int dir_fd, const char *file_name,
+              const char *path, pattern_t *pattern,
+              const replace_t *replacement, bool *replaced_flag)
 {
   FILE *fp, *tmp;
-  char *line;
+  struct stat st; /* The stat for detecting symbolic links.  */
+  char *line, *tmp_name;
   size_t line_len, file_len;
-  regmatch_t match[10]; /* Matched regular expression.  */
+  off_t prefix_len; /* Length of the lines before the first match.  */
+  size_t skipped; /* Length of lines skipped by skip_lines.  */
   int rr; /* Return value of read_line.  */
   int errcode; /* Return value of regexec.  */
-  size_t path_len;
-  bool found_flag; /* Flag for pattern found.  */
+  bool copy_flag; /* Flag for copying with copy_file_range.  */
+  uintmax_t matches; /* Matches counted before the rewrite.  */
 
-  fp = fopen (file_name, "r");
+  *replaced_flag = false;
+  fp = open_mapped (buf, dir_fd, file_name);
   if (fp == NULL)
     {
-      rrep_error (ERR_OPEN_READ, file_name);
+      rrep_error (ERR_OPEN_READ, path);
       return FAILURE;
     }
+  count_stat (STAT_FILES_SCANNED, 1);
 
-  /* Check whether file file_name contains pattern at all.  */
-  found_flag = false;
+  /* Scan file file_name up to the first line that contains pattern.  */
+  prefix_len = 0;
   line = NULL;
-  while ((!found_flag || !(options & OPT_BINARY))
-         && (rr = read_line (fp, &line, &line_len, file_name))
-         == SUCCESS)
+  for (;;)
     {
+      rr = skip_lines (buf, pattern, &line, &skipped);
+      if (rr != SUCCESS)
+        break;
+      prefix_len += skipped;
+      rr = read_line (buf, fp, &line, &line_len, path);
+      if (rr != SUCCESS)
+        break;
       if (!(options & OPT_BINARY))
         {
           /* Check whether file is binary.  */
           if (memchr (line, '\0', line_len) != NULL)
             {
               /* Null character found, cancel search.  */
-              fclose (fp);
+              count_stat (STAT_FILES_BINARY, 1);
+              close_file (buf, fp);
               return SUCCESS;
             }
         }
-      errcode = match_pattern (pattern, line, line, match);
+      errcode = detect_pattern (pattern, line, line_len);
       if (errcode == 0)
-        found_flag = true;
+        break;
       else if (errcode != REG_NOMATCH)
         {
           print_regerror (errcode, pattern->compiled);
-          fclose (fp);
+          close_file (buf, fp);
           return FAILURE;
         }
+      prefix_len += line_len;
     }
   if (rr == FAILURE)
     {
-      fclose (fp);
+      close_file (buf, fp);
       return FAILURE;
     }
-
-  if (found_flag)
+  if (rr == END_REACHED || rr == BINARY_FOUND)
     {
-      if (options & OPT_DRY && !(options & OPT_QUIET))
-        {
-          printf ("%s\n", file_name);
-          fclose (fp);
-          return SUCCESS;
-        }
-
-      if (options & OPT_PROMPT)
-        {
-          if (prompt_user (file_name) == false)
-            {
-              fclose (fp);
-              return SUCCESS;
-            }
-        }
+      /* Pattern not found or binary file.  */
+      if (rr == BINARY_FOUND)
+        count_stat (STAT_FILES_BINARY, 1);
+      close_file (buf, fp);
+      return SUCCESS;
+    }
 
-      if (options & OPT_BACKUP)
+  if (options & OPT_DRY)
+    {
+      if (!(options & OPT_BINARY))
         {
-          if (backup_file (file_name) != SUCCESS)
+          /* The rest of the file must not be binary either.  */
+          while ((rr = read_line (buf, fp, &line, &line_len, path))
+                 == SUCCESS)
+            if (memchr (line, '\0', line_len) != NULL)
+              {
+                count_stat (STAT_FILES_BINARY, 1);
+                close_file (buf, fp);
+                return SUCCESS;
+              }
+          if (rr == FAILURE)
             {
-              fclose (fp);
+              close_file (buf, fp);
               return FAILURE;
             }
         }
+      count_stat (STAT_FILES_MATCHED, 1);
+      *replaced_flag = true;
+      close_file (buf, fp);
+      return SUCCESS;
+    }
 
-      rewind (fp);
-      tmp = tmpfile ();
-      /* Copy f to tmp or file_buffer with replaced string.  */
-      if (replace_string (fp, tmp, pattern, replacement, file_name, &file_len))
+  switch_phase (PHASE_REWRITE);
+  matches = get_stat (STAT_MATCHES);
+  /* With OPT_ATOMIC, write a complete copy into a temporary file next to f.
+     Symbolic links are written through instead of being replaced.  */
+  tmp_name = NULL;
+  if ((options & OPT_ATOMIC)
+      && fstatat (dir_fd, file_name, &st, AT_SYMLINK_NOFOLLOW) == 0
+      && !S_ISLNK (st.st_mode))
+    {
+      tmp = create_temp_file (dir_fd, file_name, path, &tmp_name);
+      copy_flag = true;
+      if (tmp == NULL
+          || write_span (buf, fp, tmp, 0, prefix_len, path, &copy_flag)
+             != SUCCESS)
         {
-          fclose (fp);
-          if (tmp != NULL)
-            fclose (tmp);
+          discard_output (dir_fd, tmp, tmp_name);
+          close_file (buf, fp);
           return FAILURE;
         }
+    }
+  else
+    tmp = tmpfile ();
+
+  /* Copy the rest of f from the first match on to tmp or file_buffer with
+     replaced string.  Large files are split into chunks that several threads
+     rewrite.  */
+  if (jobs > 1 && tmp != NULL && buf->map != NULL
+      && buf->map_size - prefix_len >= 2 * CHUNK_SIZE)
+    rr = replace_chunks (buf, fp, tmp, pattern, replacement, path, prefix_len,
+                         jobs, replace_string);
+  else
+    rr = replace_string (buf, fp, tmp, pattern, replacement, path, line,
+                         line_len, prefix_len, true, &file_len);
+  if (rr == SUCCESS && tmp != NULL)
+    {
+      if (fflush (tmp) != 0 || fstat (fileno (tmp), &st) != 0)
+        {
+          rrep_error (ERR_WRITE_TEMP, path);
+          rr = FAILURE;
+        }
+      file_len = st.st_size;
+    }
+  if (rr != SUCCESS)
+    {
+      discard_output (dir_fd, tmp, tmp_name);
+      close_file (buf, fp);
+      if (rr == BINARY_FOUND)
+        {
+          count_stat (STAT_FILES_BINARY, 1);
+          return SUCCESS;
+        }
+      return FAILURE;
+    }
+  count_stat (STAT_FILES_MATCHED, 1);
 
-      /* Copy from tmp or file_buffer back to f.  */
-      fp = freopen (file_name, "w", fp);
-      if (fp == NULL)
+  if (options & OPT_PROMPT)
+    {
+      /* Waiting for the user is not part of any phase.  */
+      switch_phase (PHASE_NONE);
+      if (prompt_user (path) == false)
         {
-          rrep_error (ERR_OPEN_WRITE, file_name);
-          if (tmp != NULL)
-            fclose (tmp);
-          return FAILURE;
+          discard_output (dir_fd, tmp, tmp_name);
+          close_file (buf, fp);
+          return SUCCESS;
         }
-      if (tmp == NULL)
+    }
+
+  if (options & OPT_BACKUP)
+    {
+      switch_phase (PHASE_BACKUP);
+      if (backup_file (path) != SUCCESS)
         {
-          /* Use file_buffer.  */
-          if (fwrite (file_buffer, sizeof (char), file_len, fp) != file_len)
-            {
-              rrep_error (ERR_OVERWRITE, file_name);
-              fclose (fp);
-              return FAILURE;
-            }
+          discard_output (dir_fd, tmp, tmp_name);
+          close_file (buf, fp);
+          return FAILURE;
         }
-      else
+    }
+
+  switch_phase (PHASE_COPY_BACK);
+  if (tmp_name != NULL)
+    {
+      /* Replace f by the temporary file.  */
+      rr = rename_file (dir_fd, file_name, path, fp, tmp, tmp_name);
+      close_file (buf, fp);
+    }
+  else
+    {
+      /* Copy from tmp or file_buffer back to f behind the unchanged
+         prefix.  */
+      close_file (buf, fp);
+      rr = overwrite_file (buf, dir_fd, file_name, path, tmp, prefix_len,
+                           file_len);
+      if (tmp != NULL)
+        fclose (tmp);
+    }
+  if (rr != SUCCESS)
+    return FAILURE;
+  *replaced_flag = true;
+  count_stat (STAT_FILES_REWRITTEN, 1);
+  count_stat (STAT_BYTES_WRITTEN, file_len);
+  count_stat (STAT_REPLACEMENTS, get_stat (STAT_MATCHES) - matches);
+
+  return SUCCESS;
+}
+
+/* Processes the regular file file_name relative to the directory dir_fd and
+   keeps its times if requested.  path and *replaced_flag are used as in
+   process_file.  */
+int
+process_regular_file (buffer_t *buf, int dir_fd, const char *file_name,
+                      const char *path, pattern_t *pattern,
+                      const replace_t *replacement, bool *replaced_flag)
+{
+  struct stat st; /* The stat for obtaining file times.  */
+  struct timespec times[2]; /* File times.  */
+  bool stat_flag = false; /* Flag for a valid st.  */
+  bool times_saved = false; /* Flag for time keeping.  */
+  bool failure_flag = false;
+  int result; /* Return value of process_file.  */
+  int phase; /* Phase of the caller.  */
+
+  *replaced_flag = false;
+  if (options & OPT_KEEP_TIMES || no_match_cache != NULL)
+    {
+      /* Obtain file times and the identity of the file.  */
+      if (fstatat (dir_fd, file_name, &st, AT_SYMLINK_NOFOLLOW) == 0)
+        stat_flag = true;
+      else if (options & OPT_KEEP_TIMES)
         {
-          /* Use tmp.  */
-          rewind (tmp);
-          while (!feof (tmp))
-            {
-              line_len = fread (buffer, sizeof (char), buffer_size, tmp);
-              if (line_len != buffer_size && ferror (tmp))
-                {
-                  rrep_error (ERR_READ_TEMP, file_name);
-                  fclose (fp);
-                  fclose (tmp);
-                  return FAILURE;
-                }
-              if (fwrite (buffer, sizeof (char), line_len, fp) != line_len)
-                {
-                  rrep_error (ERR_OVERWRITE, file_name);
-                  fclose (fp);
-                  fclose (tmp);
-                  return FAILURE;
-                }
-            }
-          fclose (tmp);
+          rrep_error (ERR_KEEP_TIMES, path);
+          failure_flag = true;
         }
-      if (!(options & OPT_QUIET))
+    }
+  if (stat_flag && no_match_cache != NULL
+      && cached_no_match (no_match_cache, &st))
+    {
+      count_stat (STAT_FILES_CACHED, 1);
+      return SUCCESS;
+    }
+  if (stat_flag && options & OPT_KEEP_TIMES)
+    {
+      times[0] = get_stat_atime (&st);
+      times[1] = get_stat_mtime (&st);
+      times_saved = true;
+    }
+  phase = switch_phase (PHASE_DETECTION);
+  result = process_file (buf, dir_fd, file_name, path, pattern, replacement,
+                         replaced_flag);
+  switch_phase (phase);
+  failure_flag |= result;
+  /* A file whose match was declined at the prompt is not recorded.  */
+  if (stat_flag && no_match_cache != NULL && result == SUCCESS
+      && !*replaced_flag && !(options & OPT_PROMPT))
+    add_no_match (no_match_cache, &st);
+  /* Release the memory of an unusually large file.  */
+  trim_buffer (buf);
+  if (times_saved)
+    {
+      /* Restore file times.  */
+      if (utimensat (dir_fd, file_name, times, 0) != 0)
         {
-          if (relative_path != NULL)
-            {
-              printf ("%s", relative_path);
-              path_len = strlen (relative_path);
-              if (path_len == 0 || relative_path[path_len-1] != '/')
-                printf ("/");
-            }
-          print_confirmation (file_name);
+          rrep_error (ERR_KEEP_TIMES, path);
+          failure_flag = true;
         }
     }
-  fclose (fp);
+
+  if (failure_flag)
+    return FAILURE;
 
   return SUCCESS;
 }
 
 /* Checks the include and exclude options and returns true if file_name
-   qualifies.  */
+   qualifies.  If dir_flag is set, the name is checked against the
+   --exclude-dir patterns instead.  */
 bool
-check_include_name (const char *file_name, const struct exclude *included_name,
-                    const struct exclude *excluded_name)
+check_include_name (const char *file_name, bool dir_flag)
 {
-  /* Check include option.  */
-  if (included_name && excluded_file_name (included_name, file_name))
-    return false;
-  /* Check excluded option.  */
-  if (excluded_name && excluded_file_name (excluded_name, file_name))
-    return false;
+  int reject = reject_name (name_patterns, file_name);
+
+  if (dir_flag)
+    return !(reject & NAMES_EXCLUDE_DIR);
 
-  return true;
+  return !(reject & (NAMES_INCLUDE | NAMES_EXCLUDE));
 }
 
 /* Returns true if file_name qualifies for processing.  */
 bool
-check_name (const char *file_name, const struct exclude *included_name,
-            const struct exclude *excluded_name)
+check_name (const char *file_name, bool dir_flag)
 {
   if (file_name == NULL || file_name[0] == '\0')
     return false;
@@ -473,128 +1093,150 @@ check_name (const char *file_name, const struct exclude *included_name,
       && !(options & OPT_ALL))
     return false;
 
-  return check_include_name (file_name, included_name, excluded_name);
+  return check_include_name (file_name, dir_flag);
 }
 
-/* Processes the current directory and all subdirectories recursively.  */
+/* Returns ENTRY_FILE if the directory entry of the directory dir_fd is a
+   regular file that qualifies for processing, ENTRY_DIR if it is a directory
+   that qualifies for recursion, or ENTRY_SKIP otherwise.  */
 int
-process_dir (const char *relative_path, pattern_t *pattern,
-             const replace_t *replacement)
+check_entry (int dir_fd, const struct dirent *entry)
 {
-  DIR *d; /* Current directory.  */
-  struct dirent *entry; /* Directory entry.  */
-  struct stat st; /* The stat for obtaining file times.  */
-  struct utimbuf times; /* File times.  */
-  bool times_saved; /* Flag for time keeping.  */
-  bool failure_flag;
-  size_t path_len = strlen (relative_path);
-  size_t next_path_len;
-  char *next_path = NULL; /* The relative_path with directory names
-                             attached.  */
+  struct stat st; /* The stat for obtaining the file type.  */
+  unsigned char type = entry->d_type;
 
-  failure_flag = false;
-  d = opendir (".");
-  if (d == NULL)
+  if (type == DT_UNKNOWN)
     {
-      rrep_error (ERR_OPEN_DIR, NULL);
-      return FAILURE;
+      /* The file system does not report types in entries.  */
+      if (fstatat (dir_fd, entry->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0)
+        {
+          if (S_ISREG (st.st_mode))
+            type = DT_REG;
+          else if (S_ISDIR (st.st_mode))
+            type = DT_DIR;
+        }
+    }
+
+  if (type == DT_REG)
+    {
+      if (check_name (entry->d_name, false))
+        return ENTRY_FILE;
+      if (entry->d_name[0] == '.' && !(options & OPT_ALL))
+        count_stat (STAT_FILES_HIDDEN, 1);
+      else
+        count_stat (STAT_FILES_EXCLUDED, 1);
+      return ENTRY_SKIP;
+    }
+  if (type == DT_DIR && options & OPT_RECURSIVE
+      && strcmp (entry->d_name, ".") && strcmp (entry->d_name, "..")
+      && check_name (entry->d_name, true))
+    return ENTRY_DIR;
+
+  return ENTRY_SKIP;
+}
+
+/* Writes name behind the first len characters of the path arena of walk.  A
+   slash is put between both parts if necessary.  The offset of name in the
+   arena is stored in *name_offset and the new path length in *path_len.  */
+static int
+append_path (walk_t *walk, size_t len, const char *name, size_t *name_offset,
+             size_t *path_len)
+{
+  size_t name_len = strlen (name);
+  size_t size;
+  char *tmp;
+  bool slash_flag; /* Flag for slash between both parts.  */
+
+  slash_flag = (len > 0 && walk->path[len-1] != '/');
+  size = len + name_len + 2;
+  if (size > walk->path_size)
+    {
+      /* Reallocate memory.  */
+      if (size < 2 * walk->path_size)
+        size = 2 * walk->path_size;
+      tmp = realloc (walk->path, size);
+      if (tmp == NULL)
+        {
+          rrep_error (ERR_ALLOC_PATHBUFFER, name);
+          return FAILURE;
+        }
+      walk->path = tmp;
+      walk->path_size = size;
     }
+  if (slash_flag)
+    walk->path[len++] = '/';
+  memcpy (walk->path + len, name, name_len + 1);
+  *name_offset = len;
+  *path_len = len + name_len;
+
+  return SUCCESS;
+}
+
+/* Pushes the opened directory d with file descriptor fd on the stack of walk.
+   The path of the directory must already be in the path arena.  If st is not
+   NULL, the directory times are taken from st and restored when the directory
+   is popped.  With OPT_GITIGNORE, the ignore files of the directory are read
+   and added to the rules of ignore, which belong to the directory above.  An
+   unreadable ignore file is reported in *failure_flag.  */
+static int
+push_dir (walk_t *walk, DIR *d, int fd, size_t name_offset, size_t path_len,
+          const struct stat *st, ignore_t *ignore, bool *failure_flag)
+{
+  walk_dir_t *tmp;
+  walk_dir_t *dir;
+  size_t size;
 
-  while ((entry = readdir (d)))
+  if (walk->ndirs == walk->dirs_size)
     {
-      if (entry->d_type == DT_REG
-          && check_name (entry->d_name, included_patterns, excluded_patterns))
+      /* Reallocate memory.  */
+      size = walk->dirs_size > 0 ? 2 * walk->dirs_size : 16;
+      tmp = realloc (walk->dirs, size * sizeof (walk_dir_t));
+      if (tmp == NULL)
         {
-          /* The entry is a regular file.  */
-          if (options & OPT_KEEP_TIMES)
-            {
-              /* Obtain file times.  */
-              if (lstat (entry->d_name, &st) < 0)
-                {
-                  rrep_error (ERR_KEEP_TIMES, entry->d_name);
-                  failure_flag = true;
-                  times_saved = false;
-                }
-              else
-                {
-                  times.actime = st.st_atime;
-                  times.modtime = st.st_mtime;
-                  times_saved = true;
-                }
-            }
-          failure_flag |= process_file (relative_path, entry->d_name, pattern,
-                                        replacement);
-          if (options & OPT_KEEP_TIMES && times_saved)
-            {
-              /* Restore file times.  */
-              if (utime (entry->d_name, &times) != 0)
-                {
-                  rrep_error (ERR_KEEP_TIMES, entry->d_name);
-                  failure_flag = true;
-                }
-            }
+          rrep_error (ERR_ALLOC_PATHBUFFER, walk->path);
+          return FAILURE;
         }
-      else if (entry->d_type == DT_DIR) /* The entry is a directory.  */
+      walk->dirs = tmp;
+      walk->dirs_size = size;
+    }
+  dir = &walk->dirs[walk->ndirs++];
+  dir->d = d;
+  dir->fd = fd;
+  dir->name_offset = name_offset;
+  dir->path_len = path_len;
+  dir->times_saved = (st != NULL);
+  if (st != NULL)
+    {
+      dir->times[0] = get_stat_atime (st);
+      dir->times[1] = get_stat_mtime (st);
+    }
+  dir->ignore = NULL;
+  if (options & OPT_GITIGNORE
+      && load_ignore (fd, walk->path, ignore, &dir->ignore) != SUCCESS)
+    *failure_flag = true;
+
+  return SUCCESS;
+}
+
+/* Closes the directory on top of the stack of walk and restores its times if
+   they were saved.  */
+static int
+pop_dir (walk_t *walk)
+{
+  walk_dir_t *dir = &walk->dirs[--walk->ndirs];
+  bool failure_flag = false;
+
+  closedir (dir->d);
+  release_ignore (dir->ignore);
+  if (dir->times_saved)
+    {
+      /* Restore file times.  */
+      walk->path[dir->path_len] = '\0';
+      if (utimensat (walk->dirs[walk->ndirs-1].fd,
+                     walk->path + dir->name_offset, dir->times, 0) != 0)
         {
-          if (options & OPT_RECURSIVE && strcmp (entry->d_name, ".")
-              && strcmp (entry->d_name, "..")
-              && check_name (entry->d_name, NULL, excluded_directory_patterns))
-            {
-              if (options & OPT_KEEP_TIMES)
-                {
-                  /* Obtain file times.  */
-                  if (lstat (entry->d_name, &st) < 0)
-                    {
-                      rrep_error (ERR_KEEP_TIMES, entry->d_name);
-                      failure_flag = true;
-                      times_saved = false;
-                    }
-                  else
-                    {
-                      times.actime = st.st_atime;
-                      times.modtime = st.st_mtime;
-                      times_saved = true;
-                    }
-                }
-              /* Recurse into directory.  */
-              if (!chdir (entry->d_name))
-                {
-                  next_path_len = path_len + strlen (entry->d_name);
-                  next_path = (char *) malloc ((next_path_len + 2)
-                                               * sizeof (char));
-                  if (next_path == NULL)
-                    {
-                      rrep_error (ERR_ALLOC_PATHBUFFER, entry->d_name);
-                      return FAILURE;
-                    }
-                  strcpy (next_path, relative_path);
-                  if (path_len == 0 || relative_path[path_len-1] != '/')
-                    strcat (next_path, "/");
-                  strcat (next_path, entry->d_name);
-                  failure_flag |= process_dir (next_path, pattern, replacement);
-                  free (next_path);
-                  next_path = NULL;
-                  if (chdir (".."))
-                    {
-                      rrep_error (ERR_PROCESS_DIR, entry->d_name);
-                      return FAILURE;
-                    }
-                  if (options & OPT_KEEP_TIMES && times_saved)
-                    {
-                      /* Restore file times.  */
-                      if (utime (entry->d_name, &times) != 0)
-                        {
-                          rrep_error (ERR_KEEP_TIMES, entry->d_name);
-                          failure_flag = true;
-                        }
-                    }
-                }
-              else
-                {
-                  rrep_error (ERR_PROCESS_DIR, entry->d_name);
-                  failure_flag = true;
-                }
-            }
+          rrep_error (ERR_KEEP_TIMES, walk->path);
+          failure_flag = true;
         }
     }
 
@@ -604,104 +1246,313 @@ process_dir (const char *relative_path, pattern_t *pattern,
   return SUCCESS;
 }
 
-/* Processes the file_counter files in file_list.  */
+/* Frees the memory that was allocated for the fields of walk.  */
+static void
+free_walk (walk_t *walk)
+{
+  while (walk->ndirs > 0)
+    {
+      closedir (walk->dirs[--walk->ndirs].d);
+      release_ignore (walk->dirs[walk->ndirs].ignore);
+    }
+  if (walk->dirs != NULL)
+    {
+      free (walk->dirs);
+      walk->dirs = NULL;
+    }
+  walk->dirs_size = 0;
+  if (walk->path != NULL)
+    {
+      free (walk->path);
+      walk->path = NULL;
+    }
+  walk->path_size = 0;
+}
+
+/* Processes the opened directory d with file descriptor fd and path
+   relative_path and all subdirectories.  Directories are opened relative to
+   their parent, so the working directory is never changed.  d is closed before
+   returning.  */
 int
-process_file_list (char **file_list, const size_t file_counter,
-                   pattern_t *pattern, const replace_t *replacement)
+process_dir (buffer_t *buf, walk_t *walk, DIR *d, int fd,
+             const char *relative_path, pattern_t *pattern,
+             const replace_t *replacement)
 {
-  struct stat st; /* The stat for obtaining file type.  */
-  struct utimbuf times; /* File times.  */
-  int wd; /* File descriptor for current working directory.  */
-  int i;
-  bool omit_dir_flag = false;
+  walk_dir_t *top; /* Directory on top of the stack.  */
+  struct dirent *entry; /* Directory entry.  */
+  struct stat st; /* The stat for obtaining directory times.  */
+  DIR *next_d; /* Subdirectory.  */
+  int next_fd; /* File descriptor of the subdirectory.  */
+  size_t base = walk->ndirs; /* Stack size of the caller.  */
+  size_t name_offset, path_len;
+  bool replaced_flag; /* Flag for replaced pattern.  */
+  bool times_flag; /* Flag for valid directory times in st.  */
   bool failure_flag = false;
 
-  /* Save current working directory.  */
-  wd = open (".", O_RDONLY);
-  omit_dir_flag = (wd < 0);
-  if (omit_dir_flag)
+  if (append_path (walk, 0, relative_path, &name_offset, &path_len) != SUCCESS
+      || push_dir (walk, d, fd, name_offset, path_len, NULL, NULL,
+                   &failure_flag) != SUCCESS)
     {
-      rrep_error (ERR_SAVE_DIR, NULL);
-      failure_flag = true;
+      closedir (d);
+      return FAILURE;
     }
 
-  /* Process file list.  */
-  for (i = 0; i < file_counter; i++)
+  while (walk->ndirs > base)
     {
-      if (lstat (file_list[i], &st) < 0)
+      top = &walk->dirs[walk->ndirs-1];
+      entry = readdir (top->d);
+      if (entry == NULL)
         {
-          rrep_error (ERR_PROCESS_ARG, file_list[i]);
-          failure_flag = true;
+          /* Directory complete.  */
+          failure_flag |= pop_dir (walk);
           continue;
         }
 
-      if (S_ISDIR (st.st_mode)) /* The st is a directory.  */
+      switch (check_entry (top->fd, entry))
         {
-          if (omit_dir_flag)
+        case ENTRY_FILE:
+          if (append_path (walk, top->path_len, entry->d_name, &name_offset,
+                           &path_len) != SUCCESS)
+            {
+              failure_flag = true;
+              break;
+            }
+          if (options & OPT_GITIGNORE
+              && ignored_path (top->ignore, walk->path, false))
+            {
+              count_stat (STAT_FILES_IGNORED, 1);
+              continue;
+            }
+          if (walk->index != NULL
+              && skip_indexed (walk->index, top->fd, entry->d_name,
+                               walk->path))
             {
-              print_dir_skip (file_list[i]);
+              count_stat (STAT_FILES_INDEXED, 1);
               continue;
             }
-          if (!check_include_name (file_list[i], NULL,
-                                   excluded_directory_patterns))
+          failure_flag |= process_regular_file (buf, top->fd, entry->d_name,
+                                                walk->path, pattern,
+                                                replacement, &replaced_flag);
+          if (replaced_flag)
+            print_found (NULL, walk->path);
+          continue;
+
+        case ENTRY_DIR:
+          if (append_path (walk, top->path_len, entry->d_name, &name_offset,
+                           &path_len) != SUCCESS)
+            {
+              failure_flag = true;
+              break;
+            }
+          /* Ignored directories are not even opened.  */
+          if (options & OPT_GITIGNORE
+              && ignored_path (top->ignore, walk->path, true))
             continue;
-          if (options & OPT_KEEP_TIMES)
+          /* Descend into directory.  */
+          next_d = opendirat (top->fd, entry->d_name, O_NOFOLLOW, &next_fd);
+          if (next_d == NULL)
             {
-              /* Save file times.  */
-              times.actime = st.st_atime;
-              times.modtime = st.st_mtime;
+              rrep_error (ERR_PROCESS_DIR, walk->path);
+              failure_flag = true;
+              continue;
             }
-          if (!chdir (file_list[i]))
+          times_flag = options & OPT_KEEP_TIMES;
+          if (times_flag && fstat (next_fd, &st) < 0)
             {
-              failure_flag |= process_dir (file_list[i], pattern, replacement);
-              /* Return to working directory.  */
-              if (fchdir (wd))
-                {
-                  rrep_error (ERR_PROCESS_DIR, file_list[i]);
-                  close (wd);
-                  return FAILURE;
-                }
-              if (options & OPT_KEEP_TIMES)
-                {
-                  /* Restore file times.  */
-                  if (utime (file_list[i], &times) != 0)
-                    {
-                      rrep_error (ERR_KEEP_TIMES, file_list[i]);
-                      failure_flag = true;
-                    }
-                }
+              /* The times of the directory are left alone.  */
+              rrep_error (ERR_KEEP_TIMES, walk->path);
+              failure_flag = true;
+              times_flag = false;
             }
-          else
+          if (push_dir (walk, next_d, next_fd, name_offset, path_len,
+                        times_flag ? &st : NULL, top->ignore,
+                        &failure_flag) != SUCCESS)
             {
-              rrep_error (ERR_PROCESS_DIR, file_list[i]);
+              closedir (next_d);
               failure_flag = true;
+              break;
             }
+          continue;
+
+        default:
+          continue;
+        }
+      /* Only errors break out of the switch.  */
+      break;
+    }
+  /* Close remaining directories after an error.  */
+  while (walk->ndirs > base)
+    {
+      closedir (walk->dirs[--walk->ndirs].d);
+      release_ignore (walk->dirs[walk->ndirs].ignore);
+    }
+
+  if (failure_flag)
+    return FAILURE;
+
+  return SUCCESS;
+}
+
+/* Processes the file or directory file_name from the file list.  Directories
+   are walked with walk.  */
+static int
+process_arg (buffer_t *buf, walk_t *walk, const char *file_name,
+             pattern_t *pattern, const replace_t *replacement)
+{
+  struct stat st; /* The stat for obtaining file type.  */
+  struct timespec times[2]; /* File times.  */
+  index_t **tmp; /* Grown list of indexes.  */
+  index_t *index; /* Index of the directory.  */
+  DIR *d; /* Directory file_name.  */
+  int fd; /* File descriptor of d.  */
+  bool replaced_flag; /* Flag for replaced pattern.  */
+  bool failure_flag = false;
+
+  if (lstat (file_name, &st) < 0)
+    {
+      rrep_error (ERR_PROCESS_ARG, file_name);
+      return FAILURE;
+    }
+
+  if (S_ISDIR (st.st_mode)) /* The st is a directory.  */
+    {
+      if (!check_include_name (file_name, true))
+        return SUCCESS;
+      if (options & OPT_KEEP_TIMES)
+        {
+          /* Save file times.  */
+          times[0] = get_stat_atime (&st);
+          times[1] = get_stat_mtime (&st);
         }
-      else if (S_ISREG (st.st_mode) && check_include_name (file_list[i],
-                                                           included_patterns,
-                                                           excluded_patterns))
+      index = NULL;
+      if (options & OPT_USE_INDEX)
         {
-          if (options & OPT_KEEP_TIMES)
+          /* Without a usable index, all files are searched.  */
+          index = load_index (file_name, pattern);
+          tmp = (index_t **) realloc (indexes, (nindexes + 1)
+                                               * sizeof (index_t *));
+          if (tmp == NULL)
             {
-              /* Save file times.  */
-              times.actime = st.st_atime;
-              times.modtime = st.st_mtime;
+              free_index (index);
+              index = NULL;
             }
-          /* The st is a regular file.  */
-          failure_flag |= process_file (NULL, file_list[i], pattern,
-                                        replacement);
-          if (options & OPT_KEEP_TIMES)
+          else
+            {
+              indexes = tmp;
+              indexes[nindexes++] = index;
+            }
+        }
+      if (jobs > 1)
+        {
+          /* Let the workers walk the directory.  */
+          return submit_dir_job (file_name,
+                                 options & OPT_KEEP_TIMES ? times : NULL,
+                                 index);
+        }
+      d = opendirat (AT_FDCWD, file_name, 0, &fd);
+      if (d == NULL)
+        {
+          rrep_error (ERR_PROCESS_DIR, file_name);
+          return FAILURE;
+        }
+      walk->index = index;
+      failure_flag |= process_dir (buf, walk, d, fd, file_name, pattern,
+                                   replacement);
+      if (options & OPT_KEEP_TIMES)
+        {
+          /* Restore file times.  */
+          if (utimensat (AT_FDCWD, file_name, times, 0) != 0)
             {
-              /* Restore file times.  */
-              if (utime (file_list[i], &times) != 0)
-                {
-                  rrep_error (ERR_KEEP_TIMES, file_list[i]);
-                  failure_flag = true;
-                }
+              rrep_error (ERR_KEEP_TIMES, file_name);
+              failure_flag = true;
             }
         }
     }
-  close (wd);
+  else if (S_ISREG (st.st_mode) && check_include_name (file_name, false))
+    {
+      /* The st is a regular file.  */
+      if (jobs > 1)
+        return submit_file_job (file_name);
+      failure_flag |= process_regular_file (buf, AT_FDCWD, file_name,
+                                            file_name, pattern, replacement,
+                                            &replaced_flag);
+      if (replaced_flag)
+        print_found (NULL, file_name);
+    }
+  else if (S_ISREG (st.st_mode))
+    count_stat (STAT_FILES_EXCLUDED, 1);
+
+  if (failure_flag)
+    return FAILURE;
+
+  return SUCCESS;
+}
+
+/* Processes the file_counter files in file_list.  */
+int
+process_file_list (buffer_t *buf, char **file_list, const size_t file_counter,
+                   pattern_t *pattern, const replace_t *replacement)
+{
+  walk_t walk = { NULL, 0, 0, NULL, 0, NULL }; /* Directory walk.  */
+  size_t i;
+  bool failure_flag = false;
+
+  /* Process file list.  */
+  for (i = 0; i < file_counter; i++)
+    failure_flag |= process_arg (buf, &walk, file_list[i], pattern,
+                                 replacement);
+  free_walk (&walk);
+
+  if (failure_flag)
+    return FAILURE;
+
+  return SUCCESS;
+}
+
+/* Processes the files whose names are read from the file list_name, or from
+   standard input if list_name is -, where each name ends with a null
+   character.  Names are processed as they are read, so only the longest name
+   is held in memory.  */
+int
+process_files0 (buffer_t *buf, const char *list_name, pattern_t *pattern,
+                const replace_t *replacement)
+{
+  walk_t walk = { NULL, 0, 0, NULL, 0, NULL }; /* Directory walk.  */
+  FILE *fp; /* Stream of the file list.  */
+  char *name = NULL; /* Current file name.  */
+  size_t name_size = 0; /* Allocated size of name.  */
+  ssize_t name_len; /* Length of name including the null character.  */
+  bool stdin_flag = !strcmp (list_name, "-");
+  bool failure_flag = false;
+
+  fp = stdin_flag ? stdin : fopen (list_name, "r");
+  if (fp == NULL)
+    {
+      rrep_error (ERR_OPEN_READ, list_name);
+      return FAILURE;
+    }
+  while ((name_len = getdelim (&name, &name_size, '\0', fp)) > 0)
+    {
+      /* The last name need not end with a null character.  */
+      if (name[name_len-1] != '\0')
+        name[name_len++] = '\0';
+      if (name_len == 1)
+        {
+          rrep_error (ERR_EMPTY_NAME, list_name);
+          failure_flag = true;
+          continue;
+        }
+      failure_flag |= process_arg (buf, &walk, name, pattern, replacement);
+    }
+  if (ferror (fp))
+    {
+      rrep_error (ERR_READ_FILE, list_name);
+      failure_flag = true;
+    }
+  if (!stdin_flag)
+    fclose (fp);
+  free (name);
+  free_walk (&walk);
 
   if (failure_flag)
     return FAILURE;
@@ -715,13 +1566,23 @@ main (int argc, char** argv)
 {
   const char *pattern_string = NULL; /* Regular expression to search for.  */
   const char *replacement_string = NULL; /* Replacement string.  */
+  const char *pairs_file = NULL; /* File with pattern and replacement pairs.  */
+  const char *index_dir = NULL; /* Directory to build the index of.  */
+  const char *cache_file = NULL; /* File of the no-match cache.  */
+  const char *files0_from = NULL; /* File with null terminated names.  */
   char *suffix_string = NULL; /* Suffix for backups.  */
   char *version_control = NULL; /* Version control for backups.  */
   pattern_t pattern; /* Pattern struct.  */
   replace_t replacement; /* Replacement struct.  */
+  buffer_t buf; /* Buffers of the main thread.  */
   char **file_list; /* List of files to process.  */
   size_t file_counter = 0; /* Counter for number of files.  */
   int i, opt;
+  size_t j;
+  long njobs; /* Parsed number of jobs.  */
+  long cache_kib; /* Parsed size of the DFA cache.  */
+  long limit_kib; /* Parsed buffer limit.  */
+  char *end; /* End of parsed number.  */
   int cflags = 0; /* Flags for regcomp.  */
   bool failure_flag = false;
   bool exit_flag = false;
@@ -732,15 +1593,26 @@ main (int argc, char** argv)
   bindtextdomain (PACKAGE, LOCALEDIR);
   textdomain (PACKAGE);
 #endif
+  /* Select the search function before any worker can call it.  */
+  init_search ();
 
   /* Initialize pattern.  */
   pattern.string = NULL;
   pattern.compiled = NULL;
+  pattern.locator = NULL;
+  pattern.detector = NULL;
+  pattern.literal = NULL;
+  pattern.dfa = NULL;
+  pattern.automaton = NULL;
   /* Initialize replacement.  */
   replacement.string = NULL;
   replacement.sub = NULL;
+  replacement.max_sub = 0;
   replacement.part = NULL;
   replacement.part_len = NULL;
+  replacement.pairs = NULL;
+  replacement.pair_len = NULL;
+  replacement.npairs = 0;
   /* Set program invocation name.  */
   set_program_name (argv[0]);
 
@@ -767,22 +1639,19 @@ main (int argc, char** argv)
           break;
 
         case INCLUDE_OPTION:
-          if (!included_patterns)
-            included_patterns = new_exclude ();
-          add_exclude (included_patterns, optarg,
-                       EXCLUDE_WILDCARDS | EXCLUDE_INCLUDE);
-          break;
-
         case EXCLUDE_OPTION:
-          if (!excluded_patterns)
-            excluded_patterns = new_exclude ();
-          add_exclude (excluded_patterns, optarg, EXCLUDE_WILDCARDS);
-          break;
-
         case EXCLUDE_DIR_OPTION:
-          if (!excluded_directory_patterns)
-            excluded_directory_patterns = new_exclude ();
-          add_exclude (excluded_directory_patterns, optarg, EXCLUDE_WILDCARDS);
+          if (name_patterns == NULL)
+            name_patterns = new_names ();
+          if (name_patterns == NULL
+              || add_name_pattern (name_patterns, optarg,
+                                   opt == INCLUDE_OPTION ? NAMES_INCLUDE
+                                   : opt == EXCLUDE_OPTION ? NAMES_EXCLUDE
+                                   : NAMES_EXCLUDE_DIR) != SUCCESS)
+            {
+              rrep_error (ERR_MEMORY, optarg);
+              failure_flag = true;
+            }
           break;
 
         case 'V':
@@ -813,6 +1682,40 @@ main (int argc, char** argv)
           options |= OPT_DRY;
           break;
 
+        case BUFFER_LIMIT_OPTION:
+          errno = 0;
+          limit_kib = strtol (optarg, &end, 10);
+          if (errno != 0 || end == optarg || *end != '\0' || limit_kib < 0
+              || (size_t) limit_kib > (size_t) -1/1024)
+            {
+              rrep_error (ERR_BUFFER_LIMIT, optarg);
+              failure_flag = true;
+            }
+          else
+            buffer_limit = limit_kib*1024;
+          break;
+
+        case DFA_CACHE_OPTION:
+          errno = 0;
+          cache_kib = strtol (optarg, &end, 10);
+          if (errno != 0 || end == optarg || *end != '\0' || cache_kib < 0
+              || (size_t) cache_kib > (size_t) -1/1024)
+            {
+              rrep_error (ERR_DFA_CACHE, optarg);
+              failure_flag = true;
+            }
+          else
+            dfa_cache_size = cache_kib*1024;
+          break;
+
+        case ATOMIC_OPTION:
+          options |= OPT_ATOMIC;
+          break;
+
+        case FSYNC_OPTION:
+          options |= OPT_FSYNC;
+          break;
+
         case 'e':
           if (pattern_string != NULL)
             {
@@ -831,6 +1734,24 @@ main (int argc, char** argv)
           cflags |= REG_ICASE;
           break;
 
+        case 'j':
+          errno = 0;
+          njobs = strtol (optarg, &end, 10);
+          if (errno != 0 || end == optarg || *end != '\0' || njobs < 0)
+            {
+              rrep_error (ERR_JOBS, optarg);
+              failure_flag = true;
+            }
+          else if (njobs == 0)
+            {
+              /* Use all online processors.  */
+              njobs = sysconf (_SC_NPROCESSORS_ONLN);
+              jobs = njobs > 0 ? njobs : 1;
+            }
+          else
+            jobs = njobs;
+          break;
+
         case KEEP_TIMES_OPTION:
           options |= OPT_KEEP_TIMES;
           break;
@@ -844,10 +1765,47 @@ main (int argc, char** argv)
             replacement_string = optarg;
           break;
 
+        case PAIRS_FILE_OPTION:
+          pairs_file = optarg;
+          options |= OPT_FIXED;
+          break;
+
         case INTERACTIVE_OPTION:
           options |= OPT_PROMPT;
           break;
 
+        case GITIGNORE_OPTION:
+          options |= OPT_GITIGNORE;
+          break;
+
+        case BUILD_INDEX_OPTION:
+          index_dir = optarg;
+          break;
+
+        case USE_INDEX_OPTION:
+          options |= OPT_USE_INDEX;
+          break;
+
+        case NO_MATCH_CACHE_OPTION:
+          cache_file = optarg;
+          break;
+
+        case FILES0_FROM_OPTION:
+          files0_from = optarg;
+          break;
+
+        case STATS_OPTION:
+          if (optarg == NULL || !strcmp (optarg, "text"))
+            options |= OPT_STATS;
+          else if (!strcmp (optarg, "json"))
+            options |= OPT_STATS | OPT_STATS_JSON;
+          else
+            {
+              rrep_error (ERR_STATS_FORMAT, optarg);
+              failure_flag = true;
+            }
+          break;
+
         case 'q':
           options |= OPT_QUIET;
           break;
@@ -880,6 +1838,16 @@ main (int argc, char** argv)
   if (exit_flag)
     return EXIT_SUCCESS;
 
+  if (index_dir != NULL)
+    {
+      /* Building an index needs neither a pattern nor a replacement.  An
+         index always covers all subdirectories.  */
+      options |= OPT_RECURSIVE;
+      failure_flag = build_index (index_dir, check_entry) != SUCCESS;
+      free_names (name_patterns);
+      return failure_flag ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+
   if (suffix_string)
     {
       /* Make a copy of suffix_string, because getenv might overwrite the
@@ -898,6 +1866,10 @@ main (int argc, char** argv)
   else
     backup_method = no_backups;
 
+  /* Prompts cannot be answered out of order.  */
+  if (options & OPT_PROMPT)
+    jobs = 1;
+
   /* Allocate memory for file list.  */
   file_list = (char **) malloc ((argc-optind) * sizeof (char *));
   if (file_list == NULL)
@@ -908,9 +1880,9 @@ main (int argc, char** argv)
   /* Parse remaining arguments.  */
   for (i = optind; i < argc; i++)
     {
-      if (pattern_string == NULL)
+      if (pattern_string == NULL && pairs_file == NULL)
         pattern_string = argv[i];
-      else if (replacement_string == NULL)
+      else if (replacement_string == NULL && pairs_file == NULL)
         replacement_string = argv[i];
       else
         {
@@ -920,7 +1892,9 @@ main (int argc, char** argv)
         }
     }
 
-  if (pattern_string == NULL || replacement_string == NULL)
+  if (pairs_file != NULL
+      ? pattern_string != NULL || replacement_string != NULL
+      : pattern_string == NULL || replacement_string == NULL)
     {
       print_invocation ();
       if (suffix_string != NULL)
@@ -929,69 +1903,121 @@ main (int argc, char** argv)
         free (file_list);
       return EXIT_FAILURE;
     }
+  if (files0_from != NULL
+      && (file_counter > 0
+          || (!strcmp (files0_from, "-") && options & OPT_PROMPT)))
+    {
+      /* Names come only from the list, and prompts need standard input.  */
+      if (file_counter > 0)
+        rrep_error (ERR_FILES0_OPERAND, file_list[0]);
+      else
+        rrep_error (ERR_FILES0_PROMPT, NULL);
+      if (suffix_string != NULL)
+        free (suffix_string);
+      if (file_list != NULL)
+        free (file_list);
+      return EXIT_FAILURE;
+    }
 
   /* Allocate initial memory for buffer.  */
-  buffer = (char *) malloc (INIT_BUFFER_SIZE * sizeof (char));
-  if (buffer == NULL)
+  if (init_buffer (&buf) != SUCCESS)
     {
-      rrep_error (ERR_ALLOC_BUFFER, NULL);
       if (suffix_string != NULL)
         free (suffix_string);
       if (file_list != NULL)
         free (file_list);
       return EXIT_FAILURE;
     }
-  buffer_size = INIT_BUFFER_SIZE;
-
+  if (pairs_file != NULL)
+    {
+      /* Parse pairs file.  */
+      if (parse_pairs (pairs_file, &pattern, &replacement) == FAILURE)
+        {
+          if (suffix_string != NULL)
+            free (suffix_string);
+          if (file_list != NULL)
+            free (file_list);
+          free_buffer (&buf);
+          return EXIT_FAILURE;
+        }
+    }
   /* Parse pattern string.  */
-  if (parse_pattern (pattern_string, &pattern, cflags) == FAILURE)
+  else if (parse_pattern (pattern_string, &pattern, cflags) == FAILURE)
     {
       if (file_list != NULL)
         free (file_list);
-      if (buffer != NULL)
-        free (buffer);
+      free_buffer (&buf);
       return EXIT_FAILURE;
     }
-
   /* Parse replacement string.  */
-  if (parse_replace (replacement_string, &replacement) == FAILURE)
+  else if (parse_replace (replacement_string, &replacement) == FAILURE)
     {
       if (suffix_string != NULL)
         free (suffix_string);
       if (file_list != NULL)
         free (file_list);
-      if (buffer != NULL)
-        free (buffer);
+      free_buffer (&buf);
       free_pattern (&pattern);
-      return FAILURE;
+      return EXIT_FAILURE;
     }
+  /* Find only the subpatterns that the replacement refers to.  */
+  pattern.nmatch = replacement.max_sub + 1;
 
   /* Replace pattern in file.  */
-  if (file_counter == 0 || (file_counter == 1 && !strcmp (file_list[0], "-")))
+  start_stats ();
+  if (files0_from == NULL
+      && (file_counter == 0
+          || (file_counter == 1 && !strcmp (file_list[0], "-"))))
     {
       /* Default input from stdin and output stdout.  */
-      failure_flag |= replace_string (stdin, stdout, &pattern, &replacement,
-                                      "stdin", NULL);
+      switch_phase (PHASE_REWRITE);
+      failure_flag |= replace_pipeline (&buf, stdin, stdout, &pattern,
+                                        &replacement, "stdin",
+                                        replace_string);
+      /* Every match in standard input is replaced in the output.  */
+      count_stat (STAT_REPLACEMENTS, get_stat (STAT_MATCHES));
     }
   else
     {
       print_dry ();
-      failure_flag |= process_file_list (file_list, file_counter, &pattern,
-                                         &replacement);
+      /* Without memory for the cache, all files are searched.  */
+      if (cache_file != NULL)
+        failure_flag |= load_cache (cache_file, &pattern, &no_match_cache);
+      switch_phase (PHASE_TRAVERSAL);
+      if (jobs > 1 && init_jobs (jobs, process_regular_file, check_entry,
+                                 &pattern, &replacement) != SUCCESS)
+        {
+          /* Fall back to sequential processing.  */
+          failure_flag = true;
+          jobs = 1;
+        }
+      if (files0_from != NULL)
+        failure_flag |= process_files0 (&buf, files0_from, &pattern,
+                                        &replacement);
+      else
+        failure_flag |= process_file_list (&buf, file_list, file_counter,
+                                           &pattern, &replacement);
+      if (jobs > 1)
+        {
+          /* The main thread only waits for the workers.  */
+          switch_phase (PHASE_NONE);
+          failure_flag |= finish_jobs ();
+        }
+      if (no_match_cache != NULL)
+        {
+          failure_flag |= save_cache (no_match_cache);
+          free_cache (no_match_cache);
+        }
     }
+  print_stats ();
 
-  if (included_patterns)
-    free_exclude (included_patterns);
-  if (excluded_patterns)
-    free_exclude (excluded_patterns);
-  if (excluded_directory_patterns)
-    free_exclude (excluded_directory_patterns);
+  for (j = 0; j < nindexes; j++)
+    free_index (indexes[j]);
+  free (indexes);
+  free_names (name_patterns);
   free_replace (&replacement);
   free_pattern (&pattern);
-  if (file_buffer)
-    free (file_buffer);
-  if (buffer)
-    free (buffer);
+  free_buffer (&buf);
   if (file_list)
     free (file_list);
   if (suffix_string != NULL)
@@ -19,6 +19,12 @@
 /* Initial size of the buffer for reading lines.  */
 #define INIT_BUFFER_SIZE (4096)
 
+/* Default size up to which buffers are kept between files in kibibytes.  */
+#define BUFFER_LIMIT (1024)
+
+/* Default memory limit for the state cache of the DFA in kibibytes.  */
+#define DFA_CACHE_SIZE (1024)
+
 /* Option flag definitions.  */
 #define OPT_ALL         0x001 /* Process all files.  */
 #define OPT_BACKUP      0x002 /* Backup files.  */
@@ -32,14 +38,35 @@
 #define OPT_RECURSIVE   0x200 /* Recurse into directories.  */
 #define OPT_WHOLE_LINE  0x400 /* Force PATTERN to match only whole lines.  */
 #define OPT_WHOLE_WORD  0x800 /* Force PATTERN to match only whole words.  */
+#define OPT_ATOMIC     0x1000 /* Replace files by renaming a temporary file.  */
+#define OPT_FSYNC      0x2000 /* Synchronize modified files to disk.  */
+#define OPT_STATS      0x4000 /* Report statistics of the run.  */
+#define OPT_STATS_JSON 0x8000 /* Report statistics in JSON.  */
+#define OPT_GITIGNORE 0x10000 /* Skip files excluded by ignore files.  */
+#define OPT_USE_INDEX 0x20000 /* Skip files that the index rules out.  */
 
 /* Processing constants.  */
 enum
   {
     SUCCESS = 0,
     FAILURE = 1,
-    END_REACHED = 2
+    END_REACHED = 2,
+    BINARY_FOUND = 3
+  };
+
+/* Kinds of directory entries.  */
+enum
+  {
+    ENTRY_SKIP = 0, /* The entry is not processed.  */
+    ENTRY_FILE = 1, /* The entry is a regular file to process.  */
+    ENTRY_DIR = 2 /* The entry is a directory to recurse into.  */
   };
 
 /* Option flags are set in main.  */
 extern int options;
+
+/* Memory limit for the state cache of the DFA in bytes.  */
+extern size_t dfa_cache_size;
+
+/* Size up to which buffers are kept for the next file in bytes.  */
+extern size_t buffer_limit;
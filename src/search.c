@@ -0,0 +1,237 @@
+/* search.c - fixed string search for rrep.
+   Copyright (C) 2026 Arno Onken <asnelt@asnelt.org>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA
+   02110-1301, USA.  */
+
+#include <config.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include "rrep.h"
+#include "search.h"
+
+/* The vectorized searches compare the first and the last character of the
+   needle with a whole block of the haystack at once and verify only the
+   positions where both characters are found.  */
+#if defined __GNUC__ && defined __x86_64__
+# define SEARCH_SIMD 1
+# include <immintrin.h>
+#endif
+
+/* Search function that is selected by init_search.  */
+typedef const char *(*search_function_t) (const char *, const char *,
+                                          size_t, const char *, size_t,
+                                          bool);
+
+/* Checks whether c is a word constituent.  */
+static inline bool
+is_word (char c)
+{
+  return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z')
+    || (c >= '0' && c <= '9') || c == '_';
+}
+
+/* Checks the string with length len found at found against the whole word
+   and whole line options.  The characters between context and end surround
+   found.  Lines end with a newline character.  Behind end, a null character
+   is assumed like behind a terminated line.  */
+bool
+check_found (const char *context, const char *found, const char *end,
+             size_t len)
+{
+  char c;
+
+  if (!(options & (OPT_WHOLE_WORD | OPT_WHOLE_LINE)))
+    return true;
+
+  /* Check beginning.  */
+  if (found > context)
+    {
+      c = *(found-1);
+      if (options & OPT_WHOLE_LINE)
+        {
+          if (c != '\n')
+            return false;
+        }
+      else if (is_word (c))
+        return false;
+    }
+
+  /* Check end.  */
+  c = found+len < end ? *(found+len) : '\0';
+  if (c != '\n')
+    {
+      if (options & OPT_WHOLE_LINE)
+        return false;
+      if (is_word (c))
+        return false;
+    }
+
+  return true;
+}
+
+/* Verifies the candidate at found whose first and last characters are
+   already known to match.  The whole word and whole line options are only
+   checked if whole_flag is set.  */
+static inline bool
+check_candidate (const char *context, const char *found, const char *end,
+                 const char *needle, size_t needle_len, bool whole_flag)
+{
+  return (needle_len <= 2
+          || memcmp (found+1, needle+1, needle_len-2) == 0)
+    && (!whole_flag || check_found (context, found, end, needle_len));
+}
+
+/* Searches the positions from start on with memchr for the first character of
+   needle.  */
+static const char *
+search_scalar (const char *context, const char *start, size_t len,
+               const char *needle, size_t needle_len, bool whole_flag)
+{
+  const char *end, *found;
+
+  if (needle_len > len)
+    return NULL;
+  end = start+len;
+  found = start;
+  while ((found = memchr (found, *needle, len-needle_len+1-(found-start)))
+         != NULL)
+    {
+      if (*(found+needle_len-1) == *(needle+needle_len-1)
+          && check_candidate (context, found, end, needle, needle_len,
+                              whole_flag))
+        return found;
+      found++;
+    }
+
+  return NULL;
+}
+
+#ifdef SEARCH_SIMD
+/* Searches blocks of 16 characters with SSE2 instructions.  */
+static const char *
+search_sse2 (const char *context, const char *start, size_t len,
+             const char *needle, size_t needle_len, bool whole_flag)
+{
+  const char *end, *found;
+  __m128i first, last, block_first, block_last;
+  unsigned int mask;
+  size_t i;
+
+  if (needle_len > len)
+    return NULL;
+  end = start+len;
+  first = _mm_set1_epi8 (*needle);
+  last = _mm_set1_epi8 (*(needle+needle_len-1));
+  for (i = 0; i+needle_len+15 <= len; i += 16)
+    {
+      block_first = _mm_loadu_si128 ((const __m128i *) (start+i));
+      block_last = _mm_loadu_si128 ((const __m128i *)
+                                    (start+i+needle_len-1));
+      mask = _mm_movemask_epi8 (_mm_and_si128
+                                (_mm_cmpeq_epi8 (first, block_first),
+                                 _mm_cmpeq_epi8 (last, block_last)));
+      while (mask != 0)
+        {
+          found = start+i+__builtin_ctz (mask);
+          if (check_candidate (context, found, end, needle, needle_len,
+                               whole_flag))
+            return found;
+          mask &= mask-1;
+        }
+    }
+
+  /* Search the rest that does not fill a block.  */
+  return search_scalar (context, start+i, len-i, needle, needle_len,
+                        whole_flag);
+}
+
+/* Searches blocks of 32 characters with AVX2 instructions.  */
+__attribute__ ((target ("avx2")))
+static const char *
+search_avx2 (const char *context, const char *start, size_t len,
+             const char *needle, size_t needle_len, bool whole_flag)
+{
+  const char *end, *found;
+  __m256i first, last, block_first, block_last;
+  unsigned int mask;
+  size_t i;
+
+  if (needle_len > len)
+    return NULL;
+  end = start+len;
+  first = _mm256_set1_epi8 (*needle);
+  last = _mm256_set1_epi8 (*(needle+needle_len-1));
+  for (i = 0; i+needle_len+31 <= len; i += 32)
+    {
+      block_first = _mm256_loadu_si256 ((const __m256i *) (start+i));
+      block_last = _mm256_loadu_si256 ((const __m256i *)
+                                       (start+i+needle_len-1));
+      mask = _mm256_movemask_epi8 (_mm256_and_si256
+                                   (_mm256_cmpeq_epi8 (first, block_first),
+                                    _mm256_cmpeq_epi8 (last, block_last)));
+      while (mask != 0)
+        {
+          found = start+i+__builtin_ctz (mask);
+          if (check_candidate (context, found, end, needle, needle_len,
+                               whole_flag))
+            return found;
+          mask &= mask-1;
+        }
+    }
+
+  /* Search the rest that does not fill a block.  */
+  return search_sse2 (context, start+i, len-i, needle, needle_len,
+                      whole_flag);
+}
+#endif
+
+static search_function_t search_function = search_scalar;
+
+/* Selects the fastest search function that the processor supports.  */
+void
+init_search (void)
+{
+#ifdef SEARCH_SIMD
+  __builtin_cpu_init ();
+  if (__builtin_cpu_supports ("avx2"))
+    search_function = search_avx2;
+  else
+    search_function = search_sse2;
+#endif
+}
+
+/* Returns the first occurrence of the string needle with length needle_len in
+   the len characters at start that passes the whole word and whole line
+   options, or NULL if there is none.  The characters between context and
+   start precede start and are only used for the whole word and whole line
+   checks.  start does not need to be terminated.  */
+const char *
+search_string (const char *context, const char *start, size_t len,
+               const char *needle, size_t needle_len)
+{
+  return search_function (context, start, len, needle, needle_len, true);
+}
+
+/* Returns the first occurrence of the string needle with length needle_len in
+   the len characters at start regardless of the whole word and whole line
+   options, or NULL if there is none.  */
+const char *
+find_string (const char *start, size_t len, const char *needle,
+             size_t needle_len)
+{
+  return search_function (start, start, len, needle, needle_len, false);
+}
@@ -0,0 +1,38 @@
+/* search.h - declarations for the fixed string search of rrep.
+   Copyright (C) 2026 Arno Onken <asnelt@asnelt.org>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA
+   02110-1301, USA.  */
+
+/* Selects the fastest search function that the processor supports.  */
+extern void init_search (void);
+
+/* Checks the string with length len found at found against the whole word
+   and whole line options.  The characters between context and end surround
+   found.  */
+extern bool check_found (const char *, const char *, const char *, size_t);
+
+/* Returns the first occurrence of the string needle with length needle_len in
+   the len characters at start that passes the whole word and whole line
+   options, or NULL if there is none.  The characters between context and
+   start precede start and are only used for the whole word and whole line
+   checks.  start does not need to be terminated.  */
+extern const char *search_string (const char *, const char *, size_t,
+                                  const char *, size_t);
+
+/* Returns the first occurrence of the string needle with length needle_len in
+   the len characters at start regardless of the whole word and whole line
+   options, or NULL if there is none.  */
+extern const char *find_string (const char *, size_t, const char *, size_t);
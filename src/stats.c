@@ -0,0 +1,254 @@
+/* stats.c - run statistics of rrep.
+   Copyright (C) 2026 Arno Onken <asnelt@asnelt.org>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA
+   02110-1301, USA.  */
+
+/* Every thread counts into its own statistics, so counting needs neither
+   locks nor atomic operations.  The statistics of all threads are kept in a
+   list and only summed at the end of the run.  */
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include "gettext.h"
+#include "rrep.h"
+#include "stats.h"
+
+#define _(string) gettext (string)
+
+/* Names of the counters in JSON.  */
+static const char *const stat_keys[NSTATS] =
+  {
+    "files_scanned", "files_binary", "files_excluded", "files_hidden",
+    "files_ignored", "files_indexed", "files_cached", "files_matched",
+    "files_rewritten", "bytes_read", "bytes_written", "lines", "matches",
+    "replacements", "reallocations"
+  };
+
+/* Names of the phases in JSON.  */
+static const char *const phase_keys[NPHASES] =
+  {
+    NULL, "traversal", "detection", "rewrite", "copy_back", "backup"
+  };
+
+/* Statistics of the calling thread or NULL if they are not requested.  */
+static _Thread_local stats_t *local_stats = NULL;
+
+/* Statistics of all threads.  */
+static stats_t *all_stats = NULL;
+
+/* Elapsed time at the start of the run.  */
+static struct timespec run_start;
+
+/* Lock for all_stats.  */
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Returns the seconds from start to end.  */
+static double
+elapsed (const struct timespec *start, const struct timespec *end)
+{
+  return (end->tv_sec - start->tv_sec)
+         + (end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/* Starts the statistics of the calling thread if they are requested.  Must be
+   called by each thread before it counts anything.  */
+void
+start_stats ()
+{
+  stats_t *stats;
+
+  if (!(options & OPT_STATS) || local_stats != NULL)
+    return;
+  /* Without memory, the thread just does not count.  */
+  stats = (stats_t *) calloc (1, sizeof (stats_t));
+  if (stats == NULL)
+    return;
+  stats->phase = PHASE_NONE;
+  clock_gettime (CLOCK_MONOTONIC, &stats->wall_start);
+  clock_gettime (CLOCK_THREAD_CPUTIME_ID, &stats->cpu_start);
+  pthread_mutex_lock (&stats_lock);
+  if (all_stats == NULL)
+    run_start = stats->wall_start;
+  stats->next = all_stats;
+  all_stats = stats;
+  pthread_mutex_unlock (&stats_lock);
+  local_stats = stats;
+}
+
+/* Adds n to the counter stat of the calling thread.  */
+void
+count_stat (int stat, uintmax_t n)
+{
+  if (local_stats != NULL)
+    local_stats->counts[stat] += n;
+}
+
+/* Returns the counter stat of the calling thread.  */
+uintmax_t
+get_stat (int stat)
+{
+  if (local_stats == NULL)
+    return 0;
+  return local_stats->counts[stat];
+}
+
+/* Returns the counter stat of the calling thread and resets it to zero, so
+   that the count can be handed to another thread.  */
+uintmax_t
+take_stat (int stat)
+{
+  uintmax_t count;
+
+  if (local_stats == NULL)
+    return 0;
+  count = local_stats->counts[stat];
+  local_stats->counts[stat] = 0;
+  return count;
+}
+
+/* Lets the calling thread enter phase and returns the previous phase.  The
+   time since the last switch is added to the previous phase.  */
+int
+switch_phase (int phase)
+{
+  struct timespec wall, cpu;
+  int previous;
+
+  if (local_stats == NULL)
+    return PHASE_NONE;
+  previous = local_stats->phase;
+  if (phase == previous)
+    return previous;
+  clock_gettime (CLOCK_MONOTONIC, &wall);
+  clock_gettime (CLOCK_THREAD_CPUTIME_ID, &cpu);
+  local_stats->wall_time[previous] += elapsed (&local_stats->wall_start,
+                                               &wall);
+  local_stats->cpu_time[previous] += elapsed (&local_stats->cpu_start, &cpu);
+  local_stats->wall_start = wall;
+  local_stats->cpu_start = cpu;
+  local_stats->phase = phase;
+
+  return previous;
+}
+
+/* Sums the statistics of all threads into total and frees them.  Wall and
+   processor times of the phases are summed over threads, while the totals of
+   the run are stored in the last arguments.  */
+static void
+sum_stats (stats_t *total, double *wall_time, double *cpu_time)
+{
+  struct timespec now;
+  struct rusage usage;
+  stats_t *stats;
+  int i;
+
+  memset (total, 0, sizeof (stats_t));
+  *wall_time = 0;
+  *cpu_time = 0;
+  /* Close the current phase of the calling thread.  */
+  switch_phase (PHASE_NONE);
+  local_stats = NULL;
+  if (all_stats == NULL)
+    return;
+
+  while (all_stats != NULL)
+    {
+      stats = all_stats;
+      for (i = 0; i < NSTATS; i++)
+        total->counts[i] += stats->counts[i];
+      for (i = 0; i < NPHASES; i++)
+        {
+          total->wall_time[i] += stats->wall_time[i];
+          total->cpu_time[i] += stats->cpu_time[i];
+        }
+      all_stats = stats->next;
+      free (stats);
+    }
+
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  *wall_time = elapsed (&run_start, &now);
+  if (getrusage (RUSAGE_SELF, &usage) == 0)
+    *cpu_time = usage.ru_utime.tv_sec + usage.ru_stime.tv_sec
+                + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+/* Prints the statistics of all threads to standard error and frees them.
+   With OPT_STATS_JSON, a single JSON object is printed.  Must only be called
+   after all other threads ended.  */
+void
+print_stats ()
+{
+  /* Descriptions of the counters.  */
+  const char *const stat_names[NSTATS] =
+    {
+      _("Files scanned"), _("Files skipped as binary"),
+      _("Files skipped by --include or --exclude"),
+      _("Files skipped as hidden"), _("Files skipped by ignore files"),
+      _("Files skipped by the index"),
+      _("Files skipped by the no-match cache"), _("Files with matches"),
+      _("Files rewritten"), _("Bytes read"), _("Bytes written"),
+      _("Lines read one by one"), _("Matches"), _("Replacements"),
+      _("Buffer reallocations")
+    };
+  /* Descriptions of the phases.  */
+  const char *const phase_names[NPHASES] =
+    {
+      NULL, _("Traversal"), _("Detection scan"), _("Rewrite"),
+      _("Copy-back"), _("Backup")
+    };
+  stats_t total;
+  double wall_time, cpu_time;
+  int i;
+
+  if (!(options & OPT_STATS))
+    return;
+  sum_stats (&total, &wall_time, &cpu_time);
+
+  if (options & OPT_STATS_JSON)
+    {
+      fprintf (stderr, "{");
+      for (i = 0; i < NSTATS; i++)
+        fprintf (stderr, "\"%s\": %ju, ", stat_keys[i], total.counts[i]);
+      /* The times of the phases are summed over threads and can exceed
+         the run time, so they are kept apart from it.  */
+      fprintf (stderr, "\"thread_time\": {");
+      for (i = PHASE_NONE+1; i < NPHASES; i++)
+        fprintf (stderr, "%s\"%s\": {\"wall\": %.6f, \"cpu\": %.6f}",
+                 i > PHASE_NONE+1 ? ", " : "", phase_keys[i],
+                 total.wall_time[i], total.cpu_time[i]);
+      fprintf (stderr, "}, \"run_time\": {\"wall\": %.6f, \"cpu\": %.6f}}"
+               "\n", wall_time, cpu_time);
+      return;
+    }
+
+  for (i = 0; i < NSTATS; i++)
+    fprintf (stderr, "%s: %ju\n", stat_names[i], total.counts[i]);
+  fprintf (stderr, _("Thread time in seconds, summed over threads "
+                     "(wall, CPU):\n"));
+  for (i = PHASE_NONE+1; i < NPHASES; i++)
+    fprintf (stderr, "  %s: %.6f, %.6f\n", phase_names[i],
+             total.wall_time[i], total.cpu_time[i]);
+  fprintf (stderr, _("Run time in seconds (wall, CPU): %.6f, %.6f\n"),
+           wall_time, cpu_time);
+}
@@ -0,0 +1,85 @@
+/* stats.h - declarations for the run statistics of rrep.
+   Copyright (C) 2026 Arno Onken <asnelt@asnelt.org>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA
+   02110-1301, USA.  */
+
+/* Counters of a run.  */
+enum
+  {
+    STAT_FILES_SCANNED, /* Files that were searched for PATTERN.  */
+    STAT_FILES_BINARY, /* Files that were skipped as binary.  */
+    STAT_FILES_EXCLUDED, /* Files skipped by --include or --exclude.  */
+    STAT_FILES_HIDDEN, /* Files skipped because their name starts with dot.  */
+    STAT_FILES_IGNORED, /* Files skipped by ignore files.  */
+    STAT_FILES_INDEXED, /* Files that the index ruled out.  */
+    STAT_FILES_CACHED, /* Files that the no-match cache ruled out.  */
+    STAT_FILES_MATCHED, /* Files that contain PATTERN.  */
+    STAT_FILES_REWRITTEN, /* Files that were modified.  */
+    STAT_BYTES_READ, /* Characters read from files and standard input.  */
+    STAT_BYTES_WRITTEN, /* Characters written to files and standard output.  */
+    STAT_LINES, /* Lines that were read one by one.  */
+    STAT_MATCHES, /* Matches that were replaced in the output.  */
+    STAT_REPLACEMENTS, /* Matches in files that were modified.  */
+    STAT_REALLOCS, /* Reallocations of growing buffers.  */
+    NSTATS /* Number of counters.  */
+  };
+
+/* Phases of a run that are timed.  */
+enum
+  {
+    PHASE_NONE, /* Setup and waiting, which is not reported.  */
+    PHASE_TRAVERSAL, /* Walking directories and selecting files.  */
+    PHASE_DETECTION, /* Scanning a file up to the first match.  */
+    PHASE_REWRITE, /* Rewriting a file from the first match on.  */
+    PHASE_COPY_BACK, /* Writing or renaming the rewritten file into place.  */
+    PHASE_BACKUP, /* Making a backup of a file.  */
+    NPHASES /* Number of phases.  */
+  };
+
+/* Data structure for the statistics of a thread.  */
+typedef struct stats
+{
+  uintmax_t counts[NSTATS]; /* Counters.  */
+  double wall_time[NPHASES]; /* Elapsed seconds per phase.  */
+  double cpu_time[NPHASES]; /* Processor seconds of the thread per phase.  */
+  int phase; /* Current phase.  */
+  struct timespec wall_start; /* Elapsed time at the start of phase.  */
+  struct timespec cpu_start; /* Processor time at the start of phase.  */
+  struct stats *next; /* Statistics of the next thread.  */
+} stats_t;
+
+/* Starts the statistics of the calling thread if they are requested.  Must be
+   called by each thread before it counts anything.  */
+extern void start_stats (void);
+
+/* Adds n to the counter stat of the calling thread.  */
+extern void count_stat (int, uintmax_t);
+
+/* Returns the counter stat of the calling thread.  */
+extern uintmax_t get_stat (int);
+
+/* Returns the counter stat of the calling thread and resets it to zero, so
+   that the count can be handed to another thread.  */
+extern uintmax_t take_stat (int);
+
+/* Lets the calling thread enter phase and returns the previous phase.  The
+   time since the last switch is added to the previous phase.  */
+extern int switch_phase (int);
+
+/* Prints the statistics of all threads to standard error and frees them.
+   With OPT_STATS_JSON, a single JSON object is printed.  Must only be called
+   after all other threads ended.  */
+extern void print_stats (void);
@@ -0,0 +1,323 @@
+/* uring.c - reading files ahead with io_uring in rrep.
+   Copyright (C) 2026 Arno Onken <asnelt@asnelt.org>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA
+   02110-1301, USA.  */
+
+/* The queues are driven by the raw system calls, so that no library beyond
+   the kernel headers is needed.  Each batch of requests is submitted with a
+   single io_uring_enter that also waits for all completions, so the kernel
+   works on all files of a batch at once instead of one system call at a
+   time.  */
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#if defined HAVE_LINUX_IO_URING_H && defined HAVE_STDATOMIC_H \
+    && defined HAVE_MMAP
+# define USE_URING 1
+# include <stdatomic.h>
+# include <sys/mman.h>
+# include <sys/syscall.h>
+# include <linux/io_uring.h>
+#endif
+#include "rrep.h"
+#include "bufferio.h"
+#include "uring.h"
+
+#ifdef USE_URING
+
+/* Kinds of requests, stored in the lowest bits of the user data.  */
+enum
+  {
+    REQ_OPEN, /* Open a file.  */
+    REQ_STATX, /* Obtain the status of a file.  */
+    REQ_READ, /* Read the contents of a file.  */
+    REQ_KINDS /* Number of kinds.  */
+  };
+
+/* Data structure for the queues shared with the kernel.  */
+struct uring
+{
+  int fd; /* File descriptor of the queues.  */
+  unsigned entries; /* Number of submission queue entries.  */
+  unsigned *sq_head; /* Head of the submission queue.  */
+  unsigned *sq_tail; /* Tail of the submission queue.  */
+  unsigned *sq_mask; /* Mask for submission queue indices.  */
+  unsigned *sq_array; /* Indices of the submitted entries.  */
+  struct io_uring_sqe *sqes; /* Submission queue entries.  */
+  unsigned *cq_head; /* Head of the completion queue.  */
+  unsigned *cq_tail; /* Tail of the completion queue.  */
+  unsigned *cq_mask; /* Mask for completion queue indices.  */
+  struct io_uring_cqe *cqes; /* Completion queue entries.  */
+  unsigned tail; /* Tail of the submission queue including new entries.  */
+  void *ring_map; /* Mapping of both queues.  */
+  size_t ring_map_size; /* Size of ring_map.  */
+  size_t sqes_size; /* Size of the mapping of sqes.  */
+  struct statx *stx; /* Status of the files of a batch.  */
+  bool failure_flag; /* The queue is in an unknown state after an error.  */
+};
+
+/* Sets up a queue for at least entries requests.  Returns NULL if io_uring
+   is not supported by the build or the kernel, so that files are opened and
+   read one by one.  */
+uring_t *
+new_uring (unsigned entries)
+{
+  struct io_uring_params p;
+  uring_t *ring;
+  size_t sq_size, cq_size;
+  void *map;
+  char *base;
+
+  ring = (uring_t *) calloc (1, sizeof (uring_t));
+  if (ring == NULL)
+    return NULL;
+  memset (&p, 0, sizeof (p));
+  ring->fd = syscall (__NR_io_uring_setup, entries, &p);
+  /* Older kernels map both queues separately, which is not worth
+     supporting.  */
+  if (ring->fd < 0 || !(p.features & IORING_FEAT_SINGLE_MMAP))
+    goto fail;
+  ring->entries = p.sq_entries;
+  ring->stx = (struct statx *) calloc (p.sq_entries, sizeof (struct statx));
+  if (ring->stx == NULL)
+    goto fail;
+
+  sq_size = p.sq_off.array + p.sq_entries * sizeof (unsigned);
+  cq_size = p.cq_off.cqes + p.cq_entries * sizeof (struct io_uring_cqe);
+  ring->ring_map_size = sq_size > cq_size ? sq_size : cq_size;
+  map = mmap (NULL, ring->ring_map_size, PROT_READ | PROT_WRITE,
+              MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+  if (map == MAP_FAILED)
+    goto fail;
+  ring->ring_map = map;
+  ring->sqes_size = p.sq_entries * sizeof (struct io_uring_sqe);
+  map = mmap (NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+              MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+  if (map == MAP_FAILED)
+    goto fail;
+  ring->sqes = (struct io_uring_sqe *) map;
+
+  base = (char *) ring->ring_map;
+  ring->sq_head = (unsigned *) (base + p.sq_off.head);
+  ring->sq_tail = (unsigned *) (base + p.sq_off.tail);
+  ring->sq_mask = (unsigned *) (base + p.sq_off.ring_mask);
+  ring->sq_array = (unsigned *) (base + p.sq_off.array);
+  ring->cq_head = (unsigned *) (base + p.cq_off.head);
+  ring->cq_tail = (unsigned *) (base + p.cq_off.tail);
+  ring->cq_mask = (unsigned *) (base + p.cq_off.ring_mask);
+  ring->cqes = (struct io_uring_cqe *) (base + p.cq_off.cqes);
+  ring->tail = *ring->sq_tail;
+
+  return ring;
+
+ fail:
+  free_uring (ring);
+  return NULL;
+}
+
+/* Frees the queue.  */
+void
+free_uring (uring_t *ring)
+{
+  if (ring == NULL)
+    return;
+  if (ring->sqes != NULL)
+    munmap (ring->sqes, ring->sqes_size);
+  if (ring->ring_map != NULL)
+    munmap (ring->ring_map, ring->ring_map_size);
+  if (ring->fd >= 0)
+    close (ring->fd);
+  free (ring->stx);
+  free (ring);
+}
+
+/* Returns a cleared submission queue entry for the request kind on element
+   index of a batch.  */
+static struct io_uring_sqe *
+get_sqe (uring_t *ring, int kind, size_t index)
+{
+  struct io_uring_sqe *sqe;
+  unsigned i;
+
+  i = ring->tail++ & *ring->sq_mask;
+  sqe = &ring->sqes[i];
+  memset (sqe, 0, sizeof (struct io_uring_sqe));
+  sqe->user_data = (uint64_t) index * REQ_KINDS + kind;
+  ring->sq_array[i] = i;
+
+  return sqe;
+}
+
+/* Submits the new entries of ring and stores the result of each request in
+   the element of ahead that the request belongs to.  Returns when all
+   requests are complete.  */
+static int
+run_batch (uring_t *ring, ahead_t *ahead)
+{
+  struct io_uring_cqe *cqe;
+  ahead_t *file;
+  unsigned head, tail;
+  unsigned pending; /* Number of incomplete requests.  */
+  unsigned unsubmitted; /* Number of requests not taken by the kernel.  */
+  long rr;
+
+  unsubmitted = ring->tail - *ring->sq_tail;
+  pending = unsubmitted;
+  atomic_store_explicit ((_Atomic unsigned *) ring->sq_tail, ring->tail,
+                         memory_order_release);
+  while (pending > 0)
+    {
+      rr = syscall (__NR_io_uring_enter, ring->fd, unsubmitted, pending,
+                    IORING_ENTER_GETEVENTS, NULL, 0);
+      if (rr < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+        {
+          ring->failure_flag = true;
+          return FAILURE;
+        }
+      if (rr > 0)
+        unsubmitted -= rr;
+
+      head = *ring->cq_head;
+      tail = atomic_load_explicit ((_Atomic unsigned *) ring->cq_tail,
+                                   memory_order_acquire);
+      for (; head != tail; head++, pending--)
+        {
+          cqe = &ring->cqes[head & *ring->cq_mask];
+          file = &ahead[cqe->user_data / REQ_KINDS];
+          switch (cqe->user_data % REQ_KINDS)
+            {
+            case REQ_OPEN:
+              file->fd = cqe->res;
+              break;
+            case REQ_STATX:
+              if (cqe->res < 0)
+                ring->stx[cqe->user_data / REQ_KINDS].stx_mask = 0;
+              break;
+            case REQ_READ:
+              /* A file that grew since its status was obtained is left to
+                 the caller.  */
+              if (cqe->res >= 0 && (size_t) cqe->res
+                     <= ring->stx[cqe->user_data / REQ_KINDS].stx_size)
+                file->len = cqe->res;
+              break;
+            }
+        }
+      atomic_store_explicit ((_Atomic unsigned *) ring->cq_head, head,
+                             memory_order_release);
+    }
+
+  return SUCCESS;
+}
+
+/* Opens the nnames null terminated file names at names relative to the
+   directory dir_fd and obtains their status in one batch of requests.  The
+   contents of regular files up to AHEAD_SIZE characters are then read in a
+   second batch.  The results are stored in the nnames elements of ahead.
+   Files that could not be opened or read are left to the caller.  After an
+   error of the queue itself, no more files are read ahead.  */
+void
+read_ahead (uring_t *ring, int dir_fd, const char *names, size_t nnames,
+            ahead_t *ahead)
+{
+  struct io_uring_sqe *sqe;
+  struct statx *stx;
+  const char *name;
+  size_t batch; /* Number of files in a batch.  */
+  size_t i;
+
+  for (i = 0; i < nnames; i++)
+    {
+      ahead[i].fd = -1;
+      ahead[i].len = 0;
+    }
+  for (; nnames > 0 && !ring->failure_flag; ahead += batch, nnames -= batch)
+    {
+      /* Each file needs two requests in the first batch.  */
+      batch = nnames < ring->entries / 2 ? nnames : ring->entries / 2;
+      for (i = 0; i < batch; i++, names += strlen (names) + 1)
+        {
+          name = names;
+          sqe = get_sqe (ring, REQ_OPEN, i);
+          sqe->opcode = IORING_OP_OPENAT;
+          sqe->fd = dir_fd;
+          sqe->addr = (uintptr_t) name;
+          sqe->open_flags = O_RDONLY;
+          sqe = get_sqe (ring, REQ_STATX, i);
+          sqe->opcode = IORING_OP_STATX;
+          sqe->fd = dir_fd;
+          sqe->addr = (uintptr_t) name;
+          sqe->len = STATX_TYPE | STATX_SIZE;
+          sqe->off = (uintptr_t) &ring->stx[i];
+        }
+      if (run_batch (ring, ahead) != SUCCESS)
+        break;
+
+      for (i = 0; i < batch; i++)
+        {
+          stx = &ring->stx[i];
+          if (ahead[i].fd < 0 || (stx->stx_mask & (STATX_TYPE | STATX_SIZE))
+                                 != (STATX_TYPE | STATX_SIZE)
+              || !S_ISREG (stx->stx_mode) || stx->stx_size == 0
+              || stx->stx_size > AHEAD_SIZE
+              || grow_buffer (&ahead[i].data, &ahead[i].size,
+                              stx->stx_size + 1) != SUCCESS)
+            continue;
+          /* One more character than expected reveals a file that grew.  */
+          sqe = get_sqe (ring, REQ_READ, i);
+          sqe->opcode = IORING_OP_READ;
+          sqe->fd = ahead[i].fd;
+          sqe->addr = (uintptr_t) ahead[i].data;
+          sqe->len = stx->stx_size + 1;
+          sqe->off = 0;
+        }
+      run_batch (ring, ahead);
+    }
+}
+
+#else /* !USE_URING */
+
+/* Sets up a queue for at least entries requests.  Returns NULL if io_uring
+   is not supported by the build or the kernel, so that files are opened and
+   read one by one.  */
+uring_t *
+new_uring (unsigned entries)
+{
+  return NULL;
+}
+
+/* Frees the queue.  */
+void
+free_uring (uring_t *ring)
+{
+}
+
+/* Without io_uring, no queue is ever set up.  */
+void
+read_ahead (uring_t *ring, int dir_fd, const char *names, size_t nnames,
+            ahead_t *ahead)
+{
+}
+
+#endif /* !USE_URING */
@@ -0,0 +1,39 @@
+/* uring.h - declarations for reading files ahead with io_uring in rrep.
+   Copyright (C) 2026 Arno Onken <asnelt@asnelt.org>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street - Fifth Floor, Boston, MA
+   02110-1301, USA.  */
+
+/* Maximum size of a file whose contents are read ahead.  Larger files are
+   only opened ahead and mapped when they are processed.  */
+#define AHEAD_SIZE (128*1024)
+
+/* Submission and completion queues shared with the kernel.  */
+typedef struct uring uring_t;
+
+/* Sets up a queue for at least entries requests.  Returns NULL if io_uring
+   is not supported by the build or the kernel, so that files are opened and
+   read one by one.  */
+extern uring_t *new_uring (unsigned);
+
+/* Frees the queue.  */
+extern void free_uring (uring_t *);
+
+/* Opens the nnames null terminated file names at names relative to the
+   directory dir_fd and obtains their status in one batch of requests.  The
+   contents of regular files up to AHEAD_SIZE characters are then read in a
+   second batch.  The results are stored in the nnames elements of ahead.
+   Files that could not be opened or read are left to the caller.  */
+extern void read_ahead (uring_t *, int, const char *, size_t, ahead_t *);
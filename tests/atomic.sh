@@ -0,0 +1,61 @@
+#!/bin/sh
+# Checks that --atomic replaces a file by a renamed copy with the contents,
+# mode and owner of the original and leaves no temporary file behind.
+#
+# Copyright 2026 Arno Onken <asnelt@asnelt.org>
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 3, or (at your option)
+# any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+: "${RREP:=../src/rrep}"
+dir=$(mktemp -d) || exit 1
+trap 'rm -rf "$dir"' 0
+mkdir "$dir/tree" || exit 1
+
+printf 'one foo\ntwo foo foo\nthree\n' > "$dir/tree/file.txt"
+chmod 640 "$dir/tree/file.txt" || exit 1
+# Only root can hand the file to another owner.
+owner_flag=false
+if [ "$(id -u)" -eq 0 ] && chown 12345:12345 "$dir/tree/file.txt"; then
+  owner_flag=true
+fi
+# The hard link keeps the original contents, as the file is replaced.
+ln "$dir/tree/file.txt" "$dir/link.txt" || exit 1
+before=$(ls -ln "$dir/tree/file.txt" | awk '{ print $1, $3, $4 }')
+
+"$RREP" --atomic foo bar "$dir/tree/file.txt" > /dev/null || exit 1
+
+status=0
+printf 'one bar\ntwo bar bar\nthree\n' > "$dir/expected"
+if ! cmp -s "$dir/expected" "$dir/tree/file.txt"; then
+  echo "file.txt: wrong contents" >&2
+  status=1
+fi
+if ! grep -q foo "$dir/link.txt"; then
+  echo "link.txt: hard link was rewritten in place" >&2
+  status=1
+fi
+after=$(ls -ln "$dir/tree/file.txt" | awk '{ print $1, $3, $4 }')
+if [ "$owner_flag" = false ]; then
+  before=${before%% *}
+  after=${after%% *}
+fi
+if [ "$before" != "$after" ]; then
+  echo "file.txt: mode or owner $after instead of $before" >&2
+  status=1
+fi
+if [ "$(ls -A "$dir/tree")" != file.txt ]; then
+  echo "temporary file left behind" >&2
+  status=1
+fi
+exit $status
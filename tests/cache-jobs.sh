@@ -0,0 +1,55 @@
+#!/bin/sh
+# Checks that files skipped by the no-match cache in parallel runs do not
+# hand their read-ahead contents to the next file of a task.
+#
+# Copyright 2026 Arno Onken <asnelt@asnelt.org>
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 3, or (at your option)
+# any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+: "${RREP:=../src/rrep}"
+dir=$(mktemp -d) || exit 1
+trap 'rm -rf "$dir"' 0
+mkdir "$dir/tree" || exit 1
+
+# Small files that do not match are recorded in the cache.  They must be
+# older than the run to be recorded.
+i=0
+while [ $i -lt 20 ]; do
+  echo "small file $i" > "$dir/tree/small$i.txt"
+  i=$((i + 1))
+done
+touch -d '1 hour ago' "$dir/tree"/small*.txt || exit 1
+"$RREP" -r -j2 --no-match-cache="$dir/cache" -F needle X "$dir/tree" \
+  || exit 1
+
+# Large files beyond the size that is read ahead share tasks with the
+# cached small files.
+i=0
+while [ $i -lt 5 ]; do
+  awk 'BEGIN { for (i = 0; i < 20000; i++) print "line " i; print "needle" }' \
+    > "$dir/tree/large$i.txt"
+  i=$((i + 1))
+done
+touch -d '1 hour ago' "$dir/tree"/large*.txt || exit 1
+"$RREP" -r -j2 --no-match-cache="$dir/cache" -F needle X "$dir/tree" \
+  > /dev/null || exit 1
+
+status=0
+for file in "$dir/tree"/large*.txt; do
+  if grep -q needle "$file" || ! grep -q '^X$' "$file"; then
+    echo "$file: pattern not replaced" >&2
+    status=1
+  fi
+done
+exit $status
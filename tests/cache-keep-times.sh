@@ -0,0 +1,40 @@
+#!/bin/sh
+# Checks that the no-match cache notices files that were rewritten with
+# --keep-times.
+#
+# Copyright 2026 Arno Onken <asnelt@asnelt.org>
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 3, or (at your option)
+# any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+: "${RREP:=../src/rrep}"
+dir=$(mktemp -d) || exit 1
+trap 'rm -rf "$dir"' 0
+mkdir "$dir/tree" || exit 1
+
+# The file must be older than the run to be recorded.
+echo "first foo" > "$dir/tree/a.txt"
+touch -d '1 hour ago' "$dir/tree/a.txt" || exit 1
+"$RREP" -r --no-match-cache="$dir/cache" -F bar baz "$dir/tree" \
+  > /dev/null || exit 1
+
+# The rewrite keeps the size and the modification time of a.txt, so only
+# its status change time tells that the record is stale.
+"$RREP" -r --keep-times -F foo bar "$dir/tree" > /dev/null || exit 1
+"$RREP" -r --no-match-cache="$dir/cache" -F bar baz "$dir/tree" \
+  > /dev/null || exit 1
+if ! grep -q '^first baz$' "$dir/tree/a.txt"; then
+  echo "a.txt: skipped by a stale cache record" >&2
+  exit 1
+fi
+exit 0
@@ -0,0 +1,64 @@
+#!/bin/sh
+# Checks that patterns with anchors and character classes are replaced the
+# same with the DFA and with regexec alone.
+#
+# Copyright 2026 Arno Onken <asnelt@asnelt.org>
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 3, or (at your option)
+# any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+: "${RREP:=../src/rrep}"
+dir=$(mktemp -d) || exit 1
+trap 'rm -rf "$dir"' 0
+
+cat > "$dir/input.txt" <<'END'
+foo bar baz
+  foo at the end foo
+Bar 42 and 7 and 1999
+tab	separated	words
+x
+
+word,word;WORD word_word
+abc123def 0x1F
+END
+
+status=0
+while IFS= read -r pattern; do
+  cp "$dir/input.txt" "$dir/dfa.txt" || exit 1
+  cp "$dir/input.txt" "$dir/regexec.txt" || exit 1
+  "$RREP" -E -e "$pattern" -p '<&>' "$dir/dfa.txt" > /dev/null
+  dfa_status=$?
+  "$RREP" -E --dfa-cache=0 -e "$pattern" -p '<&>' "$dir/regexec.txt" \
+    > /dev/null
+  regexec_status=$?
+  if [ $dfa_status -ne $regexec_status ] \
+     || ! cmp -s "$dir/dfa.txt" "$dir/regexec.txt"; then
+    echo "pattern $pattern: DFA and regexec differ" >&2
+    status=1
+  fi
+done <<'END'
+^foo
+foo$
+^$
+^[[:space:]]+
+[[:digit:]]+
+[^[:alnum:] ]+
+[[:upper:]][[:lower:]]*
+\<word\>
+\bwo
+^x$
+(foo|bar|baz)$
+[a-c]+[0-9]
+0x[[:xdigit:]]+
+END
+exit $status
@@ -0,0 +1,81 @@
+#!/bin/sh
+# Checks that --files0-from reads names from a file and from standard input,
+# reports empty names and still processes the other names.
+#
+# Copyright 2026 Arno Onken <asnelt@asnelt.org>
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 3, or (at your option)
+# any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+: "${RREP:=../src/rrep}"
+dir=$(mktemp -d) || exit 1
+trap 'rm -rf "$dir"' 0
+
+# Names may contain blanks and newlines, and the last one need not end with
+# a null character.
+make_files ()
+{
+  mkdir "$1" "$1/sub" || exit 1
+  echo foo > "$1/plain.txt"
+  echo foo > "$1/with blank.txt"
+  echo foo > "$1/with
+newline.txt"
+  echo foo > "$1/sub/nested.txt"
+  printf '%s\0' "$1/plain.txt" "$1/with blank.txt" "$1/with
+newline.txt" > "$1.list"
+  printf '%s' "$1/sub" >> "$1.list"
+}
+
+# Checks that all files of the directory $1 were rewritten.
+check_files ()
+{
+  for file in "$1/plain.txt" "$1/with blank.txt" "$1/with
+newline.txt" "$1/sub/nested.txt"; do
+    if grep -q foo "$file"; then
+      echo "$file: not processed" >&2
+      status=1
+    fi
+  done
+}
+
+status=0
+make_files "$dir/list"
+"$RREP" -r --files0-from="$dir/list.list" foo bar > /dev/null \
+  || status=1
+check_files "$dir/list"
+
+make_files "$dir/stdin"
+"$RREP" -r -j2 --files0-from=- foo bar < "$dir/stdin.list" > /dev/null \
+  || status=1
+check_files "$dir/stdin"
+
+# Empty names are an error, but the other names are processed.
+make_files "$dir/empty"
+{ printf '\0'; cat "$dir/empty.list"; printf '\0\0'; } > "$dir/empty.in"
+"$RREP" -r --files0-from=- foo bar < "$dir/empty.in" > /dev/null \
+  2> "$dir/empty.err"
+empty_status=$?
+nempty=$(grep -c 'zero-length' "$dir/empty.err")
+if [ $empty_status -eq 0 ] || [ "$nempty" -ne 2 ]; then
+  echo "empty names not reported" >&2
+  status=1
+fi
+check_files "$dir/empty"
+
+# Names cannot come from both the list and the command line.
+if "$RREP" --files0-from="$dir/list.list" foo bar "$dir/list/plain.txt" \
+     > /dev/null 2>&1; then
+  echo "file operand accepted with --files0-from" >&2
+  status=1
+fi
+exit $status
@@ -0,0 +1,69 @@
+#!/bin/sh
+# Checks that --gitignore applies negated patterns, directory patterns and
+# the rules of ignore files in subdirectories.
+#
+# Copyright 2026 Arno Onken <asnelt@asnelt.org>
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 3, or (at your option)
+# any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+: "${RREP:=../src/rrep}"
+dir=$(mktemp -d) || exit 1
+trap 'rm -rf "$dir"' 0
+tree="$dir/tree"
+mkdir -p "$tree/build/sub" "$tree/src/gen" "$tree/docs/build" "$tree/logs" \
+  || exit 1
+
+cat > "$tree/.gitignore" <<'END'
+# Directory patterns only match directories.
+/build/
+*.log
+!keep.log
+gen/
+END
+# A subdirectory adds its own rules, which override those above.
+printf 'notes.txt\n!gen/\n' > "$tree/docs/.gitignore"
+printf '*\n!important.txt\n' > "$tree/logs/.ignore"
+mkdir "$tree/docs/gen" || exit 1
+
+for file in build/a.txt build/sub/b.txt src/main.c src/gen/out.c \
+            docs/build/page.txt docs/notes.txt docs/readme.txt \
+            docs/gen/kept.txt debug.log keep.log logs/important.txt \
+            logs/other.txt; do
+  echo "foo in $file" > "$tree/$file" || exit 1
+done
+# A file named build is no directory, so /build/ does not match it.
+echo "foo in src/build" > "$tree/src/build"
+
+cp -R "$tree" "$dir/parallel" || exit 1
+"$RREP" -r --gitignore foo bar "$tree" > /dev/null || exit 1
+"$RREP" -r -j2 --gitignore foo bar "$dir/parallel" > /dev/null || exit 1
+
+status=0
+for tree in "$tree" "$dir/parallel"; do
+  for file in src/main.c docs/build/page.txt docs/readme.txt \
+              docs/gen/kept.txt keep.log logs/important.txt src/build; do
+    if grep -q foo "$tree/$file"; then
+      echo "$tree/$file: not processed" >&2
+      status=1
+    fi
+  done
+  for file in build/a.txt build/sub/b.txt src/gen/out.c docs/notes.txt \
+              debug.log logs/other.txt; do
+    if grep -q bar "$tree/$file"; then
+      echo "$tree/$file: ignored file processed" >&2
+      status=1
+    fi
+  done
+done
+exit $status
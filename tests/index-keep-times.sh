@@ -0,0 +1,50 @@
+#!/bin/sh
+# Checks that the index notices files that were rewritten with --keep-times,
+# both when it is used and when it is built again.
+#
+# Copyright 2026 Arno Onken <asnelt@asnelt.org>
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 3, or (at your option)
+# any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+: "${RREP:=../src/rrep}"
+dir=$(mktemp -d) || exit 1
+trap 'rm -rf "$dir"' 0
+mkdir "$dir/tree" || exit 1
+
+echo "first needle" > "$dir/tree/a.txt"
+echo "second nexdle" > "$dir/tree/b.txt"
+"$RREP" --build-index "$dir/tree" || exit 1
+
+# The rewrite keeps the size and the modification time of b.txt, so only
+# its status change time tells that the index is stale.
+"$RREP" --keep-times -F nexdle needle "$dir/tree/b.txt" > /dev/null \
+  || exit 1
+"$RREP" -r --use-index --dry-run -F needle X "$dir/tree" \
+  > "$dir/out" || exit 1
+status=0
+if ! grep -q 'b\.txt' "$dir/out"; then
+  echo "b.txt: skipped by a stale index" >&2
+  status=1
+fi
+
+# A new index must not take the old filter of b.txt.
+"$RREP" --build-index "$dir/tree" || exit 1
+"$RREP" -r --use-index -F needle X "$dir/tree" > /dev/null || exit 1
+for file in "$dir/tree"/*.txt; do
+  if grep -q needle "$file"; then
+    echo "$file: pattern not replaced" >&2
+    status=1
+  fi
+done
+exit $status
@@ -0,0 +1,57 @@
+#!/bin/sh
+# Checks that parallel runs over files named on the command line report and
+# rewrite them like a serial run.
+#
+# Copyright 2026 Arno Onken <asnelt@asnelt.org>
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 3, or (at your option)
+# any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+: "${RREP:=../src/rrep}"
+dir=$(mktemp -d) || exit 1
+trap 'rm -rf "$dir"' 0
+mkdir "$dir/serial" "$dir/parallel" || exit 1
+
+# Every third file has no match.
+i=0
+while [ $i -lt 40 ]; do
+  if [ $((i % 3)) -eq 0 ]; then
+    echo "plain line $i" > "$dir/serial/f$i.txt"
+  else
+    printf 'foo %d\nbar foo foo\n' $i > "$dir/serial/f$i.txt"
+  fi
+  i=$((i + 1))
+done
+cp "$dir"/serial/* "$dir/parallel" || exit 1
+
+"$RREP" -j1 foo baz "$dir"/serial/f*.txt > "$dir/serial.out"
+serial_status=$?
+"$RREP" -j4 foo baz "$dir"/parallel/f*.txt > "$dir/parallel.out"
+parallel_status=$?
+sed "s|^$dir/parallel/|$dir/serial/|" "$dir/parallel.out" > "$dir/renamed.out"
+
+status=0
+if [ $serial_status -ne $parallel_status ]; then
+  echo "exit status $parallel_status of -j4 instead of $serial_status" >&2
+  status=1
+fi
+# Files named on the command line are reported in their order.
+if ! cmp -s "$dir/serial.out" "$dir/renamed.out"; then
+  echo "reports of -j1 and -j4 differ" >&2
+  status=1
+fi
+if ! diff -r "$dir/serial" "$dir/parallel" > /dev/null; then
+  echo "files of -j1 and -j4 differ" >&2
+  status=1
+fi
+exit $status
@@ -0,0 +1,71 @@
+#!/bin/sh
+# Checks that the parallel walk of a directory tree reports and rewrites the
+# files like a serial walk and restores the directory times with
+# --keep-times.
+#
+# Copyright 2026 Arno Onken <asnelt@asnelt.org>
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 3, or (at your option)
+# any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+: "${RREP:=../src/rrep}"
+dir=$(mktemp -d) || exit 1
+trap 'rm -rf "$dir"' 0
+mkdir "$dir/serial" || exit 1
+
+# Directories of several levels hold more files than fit into one task.
+for a in 1 2 3; do
+  for b in 1 2 3 4; do
+    sub="$dir/serial/a$a/b$b"
+    mkdir -p "$sub" || exit 1
+    i=0
+    while [ $i -lt 40 ]; do
+      if [ $(((a + b + i) % 4)) -eq 0 ]; then
+        echo "plain $a $b $i" > "$sub/f$i.txt"
+      else
+        echo "foo $a $b $i foo" > "$sub/f$i.txt"
+      fi
+      i=$((i + 1))
+    done
+  done
+  echo "top foo $a" > "$dir/serial/a$a/top.txt"
+done
+cp -R "$dir/serial" "$dir/parallel" || exit 1
+touch -d '2000-01-01' "$dir/reference" || exit 1
+find "$dir/parallel" -type d -exec touch -d '1999-12-31' {} + || exit 1
+
+"$RREP" -r -j1 foo baz "$dir/serial" > "$dir/serial.out"
+serial_status=$?
+"$RREP" -r -j4 --keep-times foo baz "$dir/parallel" > "$dir/parallel.out"
+parallel_status=$?
+sed "s|^$dir/parallel/|$dir/serial/|" "$dir/parallel.out" > "$dir/renamed.out"
+
+status=0
+if [ $serial_status -ne $parallel_status ]; then
+  echo "exit status $parallel_status of -j4 instead of $serial_status" >&2
+  status=1
+fi
+# The reports are sorted by name within a walk.
+if ! LC_ALL=C sort "$dir/serial.out" | cmp -s - "$dir/renamed.out"; then
+  echo "reports of -j1 and -j4 differ" >&2
+  status=1
+fi
+if ! diff -r "$dir/serial" "$dir/parallel" > /dev/null; then
+  echo "files of -j1 and -j4 differ" >&2
+  status=1
+fi
+if [ -n "$(find "$dir/parallel" -type d -newer "$dir/reference")" ]; then
+  echo "directory times not restored" >&2
+  status=1
+fi
+exit $status
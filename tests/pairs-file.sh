@@ -0,0 +1,42 @@
+#!/bin/sh
+# Checks that --pairs-file replaces overlapping patterns leftmost first and
+# longest at the same position, in a single pass over the text.
+#
+# Copyright 2026 Arno Onken <asnelt@asnelt.org>
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 3, or (at your option)
+# any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+: "${RREP:=../src/rrep}"
+dir=$(mktemp -d) || exit 1
+trap 'rm -rf "$dir"' 0
+
+# Replacements are not searched again, so A stays as it is.
+printf 'foo\tA\nfoobar\tB\nbar\tC\nob\tD\nA\tZ\nabc\tX\nbcd\tY\n' \
+  > "$dir/pairs" || exit 1
+printf 'foobar foob obar barfoo\nabcd\n' > "$dir/file.txt"
+printf 'B Ab Dar CA\nXd\n' > "$dir/expected"
+cp "$dir/file.txt" "$dir/parallel.txt" || exit 1
+
+"$RREP" --pairs-file="$dir/pairs" "$dir/file.txt" > /dev/null || exit 1
+"$RREP" -j2 --pairs-file="$dir/pairs" "$dir/parallel.txt" > /dev/null \
+  || exit 1
+
+status=0
+for file in file parallel; do
+  if ! cmp -s "$dir/expected" "$dir/$file.txt"; then
+    echo "$file.txt: $(cat "$dir/$file.txt")" >&2
+    status=1
+  fi
+done
+exit $status